@@ -0,0 +1,744 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core.hpp"
+#include "dfttest2.h"
+#include "numa.hpp"
+
+#include <config.h> // generated by cmake
+
+static constexpr double pi = 3.14159265358979323846;
+
+// https://github.com/HomeOfVapourSynthEvolution/VapourSynth-DFTTest/blob/
+// bc5e0186a7f309556f20a8e9502f2238e39179b8/DFTTest/DFTTest.cpp#L518
+static void normalize(double * window, int size, int step) {
+    std::vector<double> nw(size);
+    for (int q = 0; q < size; q++) {
+        for (int h = q; h >= 0; h -= step) {
+            nw[q] += window[h] * window[h];
+        }
+        for (int h = q + step; h < size; h += step) {
+            nw[q] += window[h] * window[h];
+        }
+    }
+    for (int q = 0; q < size; q++) {
+        window[q] /= std::sqrt(nw[q]);
+    }
+}
+
+// https://github.com/HomeOfVapourSynthEvolution/VapourSynth-DFTTest/blob/
+// bc5e0186a7f309556f20a8e9502f2238e39179b8/DFTTest/DFTTest.cpp#L462
+static double get_window_value(double location, int size, int mode, double beta) {
+    double temp = pi * location / size;
+    switch (mode) {
+        case 0: // hanning
+            return 0.5 * (1 - std::cos(2 * temp));
+        case 1: // hamming
+            return 0.53836 - 0.46164 * std::cos(2 * temp);
+        case 2: // blackman
+            return 0.42 - 0.5 * std::cos(2 * temp) + 0.08 * std::cos(4 * temp);
+        case 3: // 4 term blackman-harris
+            return (
+                0.35875
+                - 0.48829 * std::cos(2 * temp)
+                + 0.14128 * std::cos(4 * temp)
+                - 0.01168 * std::cos(6 * temp)
+            );
+        case 4: { // kaiser-bessel
+            auto i0 = [](double p) -> double {
+                p /= 2;
+                double n = 1.0, t = 1.0, d = 1.0;
+                int k = 1;
+                while (true) {
+                    n *= p;
+                    d *= k;
+                    double v = n / d;
+                    t += v * v;
+                    k += 1;
+                    if (k >= 15 || v <= 1e-8) {
+                        break;
+                    }
+                }
+                return t;
+            };
+            double v = 2 * location / size - 1;
+            return i0(pi * beta * std::sqrt(1 - v * v)) / i0(pi * beta);
+        }
+        case 5: // 7 term blackman-harris
+            return (
+                0.27105140069342415
+                - 0.433297939234486060 * std::cos(2 * temp)
+                + 0.218122999543110620 * std::cos(4 * temp)
+                - 0.065925446388030898 * std::cos(6 * temp)
+                + 0.010811742098372268 * std::cos(8 * temp)
+                - 7.7658482522509342e-4 * std::cos(10 * temp)
+                + 1.3887217350903198e-5 * std::cos(12 * temp)
+            );
+        case 6: // flat top
+            return (
+                0.2810639
+                - 0.5208972 * std::cos(2 * temp)
+                + 0.1980399 * std::cos(4 * temp)
+            );
+        case 7: // rectangular
+            return 1.0;
+        case 8: // Bartlett
+            return 1 - 2 * std::abs(location - size / 2.0) / size;
+        case 9: // bartlett-hann
+            return 0.62 - 0.48 * (location / size - 0.5) - 0.38 * std::cos(2 * temp);
+        case 10: // nuttall
+            return (
+                0.355768
+                - 0.487396 * std::cos(2 * temp)
+                + 0.144232 * std::cos(4 * temp)
+                - 0.012604 * std::cos(6 * temp)
+            );
+        case 11: // blackman-nuttall
+            return (
+                0.3635819
+                - 0.4891775 * std::cos(2 * temp)
+                + 0.1365995 * std::cos(4 * temp)
+                - 0.0106411 * std::cos(6 * temp)
+            );
+        default:
+            return NAN;
+    }
+}
+
+// same as `get_window()` of dfttest2.py
+static std::vector<double> get_window(
+    int radius, int lookahead, int block_size, int block_step,
+    int spatial_window_mode, double spatial_beta,
+    int temporal_window_mode, double temporal_beta
+) {
+
+    // the temporal window peaks at the output frame
+    int output_slice = 2 * radius - lookahead;
+    int window_radius = std::max(output_slice, lookahead);
+    std::vector<double> temporal_window(2 * radius + 1);
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        temporal_window[i] = get_window_value(
+            i - output_slice + window_radius + 0.5, 2 * window_radius + 1,
+            temporal_window_mode, temporal_beta
+        );
+    }
+
+    std::vector<double> spatial_window(block_size);
+    for (int i = 0; i < block_size; i++) {
+        spatial_window[i] = get_window_value(i + 0.5, block_size, spatial_window_mode, spatial_beta);
+    }
+
+    normalize(spatial_window.data(), block_size, block_step);
+
+    std::vector<double> window;
+    window.reserve((2 * radius + 1) * block_size * block_size);
+    for (auto t_val : temporal_window) {
+        for (auto s_val1 : spatial_window) {
+            for (auto s_val2 : spatial_window) {
+                // normalize for unnormalized FFT implementation
+                window.push_back(t_val * s_val1 * s_val2 / (std::sqrt(2 * radius + 1) * block_size));
+            }
+        }
+    }
+
+    return window;
+}
+
+// padded planes of an input frame
+struct Frame {
+    AlignedArray<uint8_t> data;
+};
+
+struct Job {
+    std::array<std::shared_ptr<const Frame>, 7> srcs;
+    AlignedArray<float> result; // padded planes
+    bool done;
+};
+
+struct DFTTest2 {
+    DFTTestCore core;
+    DFTTest2Format format;
+    std::array<bool, 3> process;
+    int bytes_per_sample;
+    std::array<int, 3> widths;
+    std::array<int, 3> heights;
+    std::array<size_t, 3> plane_offsets; // in samples
+    size_t frame_size; // in samples
+
+    // recursive mode only, the filtered spectra of the previous frame
+    std::array<AlignedArray<float>, 3> recursive_states;
+    bool recursive_prior; // written by the single worker
+
+    // film grain table only, accumulated in `dfttest2_pull()`
+    std::string grain_path;
+    int grain_period;
+    int fps_num;
+    int fps_den;
+    std::vector<GrainSegment> grain_segments;
+    bool grain_written;
+
+    int max_pending;
+
+    std::mutex lock;
+    std::condition_variable work_cond; // a job is queued, or quit
+    std::condition_variable done_cond; // a job is done
+
+    std::map<int, std::shared_ptr<const Frame>> inputs;
+    std::map<int, Job> jobs;
+    std::deque<Job *> queue;
+    std::vector<AlignedArray<float>> free_results;
+    int num_pushed;
+    int num_scheduled;
+    int num_pulled;
+    bool finished;
+    bool quit;
+
+    std::vector<std::thread> workers;
+};
+
+// creates the jobs whose input frames are all available, requires `d->lock`
+static void schedule(DFTTest2 * d) {
+    int radius = d->core.radius;
+    int output_slice = d->core.output_slice;
+    int lookahead = 2 * radius - output_slice;
+
+    while (d->num_scheduled < d->num_pushed && (d->finished || d->num_scheduled + lookahead < d->num_pushed)) {
+        int n = d->num_scheduled++;
+
+        auto & job = d->jobs[n];
+        for (int i = 0; i < 2 * radius + 1; i++) {
+            job.srcs[i] = d->inputs.at(std::clamp(n - output_slice + i, 0, d->num_pushed - 1));
+        }
+
+        if (d->free_results.empty()) {
+            job.result = make_aligned_array<float>(d->frame_size);
+        } else {
+            job.result = std::move(d->free_results.back());
+            d->free_results.pop_back();
+        }
+
+        job.done = false;
+        d->queue.push_back(&job);
+        d->work_cond.notify_one();
+    }
+
+    // frames no longer referenced by future jobs
+    d->inputs.erase(d->inputs.begin(), d->inputs.lower_bound(d->num_scheduled - output_slice));
+}
+
+static void worker(DFTTest2 * d) {
+    auto workspace = alloc_workspace(d->core, d->widths[0], d->heights[0]);
+
+    while (true) {
+        Job * job;
+        {
+            std::unique_lock lock { d->lock };
+            d->work_cond.wait(lock, [d] { return d->quit || !d->queue.empty(); });
+            if (d->quit) {
+                break;
+            }
+            job = d->queue.front();
+            d->queue.pop_front();
+        }
+
+        for (int plane = 0; plane < d->format.num_planes; plane++) {
+            if (!d->process[plane]) {
+                continue;
+            }
+
+            std::array<const uint8_t *, 7> srcps;
+            for (int i = 0; i < 2 * d->core.radius + 1; i++) {
+                srcps[i] = &job->srcs[i]->data[d->plane_offsets[plane] * d->bytes_per_sample];
+            }
+
+            filter_plane(
+                &job->result[d->plane_offsets[plane]],
+                srcps.data(),
+                d->widths[plane], d->heights[plane],
+                d->format.bits_per_sample,
+                d->core,
+                workspace,
+                nullptr,
+                d->recursive_states[plane].get(),
+                d->recursive_prior
+            );
+        }
+        // jobs are queued in order
+        d->recursive_prior = d->core.recursive > 0.0f;
+
+        {
+            std::lock_guard _ { d->lock };
+            job->done = true;
+        }
+        d->done_cond.notify_all();
+    }
+
+    free_workspace(workspace);
+}
+
+static const char * init(DFTTest2 * d, const DFTTest2Params & params, const DFTTest2Format & format) {
+    if (format.sample_type == DFTTEST2_INTEGER && (format.bits_per_sample < 8 || format.bits_per_sample > 16)) {
+        return "only 8-16 bit integer format input is supported";
+    }
+    if (format.sample_type == DFTTEST2_FLOAT && format.bits_per_sample != 32) {
+        return "only 32-bit float format input is supported";
+    }
+    if (format.sample_type != DFTTEST2_INTEGER && format.sample_type != DFTTEST2_FLOAT) {
+        return "unknown sample type";
+    }
+    if (format.num_planes < 1 || format.num_planes > 3) {
+        return "\"num_planes\" must be in [1, 3]";
+    }
+    if (format.width <= 0 || format.height <= 0) {
+        return "invalid frame dimensions";
+    }
+
+    d->format = format;
+    d->bytes_per_sample = (format.bits_per_sample + 7) / 8;
+
+    if (params.planes & ~((1 << format.num_planes) - 1)) {
+        return "plane index out of range";
+    }
+    for (int plane = 0; plane < 3; plane++) {
+        d->process[plane] = params.planes & (1 << plane);
+    }
+
+    if (params.tbsize < 1 || params.tbsize % 2 == 0) {
+        return "\"tbsize\" must be odd";
+    }
+    if (params.sosize < 0 || params.sosize >= params.sbsize) {
+        return "\"sosize\" must be in [0, sbsize)";
+    }
+    if (params.swin < 0 || params.swin > 11 || params.twin < 0 || params.twin > 11) {
+        return "unknown window";
+    }
+    if (params.ftype < 0 || params.ftype > 4) {
+        return "\"ftype\" must be in [0, 4]";
+    }
+
+    int filter_type = params.ftype;
+    if (params.ftype == 0) {
+        if (std::abs(params.f0beta - 1) < 0.00005) {
+            filter_type = 0;
+        } else if (std::abs(params.f0beta - 0.5) < 0.0005) {
+            filter_type = 6;
+        } else {
+            filter_type = 5;
+        }
+    }
+
+    int radius = (params.tbsize - 1) / 2;
+    int block_size = params.sbsize;
+    int block_step = params.smode == 0 ? 1 : params.sbsize - params.sosize;
+
+    if (radius > 3) {
+        return "\"tbsize\" must be at most 7";
+    }
+    if (block_size != 16) {
+        return "\"sbsize\" must be 16";
+    }
+
+    int lookahead = params.lookahead < 0 ? radius : params.lookahead;
+    if (lookahead > 2 * radius) {
+        return "\"lookahead\" must be in [0, tbsize - 1]";
+    }
+
+    auto window = get_window(
+        radius, lookahead, block_size, block_step,
+        params.swin, params.sbeta,
+        params.twin, params.tbeta
+    );
+
+    double wscale = 0.0;
+    for (auto w : window) {
+        wscale += w * w;
+    }
+
+    double sigma_scale = params.ftype < 2 ? wscale : 1.0;
+
+    int sigma_size = (2 * radius + 1) * block_size * (block_size / 2 + 1);
+    std::vector<double> sigma(sigma_size);
+    if (params.auto_sigma > 0) {
+        // relative to the estimated noise power, which is already in the unit of the psd
+        for (int i = 0; i < sigma_size; i++) {
+            sigma[i] = (params.sigma_array ? params.sigma_array[i] : 1.0) * params.auto_sigma;
+        }
+    } else {
+        for (int i = 0; i < sigma_size; i++) {
+            sigma[i] = (params.sigma_array ? params.sigma_array[i] : params.sigma) * sigma_scale;
+        }
+    }
+
+    std::vector<double> window_scaled(window.size());
+    for (size_t i = 0; i < window.size(); i++) {
+        window_scaled[i] = window[i] * 255;
+    }
+
+    std::vector<std::complex<double>> window_freq(sigma_size);
+    if (radius == 0) {
+        const int shape[] { block_size, block_size };
+        real_dft(window_freq.data(), window_scaled.data(), 2, shape);
+    } else {
+        const int shape[] { 2 * radius + 1, block_size, block_size };
+        real_dft(window_freq.data(), window_scaled.data(), 3, shape);
+    }
+
+    DFTTestCoreArgs args;
+    args.radius = radius;
+    args.block_size = block_size;
+    args.block_step = block_step;
+    args.window = window.data();
+    args.sigma = sigma.data();
+    args.sigma2 = static_cast<float>(params.sigma2 * sigma_scale);
+    args.pmin = static_cast<float>(params.pmin * wscale);
+    args.pmax = static_cast<float>(params.pmax * wscale);
+    args.filter_type = filter_type;
+    args.zero_mean = params.zmean;
+    args.auto_sigma = params.auto_sigma > 0;
+    args.window_freq = reinterpret_cast<const double *>(window_freq.data());
+    args.sparse_block_step = params.flat_sosize < 0 ? 0 : block_size - params.flat_sosize;
+    args.sparse_threshold = params.flat_threshold;
+    args.lookahead = lookahead;
+    args.smode = params.smode;
+    args.recursive = params.recursive;
+    args.exclude_borders = params.exclude_borders;
+    args.align = params.align;
+
+    // the windows of the smaller temporal blocks, concatenated
+    std::vector<double> motion_window;
+    if (params.motion_threshold > 0) {
+        for (int r = 0; r < radius; r++) {
+            auto reduced_window = get_window(
+                r, r, block_size, block_step,
+                params.swin, params.sbeta,
+                params.twin, params.tbeta
+            );
+            motion_window.insert(motion_window.end(), reduced_window.begin(), reduced_window.end());
+        }
+        args.motion_threshold = params.motion_threshold;
+        args.motion_window = motion_window.data();
+    }
+
+    if (auto error_message = init_core(d->core, args, format.bits_per_sample); error_message) {
+        return error_message;
+    }
+
+    if (params.autotune) {
+        autotune(d->core, format.width, format.height, format.bits_per_sample);
+    }
+
+    d->frame_size = 0;
+    for (int plane = 0; plane < format.num_planes; plane++) {
+        d->widths[plane] = plane ? format.width >> format.subsampling_w : format.width;
+        d->heights[plane] = plane ? format.height >> format.subsampling_h : format.height;
+        d->plane_offsets[plane] = d->frame_size;
+        d->frame_size += (
+            static_cast<size_t>(calc_pad_size(d->heights[plane], block_size, block_step)) *
+            calc_pad_stride(d->widths[plane], block_size, block_step)
+        );
+    }
+
+    d->recursive_prior = false;
+    for (int plane = 0; plane < format.num_planes && d->core.recursive > 0.0f; plane++) {
+        if (d->process[plane]) {
+            d->recursive_states[plane] = make_aligned_array<float>(
+                spectrum_plane_size(d->widths[plane], d->heights[plane], d->core)
+            );
+        }
+    }
+
+    d->grain_written = true;
+    if (params.grain_table) {
+        if (params.grain_period < 0) {
+            return "\"grain_period\" must be non-negative";
+        }
+        if (params.fps_num <= 0 || params.fps_den <= 0) {
+            return "\"grain_table\" requires a frame rate";
+        }
+        d->grain_path = params.grain_table;
+        d->grain_period = params.grain_period;
+        d->fps_num = params.fps_num;
+        d->fps_den = params.fps_den;
+        d->grain_written = false;
+    }
+
+    int num_threads = params.num_threads;
+    if (num_threads <= 0) {
+        num_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    }
+    if (d->core.recursive > 0.0f) {
+        // frame n needs the state left by frame n - 1
+        num_threads = 1;
+    }
+
+    d->max_pending = lookahead + 2 * num_threads;
+    d->num_pushed = 0;
+    d->num_scheduled = 0;
+    d->num_pulled = 0;
+    d->finished = false;
+    d->quit = false;
+
+    d->workers.reserve(num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        d->workers.emplace_back(worker, d);
+    }
+
+    return nullptr;
+}
+
+void dfttest2_params_init(DFTTest2Params * params) {
+    *params = {};
+    params->ftype = 0;
+    params->sigma = 8.0f;
+    params->sigma_array = nullptr;
+    params->sigma2 = 8.0f;
+    params->pmin = 0.0f;
+    params->pmax = 500.0f;
+    params->sbsize = 16;
+    params->sosize = 12;
+    params->smode = 1;
+    params->tbsize = 3;
+    params->swin = 0;
+    params->twin = 7;
+    params->sbeta = 2.5f;
+    params->tbeta = 2.5f;
+    params->zmean = 1;
+    params->f0beta = 1.0f;
+    params->planes = 0b111;
+    params->flat_sosize = -1;
+    params->flat_threshold = 64.0f;
+    params->auto_sigma = 0.0f;
+    params->lookahead = -1;
+    params->motion_threshold = 0.0f;
+    params->recursive = 0.0f;
+    params->exclude_borders = 0;
+    params->align = 0;
+    params->grain_table = nullptr;
+    params->grain_period = 0;
+    params->fps_num = 0;
+    params->fps_den = 1;
+    params->autotune = 0;
+    params->num_threads = 0;
+}
+
+DFTTest2 * dfttest2_create(
+    const DFTTest2Params * params,
+    const DFTTest2Format * format,
+    char * error, size_t error_size
+) {
+
+    auto d = std::make_unique<DFTTest2>();
+
+    if (auto error_message = init(d.get(), *params, *format); error_message) {
+        if (error && error_size) {
+            std::snprintf(error, error_size, "%s", error_message);
+        }
+        return nullptr;
+    }
+
+    return d.release();
+}
+
+int dfttest2_push(
+    DFTTest2 * d,
+    const void * const planes[],
+    const ptrdiff_t strides[]
+) {
+
+    {
+        std::lock_guard _ { d->lock };
+
+        if (d->finished) {
+            return DFTTEST2_ERROR;
+        }
+
+        if (d->num_pushed - d->num_pulled >= d->max_pending) {
+            return DFTTEST2_AGAIN;
+        }
+    }
+
+    auto frame = std::make_shared<Frame>();
+    frame->data = make_aligned_array<uint8_t>(d->frame_size * d->bytes_per_sample);
+
+    for (int plane = 0; plane < d->format.num_planes; plane++) {
+        reflection_padding(
+            &frame->data[d->plane_offsets[plane] * d->bytes_per_sample],
+            static_cast<const uint8_t *>(planes[plane]),
+            d->widths[plane], d->heights[plane],
+            static_cast<int>(strides[plane] / d->bytes_per_sample),
+            d->core.block_size, d->core.block_step,
+            d->bytes_per_sample
+        );
+    }
+
+    std::lock_guard _ { d->lock };
+    d->inputs.emplace(d->num_pushed++, std::move(frame));
+    schedule(d);
+
+    return DFTTEST2_OK;
+}
+
+int dfttest2_finish(DFTTest2 * d) {
+    std::lock_guard _ { d->lock };
+    d->finished = true;
+    schedule(d);
+    return DFTTEST2_OK;
+}
+
+// in units of 1e-7 seconds
+static int64_t frame_time(const DFTTest2 * d, int n) {
+    return static_cast<int64_t>(n) * 10000000 * d->fps_den / d->fps_num;
+}
+
+// returns an error message on failure
+static const char * write_grain(const DFTTest2 * d) {
+    return write_grain_table(
+        d->grain_path.c_str(),
+        d->grain_segments.data(),
+        static_cast<int>(d->grain_segments.size())
+    );
+}
+
+int dfttest2_pull(
+    DFTTest2 * d,
+    void * const planes[],
+    const ptrdiff_t strides[],
+    int wait
+) {
+
+    Job * job;
+    {
+        std::unique_lock lock { d->lock };
+
+        if (d->finished && d->num_pulled == d->num_pushed) {
+            if (!d->grain_written) {
+                d->grain_written = true;
+                if (write_grain(d)) {
+                    return DFTTEST2_ERROR;
+                }
+            }
+            return DFTTEST2_EOF;
+        }
+
+        auto it = d->jobs.find(d->num_pulled);
+        if (it == d->jobs.end()) {
+            return DFTTEST2_AGAIN;
+        }
+        job = &it->second;
+
+        if (!job->done) {
+            if (!wait) {
+                return DFTTEST2_AGAIN;
+            }
+            d->done_cond.wait(lock, [job] { return job->done; });
+        }
+    }
+
+    const auto & core = d->core;
+
+    if (!d->grain_written) {
+        // frames are pulled in order
+        int segment = d->grain_period ? d->num_pulled / d->grain_period : 0;
+        if (segment == static_cast<int>(d->grain_segments.size())) {
+            d->grain_segments.emplace_back();
+            d->grain_segments.back().start_time = frame_time(d, d->num_pulled);
+        }
+        auto & entry = d->grain_segments.back();
+        entry.end_time = frame_time(d, d->num_pulled + 1);
+
+        for (int plane = 0; plane < d->format.num_planes; plane++) {
+            if (d->process[plane]) {
+                accumulate_grain(
+                    entry.planes[plane],
+                    &job->result[d->plane_offsets[plane]],
+                    &job->srcs[core.output_slice]->data[d->plane_offsets[plane] * d->bytes_per_sample],
+                    d->widths[plane], d->heights[plane],
+                    d->format.bits_per_sample,
+                    core
+                );
+            }
+        }
+    }
+
+    for (int plane = 0; plane < d->format.num_planes; plane++) {
+        int width = d->widths[plane];
+        int height = d->heights[plane];
+        auto dstp = static_cast<uint8_t *>(planes[plane]);
+
+        if (d->process[plane]) {
+            store_plane(
+                dstp,
+                &job->result[d->plane_offsets[plane]],
+                width, height,
+                static_cast<int>(strides[plane] / d->bytes_per_sample),
+                d->format.bits_per_sample,
+                core
+            );
+        } else {
+            int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+            int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+            int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+            int offset_y = (pad_height - height) / 2;
+            int offset_x = (pad_width - width) / 2;
+
+            auto srcp = &job->srcs[core.output_slice]->data[
+                (d->plane_offsets[plane] + offset_y * pad_stride + offset_x) * d->bytes_per_sample
+            ];
+            for (int y = 0; y < height; y++) {
+                std::memcpy(
+                    &dstp[y * strides[plane]],
+                    &srcp[y * pad_stride * d->bytes_per_sample],
+                    width * d->bytes_per_sample
+                );
+            }
+        }
+    }
+
+    {
+        std::lock_guard _ { d->lock };
+        d->free_results.push_back(std::move(job->result));
+        d->jobs.erase(d->num_pulled++);
+    }
+
+    return DFTTEST2_OK;
+}
+
+void dfttest2_free(DFTTest2 * d) {
+    if (d == nullptr) {
+        return ;
+    }
+
+    {
+        std::lock_guard _ { d->lock };
+        d->quit = true;
+    }
+    d->work_cond.notify_all();
+
+    for (auto & thread : d->workers) {
+        thread.join();
+    }
+
+    // the stream was not pulled to the end
+    if (!d->grain_written) {
+        write_grain(d);
+    }
+
+    delete d;
+}
+
+const char * dfttest2_version(void) {
+    return VERSION;
+}
@@ -0,0 +1,2590 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#if __cplusplus >= 202002L
+#include <numbers>
+#endif
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__F16C__)
+#include <immintrin.h> // _cvtss_sh(), _cvtsh_ss()
+#endif
+
+#include "core.hpp"
+#include "numa.hpp"
+#include "tune.hpp"
+
+#ifndef DFTTEST2_PORTABLE
+// 9 is AVX-512F, including the operating system support for zmm registers
+const bool spatial_avx512 = instrset_detect() >= 9;
+#endif
+
+template <typename T, typename T_in>
+    requires
+        (std::is_same_v<T_in, T> || std::is_same_v<T_in, std::complex<T>>)
+static void dft(
+    std::complex<T> * __restrict dst,
+    const T_in * __restrict src,
+    int n,
+    int stride
+) {
+#if __cplusplus >= 202002L
+    const auto pi = std::numbers::pi_v<T>;
+#else
+    const auto pi = static_cast<T>(M_PI);
+#endif
+
+    int out_num = std::is_floating_point_v<T_in> ? (n / 2 + 1) : n;
+    for (int i = 0; i < out_num; i++) {
+        std::complex<T> sum {};
+        for (int j = 0; j < n; j++) {
+            auto imag = -2 * i * j * pi / n;
+            auto weight = std::complex(std::cos(imag), std::sin(imag));
+            sum += src[j * stride] * weight;
+        }
+        dst[i * stride] = sum;
+    }
+}
+
+template <typename T>
+static T square(const T & x) {
+    return x * x;
+}
+
+template <typename T>
+static void reflection_padding_impl(
+    T * __restrict dst, // shape: (pad_height, pad_stride)
+    const T * __restrict src, // shape: (height, stride)
+    int width, int height, int stride,
+    int block_size, int block_step
+) {
+
+    int pad_width = calc_pad_size(width, block_size, block_step);
+    int pad_height = calc_pad_size(height, block_size, block_step);
+    int pad_stride = calc_pad_stride(width, block_size, block_step);
+
+    int offset_y = (pad_height - height) / 2;
+    int offset_x = (pad_width - width) / 2;
+
+    for (int y = 0; y < height; y++) {
+        std::memcpy(&dst[(offset_y + y) * pad_stride + offset_x], &src[y * stride], width * sizeof(T));
+    }
+
+    // copy left and right regions
+    for (int y = offset_y; y < offset_y + height; y++) {
+        auto dst_line = &dst[y * pad_stride];
+
+        for (int x = 0; x < offset_x; x++) {
+            dst_line[x] = dst_line[offset_x * 2 - x];
+        }
+
+        for (int x = offset_x + width; x < pad_width; x++) {
+            dst_line[x] = dst_line[2 * (offset_x + width) - 2 - x];
+        }
+    }
+
+    // copy top region
+    for (int y = 0; y < offset_y; y++) {
+        std::memcpy(
+            &dst[y * pad_stride],
+            &dst[(offset_y * 2 - y) * pad_stride],
+            pad_width * sizeof(T)
+        );
+    }
+
+    // copy bottom region
+    for (int y = offset_y + height; y < pad_height; y++) {
+        std::memcpy(
+            &dst[y * pad_stride],
+            &dst[(2 * (offset_y + height) - 2 - y) * pad_stride],
+            pad_width * sizeof(T)
+        );
+    }
+}
+
+void reflection_padding(
+    uint8_t * __restrict dst, // shape: (pad_height, pad_stride)
+    const uint8_t * __restrict src, // shape: (height, stride)
+    int width, int height, int stride,
+    int block_size, int block_step,
+    int bytes_per_sample
+) {
+
+    if (bytes_per_sample == 1) {
+        reflection_padding_impl(
+            static_cast<uint8_t *>(dst),
+            static_cast<const uint8_t *>(src),
+            width, height, stride,
+            block_size, block_step
+        );
+    } else if (bytes_per_sample == 2) {
+        reflection_padding_impl(
+            reinterpret_cast<uint16_t *>(dst),
+            reinterpret_cast<const uint16_t *>(src),
+            width, height, stride,
+            block_size, block_step
+        );
+    } else if (bytes_per_sample == 4) {
+        reflection_padding_impl(
+            reinterpret_cast<uint32_t *>(dst),
+            reinterpret_cast<const uint32_t *>(src),
+            width, height, stride,
+            block_size, block_step
+        );
+    }
+}
+
+static void load_block(
+    Vec16f * __restrict block,
+    const uint8_t * const * srcs, // shape: (2 * radius + 1, pad_height, pad_stride)
+    int offset,
+    int radius,
+    int block_size,
+    int block_step,
+    int width,
+    int height,
+    const Vec16f * __restrict window,
+    int bits_per_sample
+) {
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    assert(block_size == 16);
+    block_size = 16; // unsafe
+
+    int offset_x = calc_pad_stride(width, block_size, block_step);
+
+    if (bytes_per_sample == 1) {
+        for (int i = 0; i < 2 * radius + 1; i++) {
+            for (int j = 0; j < block_size; j++) {
+                auto vec_input = Vec16uc().load((const uint8_t *) srcs[i] + offset + j * offset_x);
+                auto vec_input_f = to_float(Vec16i(extend(extend(vec_input))));
+                block[i * block_size * 2 + j] = scale * window[i * block_size + j] * vec_input_f;
+            }
+        }
+    }
+    if (bytes_per_sample == 2) {
+        for (int i = 0; i < 2 * radius + 1; i++) {
+            for (int j = 0; j < block_size; j++) {
+                auto vec_input = Vec16us().load((const uint16_t *) srcs[i] + offset + j * offset_x);
+                auto vec_input_f = to_float(Vec16i(extend(vec_input)));
+                block[i * block_size * 2 + j] = scale * window[i * block_size + j] * vec_input_f;
+            }
+        }
+    }
+    if (bytes_per_sample == 4) {
+        for (int i = 0; i < 2 * radius + 1; i++) {
+            for (int j = 0; j < block_size; j++) {
+                auto vec_input_f = Vec16f().load((const float *) srcs[i] + offset + j * offset_x);
+                block[i * block_size * 2 + j] = scale * window[i * block_size + j] * vec_input_f;
+            }
+        }
+    }
+}
+
+static inline Vec16f load_samples(const uint8_t * src, int bytes_per_sample) {
+    if (bytes_per_sample == 1) {
+        return to_float(Vec16i(extend(extend(Vec16uc().load(src)))));
+    } else if (bytes_per_sample == 2) {
+        return to_float(Vec16i(extend(Vec16us().load(reinterpret_cast<const uint16_t *>(src)))));
+    } else {
+        return Vec16f().load(reinterpret_cast<const float *>(src));
+    }
+}
+
+// Same as `load_block()`, with the temporal radius reduced to exclude the
+// nearest frames whose mean absolute difference to the centre frame is
+// above `threshold`, in the 8-bit scale. The frames are compared from the
+// centre outwards, so the frames beyond the first rejected pair are not
+// read. The 2 * r + 1 slices of reduced radius r are windowed by
+// `windows[r]` and stored at the start of `block`. Returns r.
+static int load_block_adaptive(
+    Vec16f * __restrict block,
+    const uint8_t * const * srcs, // shape: (2 * radius + 1, pad_height, pad_stride)
+    int offset,
+    int radius,
+    int block_size,
+    int block_step,
+    int width,
+    int height,
+    const Vec16f * const * windows, // windows of radius 0 to `radius`
+    float threshold,
+    int bits_per_sample
+) {
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    assert(block_size == 16);
+    block_size = 16; // unsafe
+
+    int offset_x = calc_pad_stride(width, block_size, block_step);
+
+    auto load_slice = [&](int i) {
+        for (int j = 0; j < block_size; j++) {
+            auto src = srcs[i] + (offset + j * offset_x) * bytes_per_sample;
+            block[i * block_size * 2 + j] = scale * load_samples(src, bytes_per_sample);
+        }
+    };
+
+    const Vec16f * centre = &block[radius * block_size * 2];
+    load_slice(radius);
+
+    float limit = threshold * block_size * block_size;
+    int reduced_radius = radius;
+    for (int distance = 1; distance <= radius && reduced_radius == radius; distance++) {
+        for (int i : { radius - distance, radius + distance }) {
+            load_slice(i);
+
+            Vec16f sum = 0.0f;
+            for (int j = 0; j < block_size; j++) {
+                sum += abs(block[i * block_size * 2 + j] - centre[j]);
+            }
+            if (horizontal_add(sum) > limit) {
+                reduced_radius = distance - 1;
+                break;
+            }
+        }
+    }
+
+    // slices only move towards the start of the block
+    int first = radius - reduced_radius;
+    auto window = windows[reduced_radius];
+    for (int i = 0; i < 2 * reduced_radius + 1; i++) {
+        for (int j = 0; j < block_size; j++) {
+            block[i * block_size * 2 + j] = window[i * block_size + j] * block[(first + i) * block_size * 2 + j];
+        }
+    }
+
+    return reduced_radius;
+}
+
+static void store_block(
+    float * __restrict shifted_dst,
+    const Vec16f * __restrict shifted_block,
+    int block_size,
+    int block_step,
+    int width,
+    int height,
+    const Vec16f * __restrict shifted_window
+) {
+
+    assert(block_size == 16);
+    block_size = 16; // unsafe
+
+    for (int i = 0; i < block_size; i++) {
+        Vec16f acc = Vec16f().load((const float *) shifted_dst + (i * calc_pad_stride(width, block_size, block_step)));
+        acc = mul_add(shifted_block[i], shifted_window[i], acc);
+        acc.store((float *) shifted_dst + (i * calc_pad_stride(width, block_size, block_step)));
+    }
+}
+
+// accumulates the overlap-add weight of a block, used when blocks are not
+// placed on a uniform grid
+static void store_weight(
+    float * __restrict shifted_dst,
+    int block_size,
+    int block_step,
+    int width,
+    int height,
+    const Vec16f * __restrict shifted_weight
+) {
+
+    assert(block_size == 16);
+    block_size = 16; // unsafe
+
+    for (int i = 0; i < block_size; i++) {
+        Vec16f acc = Vec16f().load((const float *) shifted_dst + (i * calc_pad_stride(width, block_size, block_step)));
+        acc += shifted_weight[i];
+        acc.store((float *) shifted_dst + (i * calc_pad_stride(width, block_size, block_step)));
+    }
+}
+
+// accumulates a half-resolution block and its weight
+static void store_half_block(
+    float * __restrict shifted_dst,
+    float * __restrict shifted_weight,
+    const Vec8f * __restrict half_block,
+    int stride,
+    const Vec8f * __restrict synthesis,
+    const Vec8f * __restrict weight
+) {
+
+    for (int i = 0; i < 8; i++) {
+        Vec8f acc = Vec8f().load(&shifted_dst[i * stride]);
+        acc = mul_add(half_block[i], synthesis[i], acc);
+        acc.store(&shifted_dst[i * stride]);
+
+        Vec8f weight_acc = Vec8f().load(&shifted_weight[i * stride]);
+        weight_acc += weight[i];
+        weight_acc.store(&shifted_weight[i * stride]);
+    }
+}
+
+static void normalize_weight(
+    float * __restrict shifted_dst,
+    const float * __restrict shifted_weight,
+    int width,
+    int height,
+    int stride
+) {
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            shifted_dst[y * stride + x] /= shifted_weight[y * stride + x];
+        }
+    }
+}
+
+// picture inside the uniform borders of a plane, [top, bottom) x [left, right)
+struct ActiveArea {
+    int top;
+    int bottom;
+    int left;
+    int right;
+};
+
+// Finds the rows and columns at the edges of a plane that only hold the
+// value of the corner sample of their edge. `src` points to the first sample
+// of the picture and `stride` is in bytes. Whole rows are compared with
+// memcmp, and the side borders are narrowed row by row, so the cost is a
+// pass over the borders and the first mismatching samples.
+static ActiveArea find_active_area(
+    const uint8_t * src,
+    int width,
+    int height,
+    int stride,
+    int bytes_per_sample
+) {
+
+    auto row = [&](int y) {
+        return &src[static_cast<size_t>(y) * stride];
+    };
+    auto equal = [&](const uint8_t * a, const uint8_t * b) {
+        return std::memcmp(a, b, bytes_per_sample) == 0;
+    };
+
+    // a row of the value of the current edge
+    std::vector<uint8_t> pattern(static_cast<size_t>(width) * bytes_per_sample);
+    auto fill = [&](const uint8_t * sample) {
+        for (int x = 0; x < width; x++) {
+            std::memcpy(&pattern[x * bytes_per_sample], sample, bytes_per_sample);
+        }
+    };
+
+    ActiveArea area { 0, height, 0, width };
+    size_t row_size = static_cast<size_t>(width) * bytes_per_sample;
+
+    fill(row(0));
+    while (area.top < height && std::memcmp(row(area.top), pattern.data(), row_size) == 0) {
+        area.top++;
+    }
+    if (area.top == height) {
+        return { 0, 0, 0, 0 };
+    }
+
+    fill(row(height - 1));
+    while (area.bottom > area.top && std::memcmp(row(area.bottom - 1), pattern.data(), row_size) == 0) {
+        area.bottom--;
+    }
+    if (area.bottom == area.top) {
+        return { 0, 0, 0, 0 };
+    }
+
+    fill(row(area.top));
+    area.left = width;
+    for (int y = area.top; y < area.bottom && area.left > 0; y++) {
+        if (std::memcmp(row(y), pattern.data(), area.left * bytes_per_sample)) {
+            int x = 0;
+            while (equal(&row(y)[x * bytes_per_sample], pattern.data())) {
+                x++;
+            }
+            area.left = x;
+        }
+    }
+
+    fill(&row(area.top)[(width - 1) * bytes_per_sample]);
+    area.right = 0;
+    for (int y = area.top; y < area.bottom && area.right < width; y++) {
+        auto tail = &row(y)[area.right * bytes_per_sample];
+        if (std::memcmp(tail, pattern.data(), (width - area.right) * bytes_per_sample)) {
+            int x = width;
+            while (equal(&row(y)[(x - 1) * bytes_per_sample], pattern.data())) {
+                x--;
+            }
+            area.right = x;
+        }
+    }
+
+    // rows made of a left and a right border only
+    if (area.left >= area.right) {
+        area.left = 0;
+        area.right = width;
+    }
+
+    return area;
+}
+
+static inline float load_sample(const uint8_t * src, int bytes_per_sample) {
+    if (bytes_per_sample == 1) {
+        return *src;
+    } else if (bytes_per_sample == 2) {
+        return *reinterpret_cast<const uint16_t *>(src);
+    } else {
+        return *reinterpret_cast<const float *>(src);
+    }
+}
+
+// Writes the samples of `shifted_src` outside of `area` to `shifted_dst`,
+// in the scale of the filtered samples.
+static void copy_borders(
+    float * __restrict shifted_dst,
+    const uint8_t * __restrict shifted_src,
+    int width,
+    int height,
+    int stride,
+    const ActiveArea & area,
+    int bits_per_sample
+) {
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    for (int y = 0; y < height; y++) {
+        bool border_row = y < area.top || y >= area.bottom;
+        for (int x = 0; x < width; x++) {
+            if (border_row || x < area.left || x >= area.right) {
+                auto src = &shifted_src[(static_cast<size_t>(y) * stride + x) * bytes_per_sample];
+                shifted_dst[y * stride + x] = scale * load_sample(src, bytes_per_sample);
+            }
+        }
+    }
+}
+
+// Marks the tiles of block positions that need the dense block grid.
+//
+// The gradient energy of a tile is measured over the footprint of the blocks
+// whose top-left corner lies in the tile, i.e. the 2x2 tiles starting at it
+// (block_size == 16 == tile_size).
+template <typename T>
+static void compute_dense_tiles_impl(
+    uint8_t * __restrict dense, // shape: (tile_num_y, tile_num_x)
+    float * __restrict energy, // shape: (tile_num_y, tile_num_x)
+    const T * __restrict src, // shape: (pad_height, pad_stride)
+    int pad_width, int pad_height, int pad_stride,
+    float threshold
+) {
+
+    int tile_num_x = calc_tile_num(pad_width);
+    int tile_num_y = calc_tile_num(pad_height);
+
+    std::fill_n(energy, tile_num_y * tile_num_x, 0.0f);
+
+    for (int y = 0; y < pad_height - 1; y++) {
+        auto line = &src[y * pad_stride];
+        auto energy_line = &energy[(y / tile_size) * tile_num_x];
+
+        for (int x = 0; x < pad_width - 1; x++) {
+            auto dx = static_cast<float>(line[x + 1]) - static_cast<float>(line[x]);
+            auto dy = static_cast<float>(line[x + pad_stride]) - static_cast<float>(line[x]);
+            energy_line[x / tile_size] += dx * dx + dy * dy;
+        }
+    }
+
+    for (int ty = 0; ty < tile_num_y; ty++) {
+        for (int tx = 0; tx < tile_num_x; tx++) {
+            float sum = 0.0f;
+            for (int i = ty; i < std::min(ty + 2, tile_num_y); i++) {
+                for (int j = tx; j < std::min(tx + 2, tile_num_x); j++) {
+                    sum += energy[i * tile_num_x + j];
+                }
+            }
+            dense[ty * tile_num_x + tx] = sum > threshold * (4 * tile_size * tile_size);
+        }
+    }
+}
+
+static void compute_dense_tiles(
+    uint8_t * __restrict dense,
+    float * __restrict energy,
+    const uint8_t * __restrict src,
+    int width, int height,
+    int block_size, int block_step,
+    float threshold, // mean squared gradient, in 8-bit units
+    int bits_per_sample
+) {
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+    threshold /= scale * scale;
+
+    int pad_width = calc_pad_size(width, block_size, block_step);
+    int pad_height = calc_pad_size(height, block_size, block_step);
+    int pad_stride = calc_pad_stride(width, block_size, block_step);
+
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    if (bytes_per_sample == 1) {
+        compute_dense_tiles_impl(dense, energy, src, pad_width, pad_height, pad_stride, threshold);
+    } else if (bytes_per_sample == 2) {
+        compute_dense_tiles_impl(dense, energy, reinterpret_cast<const uint16_t *>(src), pad_width, pad_height, pad_stride, threshold);
+    } else if (bytes_per_sample == 4) {
+        compute_dense_tiles_impl(dense, energy, reinterpret_cast<const float *>(src), pad_width, pad_height, pad_stride, threshold);
+    }
+}
+
+static void store_frame(
+    uint8_t * __restrict dst,
+    const float * __restrict shifted_src,
+    int width,
+    int height,
+    int dst_stride,
+    int src_stride,
+    int bits_per_sample
+) {
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+    int peak = (1 << bits_per_sample) - 1;
+
+    if (bytes_per_sample == 1) {
+        auto dstp = (uint8_t *) dst;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                auto clamped = std::clamp(static_cast<int>(shifted_src[y * src_stride + x] / scale + 0.5f), 0, peak);
+                dstp[y * dst_stride + x] = static_cast<uint8_t>(clamped);
+            }
+        }
+    }
+    if (bytes_per_sample == 2) {
+        auto dstp = (uint16_t *) dst;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                auto clamped = std::clamp(static_cast<int>(shifted_src[y * src_stride + x] / scale + 0.5f), 0, peak);
+                dstp[y * dst_stride + x] = static_cast<uint16_t>(clamped);
+            }
+        }
+    }
+    if (bytes_per_sample == 4) {
+        auto dstp = (float *) dst;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                dstp[y * dst_stride + x] = shifted_src[y * src_stride + x] / scale;
+            }
+        }
+    }
+}
+
+const char * init_core(DFTTestCore & core, const DFTTestCoreArgs & args, int bits_per_sample) {
+    core.radius = args.radius;
+    if (core.radius < 0 || core.radius > 3) {
+        return "\"radius\" must be in [0, 1, 2, 3]";
+    }
+
+    int lookahead = args.lookahead < 0 ? core.radius : args.lookahead;
+    if (lookahead > 2 * core.radius) {
+        return "\"lookahead\" must be in [0, 2 * radius]";
+    }
+    core.output_slice = 2 * core.radius - lookahead;
+    core.strip_width = 0;
+
+    core.block_size = args.block_size;
+    if (core.block_size != 16) {
+        return "\"block_size\" must be 16";
+    }
+
+    core.block_step = args.block_step;
+    if (core.block_step < 1 || core.block_step > core.block_size) {
+        return "\"block_step\" must be in [1, block_size]";
+    }
+
+    core.sparse_block_step = args.sparse_block_step;
+    if (core.sparse_block_step && (
+        core.sparse_block_step <= core.block_step ||
+        core.sparse_block_step > core.block_size / 2 ||
+        core.sparse_block_step % core.block_step
+    )) {
+        return "\"sparse_block_step\" must be a multiple of \"block_step\" in (block_step, block_size / 2]";
+    }
+    core.sparse_threshold = args.sparse_threshold;
+
+    core.smode = args.smode;
+    if (core.smode != 0 && core.smode != 1) {
+        return "\"smode\" must be 0 or 1";
+    }
+    if (core.smode == 0 && (core.block_step != 1 || core.sparse_block_step)) {
+        return "\"smode\" 0 requires \"block_step\" 1, and is not supported with \"sparse_block_step\"";
+    }
+
+    // a single frame has nothing to reduce
+    core.motion_threshold = core.radius > 0 ? args.motion_threshold : 0.0f;
+    if (core.motion_threshold < 0.0f) {
+        return "\"motion_threshold\" must not be negative";
+    }
+    if (core.motion_threshold > 0.0f) {
+        if (core.output_slice != core.radius) {
+            return "\"motion_threshold\" requires \"lookahead\" equal to radius";
+        }
+        if (core.smode == 0) {
+            return "\"motion_threshold\" is not supported with \"smode\" 0";
+        }
+        if (args.motion_window == nullptr) {
+            return "\"motion_window\" is required when \"motion_threshold\" is set";
+        }
+    }
+
+    core.downscale = args.downscale;
+    if (core.downscale) {
+        if (core.block_step % 2) {
+            return "\"downscale\" requires an even \"block_step\"";
+        }
+        if (core.smode == 0 || core.sparse_block_step || core.motion_threshold > 0.0f) {
+            return "\"downscale\" is not supported with \"smode\" 0, \"sparse_block_step\" or \"motion_threshold\"";
+        }
+    }
+
+    core.recursive = args.recursive;
+    if (core.recursive < 0.0f || core.recursive >= 1.0f) {
+        return "\"recursive\" must be in [0, 1)";
+    }
+    if (core.recursive > 0.0f) {
+        if (core.radius != 0) {
+            return "\"recursive\" requires radius 0";
+        }
+        if (core.smode == 0 || core.sparse_block_step || core.downscale) {
+            return "\"recursive\" is not supported with \"smode\" 0, \"sparse_block_step\" or \"downscale\"";
+        }
+    }
+
+    core.exclude_borders = args.exclude_borders;
+    if (core.exclude_borders && (core.smode == 0 || core.downscale || core.recursive > 0.0f)) {
+        return "\"exclude_borders\" is not supported with \"smode\" 0, \"downscale\" or \"recursive\"";
+    }
+
+    // the correlation surface of a block covers displacements in [-8, 8)
+    core.align = core.radius > 0 ? args.align : 0;
+    if (core.align < 0 || core.align > core.block_size / 2 - 1) {
+        return "\"align\" must be in [0, block_size / 2 - 1]";
+    }
+    if (core.align > 0 && (core.smode == 0 || core.motion_threshold > 0.0f || core.downscale)) {
+        return "\"align\" is not supported with \"smode\" 0, \"motion_threshold\" or \"downscale\"";
+    }
+
+    core.window = std::make_unique<Vec16f []>((2 * core.radius + 1) * core.block_size * core.block_size / 16);
+    {
+        auto window = args.window;
+        for (int i = 0; i < (2 * core.radius + 1) * core.block_size * core.block_size / 16; i++) {
+            core.window[i] = Vec16f(to_float(Vec8d().load(&window[i * 16])), to_float(Vec8d().load(&window[i * 16 + 8])));
+        }
+    }
+
+    if (core.align > 0) {
+        // 2D spectra of the slices of the window, the mean of each slice is
+        // removed before correlating it
+        core.slice_window_freq = std::make_unique<Vec16f []>((2 * core.radius + 1) * core.block_size * 2);
+        for (int i = 0; i < 2 * core.radius + 1; i++) {
+            auto slice = &core.slice_window_freq[i * core.block_size * 2];
+            std::copy_n(&core.window[i * core.block_size], core.block_size, slice);
+            std::fill_n(&slice[core.block_size], core.block_size, Vec16f(0.0f));
+            forward_spatial(slice);
+            if (!(slice[0].extract(0) > 0.0f)) {
+                return "\"align\" requires a window of positive sum in every frame";
+            }
+        }
+    }
+
+    if (core.smode == 0) {
+        auto window = args.window;
+        int block_size = core.block_size;
+        int centre = block_size / 2;
+        auto window_at = [&](int t, int y, int x) {
+            return window[(t * block_size + y) * block_size + x];
+        };
+
+        double centre_value = window_at(core.output_slice, centre, centre);
+        if (!(centre_value > 0.0)) {
+            return "\"smode\" 0 requires a positive window at the centre of the block";
+        }
+
+        core.window_x = std::make_unique<float []>(block_size);
+        for (int x = 0; x < block_size; x++) {
+            core.window_x[x] = static_cast<float>(window_at(core.output_slice, centre, x) / centre_value);
+        }
+
+        core.window_ty = std::make_unique<float []>((2 * core.radius + 1) * block_size);
+        for (int i = 0; i < (2 * core.radius + 1) * block_size; i++) {
+            core.window_ty[i] = static_cast<float>(window_at(i / block_size, i % block_size, centre));
+        }
+
+        // the horizontal and vertical stages apply the two factors separately
+        double max_value = 0.0;
+        double max_error = 0.0;
+        for (int i = 0; i < (2 * core.radius + 1) * block_size * block_size; i++) {
+            double value = window[i];
+            double product = window_at(i / (block_size * block_size), (i / block_size) % block_size, centre) *
+                window_at(core.output_slice, centre, i % block_size) / centre_value;
+            max_value = std::max(max_value, std::abs(value));
+            max_error = std::max(max_error, std::abs(value - product));
+        }
+        if (max_error > 1e-6 * max_value) {
+            return "\"smode\" 0 requires a separable window";
+        }
+
+        // Real part of the unnormalized inverse dft at the centre sample,
+        // divided by the gain of the unnormalized transforms and by the
+        // window value there. Columns 1 to 7 stand for their conjugates.
+#if __cplusplus >= 202002L
+        const auto pi = std::numbers::pi;
+#else
+        const auto pi = M_PI;
+#endif
+        double scale = 1.0 / ((2 * core.radius + 1) * block_size * block_size * centre_value);
+        core.centre_weight = std::make_unique<Vec16f []>(block_size * 2);
+        for (int y = 0; y < block_size; y++) {
+            float weight_re[16] {};
+            float weight_im[16] {};
+            for (int x = 0; x < block_size / 2 + 1; x++) {
+                double multiplicity = (x == 0 || x == block_size / 2) ? 1.0 : 2.0;
+                double angle = 2.0 * pi * (y + x) * centre / block_size;
+                weight_re[x] = static_cast<float>(multiplicity * scale * std::cos(angle));
+                weight_im[x] = static_cast<float>(-multiplicity * scale * std::sin(angle));
+            }
+            core.centre_weight[y * 2] = Vec16f().load(&weight_re[0]);
+            core.centre_weight[y * 2 + 1] = Vec16f().load(&weight_im[0]);
+        }
+    }
+
+    if (core.downscale) {
+#if __cplusplus >= 202002L
+        const auto pi = std::numbers::pi;
+#else
+        const auto pi = M_PI;
+#endif
+        int block_size = core.block_size;
+        const double * window = &args.window[core.output_slice * block_size * block_size];
+
+        // frequencies -3 to 3 in both directions
+        auto frequency = [](int i) { return i < 4 ? i : i - 8; };
+
+        core.half_phase = std::make_unique<Vec8f []>(16);
+        for (int i = 0; i < 8; i++) {
+            float phase_re[8] {};
+            float phase_im[8] {};
+            for (int j = 0; j < 4 && i != 4; j++) {
+                double angle = pi * (frequency(i) + j) / block_size;
+                phase_re[j] = static_cast<float>(std::cos(angle));
+                phase_im[j] = static_cast<float>(std::sin(angle));
+            }
+            core.half_phase[i * 2] = Vec8f().load(&phase_re[0]);
+            core.half_phase[i * 2 + 1] = Vec8f().load(&phase_im[0]);
+        }
+
+        core.half_basis = std::make_unique<Vec8f []>(8);
+        for (int j = 0; j < 4; j++) {
+            double multiplicity = j == 0 ? 1.0 : 2.0;
+            float basis_re[8];
+            float basis_im[8];
+            for (int x = 0; x < 8; x++) {
+                basis_re[x] = static_cast<float>(multiplicity * std::cos(2 * pi * j * x / 8));
+                basis_im[x] = static_cast<float>(multiplicity * std::sin(2 * pi * j * x / 8));
+            }
+            core.half_basis[j * 2] = Vec8f().load(&basis_re[0]);
+            core.half_basis[j * 2 + 1] = Vec8f().load(&basis_im[0]);
+        }
+
+        // The half-resolution synthesis of the window of the output slice,
+        // i.e. the block of a constant plane divided by its value and by the
+        // gain of the unnormalized transforms.
+        std::complex<double> window_spectrum[7][7] {};
+        for (int k = -3; k <= 3; k++) {
+            for (int l = -3; l <= 3; l++) {
+                for (int y = 0; y < block_size; y++) {
+                    for (int x = 0; x < block_size; x++) {
+                        window_spectrum[k + 3][l + 3] += window[y * block_size + x] *
+                            std::polar(1.0, -2 * pi * (k * y + l * x) / block_size);
+                    }
+                }
+            }
+        }
+
+        float gain = static_cast<float>((2 * core.radius + 1) * block_size * block_size);
+        core.half_synthesis = std::make_unique<Vec8f []>(8);
+        core.half_weight = std::make_unique<Vec8f []>(8);
+        for (int y = 0; y < 8; y++) {
+            float synthesis[8];
+            for (int x = 0; x < 8; x++) {
+                double sum = 0.0;
+                for (int k = -3; k <= 3; k++) {
+                    for (int l = -3; l <= 3; l++) {
+                        auto angle = 2 * pi * (k * (2 * y + 0.5) + l * (2 * x + 0.5)) / block_size;
+                        sum += (window_spectrum[k + 3][l + 3] * std::polar(1.0, angle)).real();
+                    }
+                }
+                synthesis[x] = static_cast<float>(sum / (block_size * block_size));
+            }
+            core.half_synthesis[y] = Vec8f().load(&synthesis[0]);
+            core.half_weight[y] = gain * square(core.half_synthesis[y]);
+        }
+    }
+
+    if (core.sparse_block_step) {
+        // unnormalized forward and inverse dft scale the block by its size
+        float gain = static_cast<float>((2 * core.radius + 1) * core.block_size * core.block_size);
+
+        core.window_weight = std::make_unique<Vec16f []>(core.block_size * core.block_size / 16);
+        for (int i = 0; i < core.block_size * core.block_size / 16; i++) {
+            core.window_weight[i] = gain * core.window[core.output_slice * core.block_size + i] * core.window[core.radius * core.block_size * 2 + i];
+        }
+    }
+
+    core.sigma = std::make_unique<Vec16f []>((2 * core.radius + 1) * core.block_size * ((core.block_size / 2 + 1 + 15) / 16));
+    {
+        auto sigma = args.sigma;
+        for (int i = 0; i < (2 * core.radius + 1) * core.block_size; i++) {
+            float sigma_padded[16] {};
+            for (int j = 0; j < core.block_size / 2 + 1; j++) {
+                sigma_padded[j] = static_cast<float>(sigma[i * (core.block_size / 2 + 1) + j]);
+            }
+            core.sigma[i] = Vec16f().load(&sigma_padded[0]);
+        }
+    }
+
+    core.sigma2 = args.sigma2;
+    core.pmin = args.pmin;
+    core.pmax = args.pmax;
+
+    core.filter_type = args.filter_type;
+    if (core.filter_type < 0 || core.filter_type > 6) {
+        return "\"filter_type\" must be in [0, 6]";
+    }
+
+    core.auto_sigma = args.auto_sigma;
+    if (core.auto_sigma && (core.filter_type >= 2 && core.filter_type <= 4)) {
+        // sigma is a threshold on the psd only for these filters
+        return "\"auto_sigma\" requires \"filter_type\" 0, 1, 5 or 6";
+    }
+    if (core.recursive > 0.0f && (core.filter_type >= 2 && core.filter_type <= 4)) {
+        // the noise power of the recursive estimate scales sigma
+        return "\"recursive\" requires \"filter_type\" 0, 1, 5 or 6";
+    }
+
+    core.zero_mean = args.zero_mean;
+    if (core.zero_mean) {
+        if (args.window_freq == nullptr) {
+            return "\"window_freq\" is required when \"zero_mean\" is set";
+        }
+
+        core.window_freq = std::make_unique<Vec16f []>((2 * core.radius + 1) * core.block_size * ((core.block_size / 2 + 1 + 15) / 16) * 2);
+        auto window_freq = args.window_freq;
+        for (int i = 0; i < (2 * core.radius + 1) * core.block_size; i++) {
+            float sigma_padded[32] {};
+            for (int j = 0; j < core.block_size / 2 + 1; j++) {
+                sigma_padded[j] = static_cast<float>(window_freq[(i * (core.block_size / 2 + 1) + j) * 2]);
+                sigma_padded[16 + j] = static_cast<float>(window_freq[(i * (core.block_size / 2 + 1) + j) * 2 + 1]);
+            }
+            core.window_freq[i * 2] = Vec16f().load(&sigma_padded[0]);
+            core.window_freq[i * 2 + 1] = Vec16f().load(&sigma_padded[16]);
+        }
+    }
+
+    if (core.motion_threshold > 0.0f) {
+        int block_size = core.block_size;
+        int slice_size = block_size * block_size;
+        int radius = core.radius;
+
+        auto energy = [](const double * window, int size) {
+            double sum = 0.0;
+            for (int i = 0; i < size; i++) {
+                sum += window[i] * window[i];
+            }
+            return sum;
+        };
+        double full_energy = energy(args.window, (2 * radius + 1) * slice_size);
+        double full_centre = std::accumulate(&args.window[radius * slice_size], &args.window[(radius + 1) * slice_size], 0.0);
+
+        core.motion_window = std::make_unique<Vec16f []>(radius * radius * slice_size / 16);
+        if (core.zero_mean) {
+            core.motion_window_freq = std::make_unique<Vec16f []>(radius * radius * block_size * 2);
+        }
+        core.motion_sigma = std::make_unique<Vec16f []>(radius * radius * block_size);
+        core.motion_synthesis = std::make_unique<Vec16f []>(radius * slice_size / 16);
+
+        for (int r = 0; r < radius; r++) {
+            const double * window = &args.motion_window[r * r * slice_size];
+            int num_slices = 2 * r + 1;
+
+            for (int i = 0; i < num_slices * slice_size / 16; i++) {
+                core.motion_window[r * r * slice_size / 16 + i] = Vec16f(
+                    to_float(Vec8d().load(&window[i * 16])),
+                    to_float(Vec8d().load(&window[i * 16 + 8]))
+                );
+            }
+
+            // the psd of white noise is proportional to the window energy
+            float energy_ratio = static_cast<float>(energy(window, num_slices * slice_size) / full_energy);
+            bool psd_threshold = core.filter_type <= 1 || core.filter_type >= 5;
+            for (int i = 0; i < num_slices * block_size; i++) {
+                auto sigma = core.sigma[(radius - r) * block_size + i];
+                core.motion_sigma[r * r * block_size + i] = psd_threshold ? sigma * energy_ratio : sigma;
+            }
+            bool psd_bounds = core.filter_type == 3 || core.filter_type == 4;
+            core.motion_pmin[r] = psd_bounds ? core.pmin * energy_ratio : core.pmin;
+            core.motion_pmax[r] = psd_bounds ? core.pmax * energy_ratio : core.pmax;
+
+            if (core.zero_mean) {
+                std::vector<double> window_scaled(window, window + num_slices * slice_size);
+                for (auto & w : window_scaled) {
+                    w *= 255;
+                }
+
+                std::vector<std::complex<double>> window_freq(num_slices * block_size * (block_size / 2 + 1));
+                if (r == 0) {
+                    const int shape[] { block_size, block_size };
+                    real_dft(window_freq.data(), window_scaled.data(), 2, shape);
+                } else {
+                    const int shape[] { num_slices, block_size, block_size };
+                    real_dft(window_freq.data(), window_scaled.data(), 3, shape);
+                }
+
+                for (int i = 0; i < num_slices * block_size; i++) {
+                    float freq_padded[32] {};
+                    for (int j = 0; j < block_size / 2 + 1; j++) {
+                        freq_padded[j] = static_cast<float>(window_freq[i * (block_size / 2 + 1) + j].real());
+                        freq_padded[16 + j] = static_cast<float>(window_freq[i * (block_size / 2 + 1) + j].imag());
+                    }
+                    core.motion_window_freq[(r * r * block_size + i) * 2] = Vec16f().load(&freq_padded[0]);
+                    core.motion_window_freq[(r * r * block_size + i) * 2 + 1] = Vec16f().load(&freq_padded[16]);
+                }
+            }
+
+            // The centre slices of both windows are the same spatial window
+            // up to a factor, the synthesis window absorbs it together with
+            // the gain of the smaller transforms.
+            double centre = std::accumulate(&window[r * slice_size], &window[(r + 1) * slice_size], 0.0);
+            if (!(centre > 0.0)) {
+                return "\"motion_window\" must be positive at the centre frame";
+            }
+            float synthesis_scale = static_cast<float>(
+                (2 * radius + 1) * full_centre / (num_slices * centre)
+            );
+            for (int i = 0; i < slice_size / 16; i++) {
+                core.motion_synthesis[r * slice_size / 16 + i] = synthesis_scale * core.window[radius * block_size * 2 + i];
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+static std::unique_ptr<T []> copy_array(const std::unique_ptr<T []> & src, int size) {
+    if (!src) {
+        return nullptr;
+    }
+
+    auto dst = std::make_unique<T []>(size);
+    std::copy_n(src.get(), size, dst.get());
+    return dst;
+}
+
+// number of vectors of `window`
+static int calc_window_size(const DFTTestCore & core) {
+    return (2 * core.radius + 1) * core.block_size * core.block_size / 16;
+}
+
+// number of vectors of `sigma`, half of that of `window_freq`
+static int calc_sigma_size(const DFTTestCore & core) {
+    return (2 * core.radius + 1) * core.block_size * ((core.block_size / 2 + 1 + 15) / 16);
+}
+
+// number of vectors of `motion_sigma`, half of that of `motion_window_freq`
+static int calc_motion_sigma_size(const DFTTestCore & core) {
+    return core.radius * core.radius * core.block_size;
+}
+
+void copy_core(DFTTestCore & dst, const DFTTestCore & src) {
+    int window_size = calc_window_size(src);
+    int sigma_size = calc_sigma_size(src);
+
+    dst.radius = src.radius;
+    dst.output_slice = src.output_slice;
+    dst.strip_width = src.strip_width;
+    dst.block_size = src.block_size;
+    dst.block_step = src.block_step;
+    dst.zero_mean = src.zero_mean;
+    dst.window = copy_array(src.window, window_size);
+    dst.window_freq = copy_array(src.window_freq, sigma_size * 2);
+    dst.sigma = copy_array(src.sigma, sigma_size);
+    dst.filter_type = src.filter_type;
+    dst.sigma2 = src.sigma2;
+    dst.pmin = src.pmin;
+    dst.pmax = src.pmax;
+    dst.sparse_block_step = src.sparse_block_step;
+    dst.sparse_threshold = src.sparse_threshold;
+    dst.window_weight = copy_array(src.window_weight, src.block_size * src.block_size / 16);
+    dst.auto_sigma = src.auto_sigma;
+    dst.smode = src.smode;
+    dst.window_x = copy_array(src.window_x, src.block_size);
+    dst.window_ty = copy_array(src.window_ty, (2 * src.radius + 1) * src.block_size);
+    dst.centre_weight = copy_array(src.centre_weight, src.block_size * 2);
+    dst.motion_threshold = src.motion_threshold;
+    dst.motion_window = copy_array(src.motion_window, calc_motion_sigma_size(src) * src.block_size / 16);
+    dst.motion_window_freq = copy_array(src.motion_window_freq, calc_motion_sigma_size(src) * 2);
+    dst.motion_sigma = copy_array(src.motion_sigma, calc_motion_sigma_size(src));
+    dst.motion_synthesis = copy_array(src.motion_synthesis, src.radius * src.block_size * src.block_size / 16);
+    std::copy_n(src.motion_pmin, 3, dst.motion_pmin);
+    std::copy_n(src.motion_pmax, 3, dst.motion_pmax);
+    dst.downscale = src.downscale;
+    dst.half_phase = copy_array(src.half_phase, 16);
+    dst.half_basis = copy_array(src.half_basis, 8);
+    dst.half_synthesis = copy_array(src.half_synthesis, 8);
+    dst.half_weight = copy_array(src.half_weight, 8);
+    dst.recursive = src.recursive;
+    dst.exclude_borders = src.exclude_borders;
+    dst.align = src.align;
+    dst.slice_window_freq = copy_array(src.slice_window_freq, sigma_size * 2);
+}
+
+size_t core_table_size(const DFTTestCore & core) {
+    size_t size = (
+        (core.window ? calc_window_size(core) : 0) +
+        (core.window_freq ? calc_sigma_size(core) * 2 : 0) +
+        (core.sigma ? calc_sigma_size(core) : 0) +
+        (core.window_weight ? core.block_size * core.block_size / 16 : 0) +
+        (core.centre_weight ? core.block_size * 2 : 0) +
+        (core.motion_window ? calc_motion_sigma_size(core) * core.block_size / 16 : 0) +
+        (core.motion_window_freq ? calc_motion_sigma_size(core) * 2 : 0) +
+        (core.motion_sigma ? calc_motion_sigma_size(core) : 0) +
+        (core.motion_synthesis ? core.radius * core.block_size * core.block_size / 16 : 0) +
+        (core.slice_window_freq ? calc_sigma_size(core) * 2 : 0)
+    ) * sizeof(Vec16f);
+
+    if (core.window_x) {
+        size += (2 * core.radius + 2) * core.block_size * sizeof(float);
+    }
+
+    if (core.downscale) {
+        size += (16 + 8 + 8 + 8) * sizeof(Vec8f);
+    }
+
+    return size;
+}
+
+// number of elements of the buffers of `DFTTestWorkspace`, 0 if unused
+struct WorkspaceSizes {
+    size_t weight;
+    size_t dense;
+    size_t energy;
+    size_t sigma;
+    size_t noise;
+    size_t row_spectra;
+};
+
+static WorkspaceSizes calc_workspace_sizes(const DFTTestCore & core, int width, int height) {
+    WorkspaceSizes sizes {};
+
+    int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+
+    if (core.sparse_block_step) {
+        int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+        size_t tile_num = static_cast<size_t>(calc_tile_num(pad_height)) * calc_tile_num(pad_width);
+
+        sizes.weight = static_cast<size_t>(pad_height) * pad_stride;
+        sizes.dense = tile_num;
+        sizes.energy = tile_num;
+    }
+
+    if (core.downscale) {
+        int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+        sizes.weight = static_cast<size_t>(pad_height / 2) * pad_stride;
+    }
+
+    if (core.auto_sigma) {
+        sizes.sigma = (2 * core.radius + 1) * core.block_size;
+        if (core.motion_sigma) {
+            sizes.sigma += calc_motion_sigma_size(core);
+        }
+        sizes.noise = static_cast<size_t>(pad_height / core.block_size) * (pad_width / core.block_size);
+    }
+
+    if (core.smode == 0) {
+        sizes.row_spectra = (2 * core.radius + 1) * core.block_size * pixel_strip_width * 2;
+    }
+
+    return sizes;
+}
+
+size_t workspace_size(const DFTTestCore & core, int width, int height) {
+    auto sizes = calc_workspace_sizes(core, width, height);
+
+    return (
+        sizes.weight * sizeof(float) +
+        sizes.dense * sizeof(uint8_t) +
+        sizes.energy * sizeof(float) +
+        sizes.sigma * sizeof(Vec16f) +
+        sizes.noise * sizeof(float) +
+        sizes.row_spectra * sizeof(Vec16f)
+    );
+}
+
+DFTTestWorkspace alloc_workspace(const DFTTestCore & core, int width, int height, int numa_node) {
+    DFTTestWorkspace workspace {};
+
+    auto sizes = calc_workspace_sizes(core, width, height);
+
+    if (core.sparse_block_step) {
+        workspace.weight = static_cast<float *>(numa_alloc(sizes.weight * sizeof(float), numa_node));
+        workspace.dense = static_cast<uint8_t *>(numa_alloc(sizes.dense * sizeof(uint8_t), numa_node));
+        workspace.energy = static_cast<float *>(numa_alloc(sizes.energy * sizeof(float), numa_node));
+    }
+
+    if (core.downscale) {
+        workspace.weight = static_cast<float *>(numa_alloc(sizes.weight * sizeof(float), numa_node));
+    }
+
+    if (core.auto_sigma) {
+        workspace.sigma = new Vec16f[sizes.sigma];
+        workspace.noise = static_cast<float *>(numa_alloc(sizes.noise * sizeof(float), numa_node));
+    }
+
+    if (core.smode == 0) {
+        workspace.row_spectra = static_cast<Vec16f *>(numa_alloc(sizes.row_spectra * sizeof(Vec16f), numa_node));
+    }
+
+    return workspace;
+}
+
+void free_workspace(DFTTestWorkspace & workspace) {
+    numa_free(workspace.row_spectra);
+    numa_free(workspace.noise);
+    delete[] workspace.sigma;
+    numa_free(workspace.energy);
+    numa_free(workspace.dense);
+    numa_free(workspace.weight);
+    workspace = {};
+}
+
+// Estimates the noise power of a plane in the unit of the filtered psd, as the
+// median over non-overlapping blocks of the mean psd of the high spatial
+// frequencies. Textured blocks only raise the upper half of the distribution.
+static float estimate_noise(
+    float * __restrict block_noise,
+    const uint8_t * const * srcs,
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core
+) {
+
+    assert(core.block_size == 16);
+    constexpr int block_size = 16;
+
+    int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+
+    // frequencies of at least 3/4 of the nyquist frequency in either direction
+    auto lane = Vec16f(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    auto valid = lane <= 8.0f;
+    auto high = (lane >= 6.0f) & valid;
+    int num_high = (2 * core.radius + 1) * (5 * 9 + 11 * 3);
+
+    int num_blocks = 0;
+    for (int i = 0; i < pad_height / block_size; i++) {
+        for (int j = 0; j < pad_width / block_size; j++) {
+            Vec16f block[7 * block_size * 2];
+
+            load_block(
+                block,
+                srcs, (i * pad_stride + j) * block_size,
+                core.radius, core.block_size, core.block_step,
+                width, height,
+                core.window.get(), bits_per_sample
+            );
+
+            for (int t = 0; t < 2 * core.radius + 1; t++) {
+                forward_spatial(&block[t * block_size * 2]);
+            }
+            forward_temporal(block, core.radius);
+
+            Vec16f sum = 0.0f;
+            for (int t = 0; t < 2 * core.radius + 1; t++) {
+                for (int y = 0; y < block_size; y++) {
+                    auto re = block[(t * block_size + y) * 2];
+                    auto im = block[(t * block_size + y) * 2 + 1];
+                    auto psd = mul_add(re, re, im * im);
+                    sum += select((y >= 6 && y <= 10) ? valid : high, psd, Vec16f(0.0f));
+                }
+            }
+
+            block_noise[num_blocks++] = horizontal_add(sum) / num_high;
+        }
+    }
+
+    std::nth_element(&block_noise[0], &block_noise[num_blocks / 2], &block_noise[num_blocks]);
+    return block_noise[num_blocks / 2];
+}
+
+// Horizontal spectra of `num_columns` adjacent blocks of a padded row, whose
+// first sample is `src`. The spectra are computed for 16 columns at a time,
+// then transposed, so that each column holds the real and imaginary parts of
+// its 9 frequencies.
+static void compute_row_spectra(
+    Vec16f * __restrict dst, // shape: (num_columns rounded up to 16, 2)
+    const uint8_t * __restrict src,
+    int num_columns,
+    const float * __restrict window_x,
+    int bits_per_sample
+) {
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    for (int j = 0; j < num_columns; j += 16) {
+        Vec16f block[32];
+
+        // lane i of block[x] is sample x of column j + i
+        for (int x = 0; x < 16; x++) {
+            block[x] = (scale * window_x[x]) * load_samples(src + (j + x) * bytes_per_sample, bytes_per_sample);
+        }
+        for (int x = 18; x < 32; x++) {
+            block[x] = 0.0f;
+        }
+
+        rdft<16>(block);
+        transpose_32x16(block);
+
+        for (int i = 0; i < 32; i++) {
+            dst[j * 2 + i] = block[i];
+        }
+    }
+}
+
+// smode 0: every output sample is the centre of its own block.
+//
+// The window is separable, so the block spectrum is the vertical dft of the
+// horizontal spectra of its rows, each scaled by the vertical window. The
+// horizontal spectra are computed once per padded row and column, and kept
+// for the block_size rows of a column strip while the block slides down, so
+// only the vertical dft remains per sample. After filtering, the centre
+// sample is a dot product with the spectrum of the output slice instead of
+// a full inverse transform.
+template <typename Probe>
+static void filter_pixels(
+    float * __restrict dst,
+    const uint8_t * const * srcs,
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core,
+    const Vec16f * __restrict sigma,
+    Vec16f * __restrict row_spectra,
+    Probe probe
+) {
+
+    assert(core.block_size == 16);
+    constexpr int block_size = 16;
+    constexpr int centre = block_size / 2;
+
+    int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    int offset_y = (pad_height - height) / 2;
+    int offset_x = (pad_width - width) / 2;
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    // the block of output sample (y, x) starts at padded row
+    // offset_y - centre + y and column offset_x - centre + x
+    for (int strip_x = 0; strip_x < width; strip_x += pixel_strip_width) {
+        int num_columns = std::min(pixel_strip_width, width - strip_x);
+
+        auto update_row = [&](int row) {
+            for (int t = 0; t < 2 * core.radius + 1; t++) {
+                compute_row_spectra(
+                    &row_spectra[(t * block_size + row % block_size) * pixel_strip_width * 2],
+                    &srcs[t][(static_cast<size_t>(row) * pad_stride + offset_x - centre + strip_x) * bytes_per_sample],
+                    num_columns,
+                    core.window_x.get(),
+                    bits_per_sample
+                );
+            }
+        };
+
+        for (int row = offset_y - centre; row < offset_y - centre + block_size - 1; row++) {
+            update_row(row);
+        }
+
+        for (int y = 0; y < height; y++) {
+            int first_row = offset_y - centre + y;
+            update_row(first_row + block_size - 1);
+            probe(perf_load_block);
+
+            for (int x = 0; x < num_columns; x++) {
+                Vec16f block[7 * block_size * 2];
+
+                for (int t = 0; t < 2 * core.radius + 1; t++) {
+                    for (int i = 0; i < block_size; i++) {
+                        auto spectrum = &row_spectra[((t * block_size + (first_row + i) % block_size) * pixel_strip_width + x) * 2];
+                        auto weight = core.window_ty[t * block_size + i];
+                        block[(t * block_size + i) * 2] = weight * spectrum[0];
+                        block[(t * block_size + i) * 2 + 1] = weight * spectrum[1];
+                    }
+                    dft<16>(&block[t * block_size * 2]);
+                }
+
+                temporal_filtering(
+                    block,
+                    sigma,
+                    core.sigma2,
+                    core.pmin,
+                    core.pmax,
+                    core.filter_type,
+                    core.zero_mean,
+                    core.window_freq.get(),
+                    core.radius,
+                    probe
+                );
+
+                auto output = &block[core.output_slice * block_size * 2];
+                Vec16f sum = 0.0f;
+                for (int i = 0; i < block_size * 2; i++) {
+                    sum = mul_add(output[i], core.centre_weight[i], sum);
+                }
+                dst[(offset_y + y) * pad_stride + offset_x + strip_x + x] = horizontal_add(sum);
+                probe(perf_inverse);
+            }
+        }
+    }
+}
+
+// correlations per slice in the alignment, the second one refines the
+// displacement, and the ratio of the energies of the differences to the
+// output slice after and before a displacement below which it is kept
+static constexpr int align_iterations = 2;
+static constexpr float align_acceptance = 0.75f;
+
+template <typename Probe>
+static void filter_plane_impl(
+    float * __restrict dst,
+    const uint8_t * const * srcs,
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core,
+    DFTTestWorkspace & workspace,
+    Probe probe,
+    float * __restrict recursive_state,
+    bool recursive_prior
+) {
+
+    auto mxcsr = get_control_word();
+    no_subnormals();
+
+    int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    int padded_size_spatial = pad_height * pad_stride;
+
+    std::memset(dst, 0, padded_size_spatial * sizeof(float));
+
+    const Vec16f * sigma = core.sigma.get();
+    const Vec16f * motion_sigma = core.motion_sigma.get();
+    if (core.auto_sigma) {
+        float noise = estimate_noise(workspace.noise, srcs, width, height, bits_per_sample, core);
+
+        int sigma_size = (2 * core.radius + 1) * core.block_size;
+        for (int i = 0; i < sigma_size; i++) {
+            workspace.sigma[i] = noise * core.sigma[i];
+        }
+        sigma = workspace.sigma;
+
+        if (motion_sigma) {
+            for (int i = 0; i < calc_motion_sigma_size(core); i++) {
+                workspace.sigma[sigma_size + i] = noise * core.motion_sigma[i];
+            }
+            motion_sigma = &workspace.sigma[sigma_size];
+        }
+    }
+
+    // analysis windows of the radii of the motion-adaptive blocks
+    const Vec16f * motion_windows[4] {};
+    for (int r = 0; r < core.radius && core.motion_threshold > 0.0f; r++) {
+        motion_windows[r] = &core.motion_window[r * r * core.block_size * core.block_size / 16];
+    }
+    motion_windows[core.radius] = core.window.get();
+
+    if (core.smode == 0) {
+        probe(perf_other);
+        filter_pixels(dst, srcs, width, height, bits_per_sample, core, sigma, workspace.row_spectra, probe);
+        set_control_word(mxcsr);
+        return ;
+    }
+
+    if (core.downscale) {
+        std::memset(workspace.weight, 0, (pad_height / 2) * pad_stride * sizeof(float));
+    }
+
+    int tile_num_x = calc_tile_num(pad_width);
+    if (core.sparse_block_step) {
+        std::memset(workspace.weight, 0, padded_size_spatial * sizeof(float));
+
+        compute_dense_tiles(
+            workspace.dense,
+            workspace.energy,
+            srcs[core.output_slice],
+            width, height,
+            core.block_size, core.block_step,
+            core.sparse_threshold,
+            bits_per_sample
+        );
+    }
+    probe(perf_other);
+
+    int num_x = calc_pad_num(width, core.block_size, core.block_step);
+    int num_y = calc_pad_num(height, core.block_size, core.block_step);
+
+    // blocks [begin_y, end_y) x [begin_x, end_x) overlap the active area,
+    // which is all that the output inside of it depends on
+    int begin_y = 0;
+    int end_y = num_y;
+    int begin_x = 0;
+    int end_x = num_x;
+    ActiveArea area {};
+    if (core.exclude_borders) {
+        int offset_y = (pad_height - height) / 2;
+        int offset_x = (pad_width - width) / 2;
+        int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+        area = find_active_area(
+            &srcs[core.output_slice][(offset_y * pad_stride + offset_x) * bytes_per_sample],
+            width, height,
+            pad_stride * bytes_per_sample,
+            bytes_per_sample
+        );
+
+        auto first_block = [&](int start, int offset) {
+            return std::max(start + offset - core.block_size + core.block_step, 0) / core.block_step;
+        };
+        auto last_block = [&](int end, int offset) {
+            return (end + offset + core.block_step - 1) / core.block_step;
+        };
+        if (area.top < area.bottom) {
+            begin_y = first_block(area.top, offset_y);
+            end_y = std::min(last_block(area.bottom, offset_y), num_y);
+            begin_x = first_block(area.left, offset_x);
+            end_x = std::min(last_block(area.right, offset_x), num_x);
+        } else {
+            end_y = 0;
+        }
+    }
+
+    // the blocks are visited in column strips of `strip_width` blocks, so the
+    // rows shared by vertically adjacent blocks are still cached when wide
+    // planes do not fit
+    int strip_width = core.strip_width > 0 ? core.strip_width : num_x;
+    for (int strip_x = begin_x - begin_x % strip_width; strip_x < end_x; strip_x += strip_width) {
+        for (int i = begin_y; i < end_y; i++) {
+            for (int j = std::max(strip_x, begin_x); j < std::min(strip_x + strip_width, end_x); j++) {
+                assert(core.block_size == 16);
+                constexpr int block_size = 16;
+
+                if (core.sparse_block_step) {
+                    int y = i * core.block_step;
+                    int x = j * core.block_step;
+                    if (!workspace.dense[(y / tile_size) * tile_num_x + x / tile_size] &&
+                        (y % core.sparse_block_step || x % core.sparse_block_step)
+                    ) {
+                        continue;
+                    }
+                }
+
+                Vec16f block[7 * block_size * 2];
+
+                int offset = (i * pad_stride + j) * core.block_step;
+
+                if (core.downscale) {
+                    load_block(
+                        block,
+                        srcs, offset,
+                        core.radius, core.block_size, core.block_step,
+                        width, height,
+                        core.window.get(), bits_per_sample
+                    );
+                    probe(perf_load_block);
+
+                    Vec8f half_block[8];
+                    fused_half(
+                        half_block,
+                        block,
+                        sigma,
+                        core.sigma2,
+                        core.pmin,
+                        core.pmax,
+                        core.filter_type,
+                        core.zero_mean,
+                        core.window_freq.get(),
+                        core.radius,
+                        core.output_slice,
+                        core.half_phase.get(),
+                        core.half_basis.get(),
+                        probe
+                    );
+
+                    int half_offset = (i * pad_stride + j) * (core.block_step / 2);
+                    store_half_block(
+                        &dst[half_offset],
+                        &workspace.weight[half_offset],
+                        half_block,
+                        pad_stride,
+                        core.half_synthesis.get(),
+                        core.half_weight.get()
+                    );
+                    probe(perf_store_block);
+                    continue;
+                }
+
+                int output_slice = core.output_slice;
+                const Vec16f * synthesis = &core.window[core.radius * block_size * 2];
+
+                if (core.recursive > 0.0f) {
+                    load_block(
+                        block,
+                        srcs, offset,
+                        0, core.block_size, core.block_step,
+                        width, height,
+                        core.window.get(), bits_per_sample
+                    );
+                    probe(perf_load_block);
+
+                    float * state = nullptr;
+                    if (recursive_state) {
+                        state = &recursive_state[static_cast<size_t>(i * num_x + j) * spectrum_block_size];
+                    }
+
+                    Vec16f estimate[block_size * 2];
+                    bool prior = state && recursive_prior;
+                    if (prior) {
+                        for (int k = 0; k < block_size * 2; k++) {
+                            estimate[k].load_partial(9, &state[k * 9]);
+                        }
+                    }
+
+                    fused_recursive(
+                        block,
+                        estimate,
+                        prior,
+                        core.recursive,
+                        sigma,
+                        core.sigma2,
+                        core.pmin,
+                        core.pmax,
+                        core.filter_type,
+                        core.zero_mean,
+                        core.window_freq.get(),
+                        probe
+                    );
+
+                    if (state) {
+                        for (int k = 0; k < block_size * 2; k++) {
+                            estimate[k].store_partial(9, &state[k * 9]);
+                        }
+                    }
+                } else if (core.motion_threshold > 0.0f) {
+                    int radius = load_block_adaptive(
+                        block,
+                        srcs, offset,
+                        core.radius, core.block_size, core.block_step,
+                        width, height,
+                        motion_windows, core.motion_threshold, bits_per_sample
+                    );
+                    probe(perf_load_block);
+
+                    // the block is centred, so the output slice is `radius`
+                    bool reduced = radius < core.radius;
+                    fused(
+                        block,
+                        reduced ? &motion_sigma[radius * radius * block_size] : sigma,
+                        core.sigma2,
+                        reduced ? core.motion_pmin[radius] : core.pmin,
+                        reduced ? core.motion_pmax[radius] : core.pmax,
+                        core.filter_type,
+                        core.zero_mean,
+                        reduced ? &core.motion_window_freq[radius * radius * block_size * 2] : core.window_freq.get(),
+                        radius,
+                        radius,
+                        probe
+                    );
+
+                    output_slice = radius;
+                    if (reduced) {
+                        synthesis = &core.motion_synthesis[radius * block_size];
+                    }
+                } else if (core.align > 0) {
+                    load_block(
+                        block,
+                        srcs, offset,
+                        core.radius, core.block_size, core.block_step,
+                        width, height,
+                        core.window.get(), bits_per_sample
+                    );
+                    probe(perf_load_block);
+
+                    // the displaced block stays inside of the padded plane
+                    int y = i * core.block_step;
+                    int x = j * core.block_step;
+                    const int bounds[] {
+                        std::max(-core.align, -y), std::min(core.align, pad_height - block_size - y),
+                        std::max(-core.align, -x), std::min(core.align, pad_width - block_size - x)
+                    };
+                    auto fetch = [&](int slice, int dy, int dx, Vec16f * dst_slice) {
+                        load_block(
+                            dst_slice,
+                            &srcs[slice], offset + dy * pad_stride + dx,
+                            0, core.block_size, core.block_step,
+                            width, height,
+                            &core.window[slice * block_size], bits_per_sample
+                        );
+                    };
+
+                    fused_aligned(
+                        block,
+                        sigma,
+                        core.sigma2,
+                        core.pmin,
+                        core.pmax,
+                        core.filter_type,
+                        core.zero_mean,
+                        core.window_freq.get(),
+                        core.radius,
+                        core.output_slice,
+                        core.slice_window_freq.get(),
+                        bounds,
+                        core.align,
+                        align_iterations,
+                        align_acceptance,
+                        fetch,
+                        probe
+                    );
+                } else {
+                    load_block(
+                        block,
+                        srcs, offset,
+                        core.radius, core.block_size, core.block_step,
+                        width, height,
+                        core.window.get(), bits_per_sample
+                    );
+                    probe(perf_load_block);
+
+                    fused(
+                        block,
+                        sigma,
+                        core.sigma2,
+                        core.pmin,
+                        core.pmax,
+                        core.filter_type,
+                        core.zero_mean,
+                        core.window_freq.get(),
+                        core.radius,
+                        core.output_slice,
+                        probe
+                    );
+                }
+
+                store_block(
+                    &dst[offset],
+                    &block[output_slice * block_size * 2],
+                    block_size,
+                    core.block_step,
+                    width,
+                    height,
+                    synthesis
+                );
+
+                if (core.sparse_block_step) {
+                    store_weight(
+                        &workspace.weight[offset],
+                        block_size,
+                        core.block_step,
+                        width,
+                        height,
+                        core.window_weight.get()
+                    );
+                }
+                probe(perf_store_block);
+            }
+        }
+    }
+
+    if (core.sparse_block_step) {
+        int offset_y = (pad_height - height) / 2;
+        int offset_x = (pad_width - width) / 2;
+
+        normalize_weight(
+            &dst[(offset_y * pad_stride + offset_x)],
+            &workspace.weight[(offset_y * pad_stride + offset_x)],
+            width,
+            height,
+            pad_stride
+        );
+    }
+    if (core.downscale) {
+        int offset_y = (pad_height - height) / 2 / 2;
+        int offset_x = (pad_width - width) / 2 / 2;
+
+        normalize_weight(
+            &dst[(offset_y * pad_stride + offset_x)],
+            &workspace.weight[(offset_y * pad_stride + offset_x)],
+            width / 2,
+            height / 2,
+            pad_stride
+        );
+    }
+    if (core.exclude_borders) {
+        int offset_y = (pad_height - height) / 2;
+        int offset_x = (pad_width - width) / 2;
+        int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+        copy_borders(
+            &dst[(offset_y * pad_stride + offset_x)],
+            &srcs[core.output_slice][(offset_y * pad_stride + offset_x) * bytes_per_sample],
+            width,
+            height,
+            pad_stride,
+            area,
+            bits_per_sample
+        );
+    }
+    probe(perf_other);
+
+    set_control_word(mxcsr);
+}
+
+void filter_plane(
+    float * __restrict dst,
+    const uint8_t * const * srcs,
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core,
+    DFTTestWorkspace & workspace,
+    PerfSession * perf,
+    float * __restrict recursive_state,
+    bool recursive_prior
+) {
+
+    if (perf) {
+        filter_plane_impl(
+            dst, srcs, width, height, bits_per_sample, core, workspace, PerfProbe { perf },
+            recursive_state, recursive_prior
+        );
+    } else {
+        filter_plane_impl(
+            dst, srcs, width, height, bits_per_sample, core, workspace, NoProbe {},
+            recursive_state, recursive_prior
+        );
+    }
+}
+
+void store_plane(
+    uint8_t * __restrict dst,
+    const float * __restrict src,
+    int width, int height, int dst_stride,
+    int bits_per_sample,
+    const DFTTestCore & core
+) {
+
+    int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    int offset_y = (pad_height - height) / 2;
+    int offset_x = (pad_width - width) / 2;
+
+    if (core.downscale) {
+        // even offsets, see `DFTTestCoreArgs::downscale`
+        offset_y /= 2;
+        offset_x /= 2;
+        width /= 2;
+        height /= 2;
+    }
+
+    store_frame(
+        dst,
+        &src[(offset_y * pad_stride + offset_x)],
+        width,
+        height,
+        dst_stride,
+        pad_stride,
+        bits_per_sample
+    );
+}
+
+void add_grain_stats(GrainStats & dst, const GrainStats & src) {
+    for (int i = 0; i < grain_num_bins; i++) {
+        dst.count[i] += src.count[i];
+        dst.power[i] += src.power[i];
+    }
+    for (int i = 0; i < grain_cov_size; i++) {
+        dst.cov[i] += src.cov[i];
+        dst.cov_count[i] += src.cov_count[i];
+    }
+}
+
+void accumulate_grain(
+    GrainStats & stats,
+    const float * __restrict filtered,
+    const uint8_t * __restrict src,
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core
+) {
+
+    int pad_width = calc_pad_size(width, core.block_size, core.block_step);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    int offset = ((pad_height - height) / 2) * pad_stride + (pad_width - width) / 2;
+
+    float scale = 1.0f / (1 << (bits_per_sample - 8));
+    if (bits_per_sample == 32) {
+        scale = 255.0f;
+    }
+    int bytes_per_sample = (bits_per_sample + 7) / 8;
+
+    std::vector<float> residual(static_cast<size_t>(width) * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = offset + y * pad_stride + x;
+            float output = filtered[i];
+            float r = scale * load_sample(&src[static_cast<size_t>(i) * bytes_per_sample], bytes_per_sample) - output;
+            residual[y * width + x] = r;
+
+            int bin = std::clamp(static_cast<int>(output * (grain_num_bins / 256.0f)), 0, grain_num_bins - 1);
+            stats.count[bin] += 1.0;
+            stats.power[bin] += r * r;
+        }
+    }
+
+    // half of the offsets, the others are symmetric
+    for (int dy = 0; dy <= grain_ar_lag; dy++) {
+        for (int dx = -2 * grain_ar_lag; dx <= 2 * grain_ar_lag; dx++) {
+            if (dy == 0 && dx < 0) {
+                continue;
+            }
+
+            int begin_x = std::max(-dx, 0);
+            int end_x = std::min(width - dx, width);
+            double sum = 0.0;
+            for (int y = 0; y + dy < height; y++) {
+                const float * row = &residual[y * width];
+                const float * shifted_row = &residual[(y + dy) * width + dx];
+                float row_sum = 0.0f;
+                for (int x = begin_x; x < end_x; x++) {
+                    row_sum += row[x] * shifted_row[x];
+                }
+                sum += row_sum;
+            }
+
+            int i = dy * grain_cov_width + dx + 2 * grain_ar_lag;
+            stats.cov[i] += sum;
+            stats.cov_count[i] += static_cast<double>(height - dy) * std::max(end_x - begin_x, 0);
+        }
+    }
+}
+
+// Solves a * x = b in place of `b` by gaussian elimination with partial
+// pivoting, returns false if `a` is singular.
+static bool solve_linear(double * a, double * b, int n) {
+    for (int i = 0; i < n; i++) {
+        int pivot = i;
+        for (int j = i + 1; j < n; j++) {
+            if (std::abs(a[j * n + i]) > std::abs(a[pivot * n + i])) {
+                pivot = j;
+            }
+        }
+        if (a[pivot * n + i] == 0.0) {
+            return false;
+        }
+        if (pivot != i) {
+            std::swap_ranges(&a[i * n], &a[i * n + n], &a[pivot * n]);
+            std::swap(b[i], b[pivot]);
+        }
+        for (int j = i + 1; j < n; j++) {
+            double factor = a[j * n + i] / a[i * n + i];
+            for (int k = i; k < n; k++) {
+                a[j * n + k] -= factor * a[i * n + k];
+            }
+            b[j] -= factor * b[i];
+        }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        for (int j = i + 1; j < n; j++) {
+            b[i] -= a[i * n + j] * b[j];
+        }
+        b[i] /= a[i * n + i];
+    }
+    return true;
+}
+
+// AV1 film grain parameters of one plane
+struct GrainPlaneParams {
+    int num_points;
+    int points[grain_num_bins][2];
+    int scaling_shift;
+    int ar_coeffs[2 * grain_ar_lag * (grain_ar_lag + 1)];
+};
+
+// Fits the auto-regressive model to the autocovariance by the Yule-Walker
+// equations, and divides the residual strength of each intensity by the
+// gain of the model, since the synthesized grain is the model driven by
+// gaussian noise of a fixed power.
+static GrainPlaneParams fit_grain(const GrainStats & stats) {
+    constexpr int num_coeffs = 2 * grain_ar_lag * (grain_ar_lag + 1);
+
+    GrainPlaneParams params {};
+    params.scaling_shift = 8;
+
+    auto cov = [&](int dy, int dx) {
+        if (dy < 0 || (dy == 0 && dx < 0)) {
+            dy = -dy;
+            dx = -dx;
+        }
+        int i = dy * grain_cov_width + dx + 2 * grain_ar_lag;
+        return stats.cov_count[i] > 0.0 ? stats.cov[i] / stats.cov_count[i] : 0.0;
+    };
+
+    double variance = cov(0, 0);
+    if (!(variance > 1e-6)) {
+        return params;
+    }
+
+    // causal neighbours in raster order, as in the AV1 specification
+    int positions[num_coeffs][2];
+    int num_positions = 0;
+    for (int dy = -grain_ar_lag; dy <= 0; dy++) {
+        for (int dx = -grain_ar_lag; dx <= grain_ar_lag && (dy < 0 || dx < 0); dx++) {
+            positions[num_positions][0] = dy;
+            positions[num_positions][1] = dx;
+            num_positions++;
+        }
+    }
+
+    double a[num_coeffs * num_coeffs];
+    double coeffs[num_coeffs];
+    for (int i = 0; i < num_coeffs; i++) {
+        for (int j = 0; j < num_coeffs; j++) {
+            a[i * num_coeffs + j] = cov(positions[i][0] - positions[j][0], positions[i][1] - positions[j][1]);
+        }
+        // keeps the system well conditioned on nearly white residuals
+        a[i * num_coeffs + i] += 1e-6 * variance;
+        coeffs[i] = cov(positions[i][0], positions[i][1]);
+    }
+
+    double gain = 1.0;
+    if (solve_linear(a, coeffs, num_coeffs)) {
+        double innovation = variance;
+        for (int i = 0; i < num_coeffs; i++) {
+            innovation -= coeffs[i] * cov(positions[i][0], positions[i][1]);
+            // Q7, as `ar_coeff_shift` is 7
+            params.ar_coeffs[i] = std::clamp(static_cast<int>(std::lround(coeffs[i] * 128.0)), -128, 127);
+        }
+        gain = std::sqrt(variance / std::max(innovation, 1e-3 * variance));
+    }
+
+    double total = 0.0;
+    for (int i = 0; i < grain_num_bins; i++) {
+        total += stats.count[i];
+    }
+
+    double strengths[grain_num_bins];
+    double max_strength = 0.0;
+    for (int i = 0; i < grain_num_bins; i++) {
+        strengths[i] = -1.0;
+        // intensities covering too few samples are interpolated by the decoder
+        if (stats.count[i] >= std::max(total / 200.0, 64.0)) {
+            strengths[i] = std::sqrt(stats.power[i] / stats.count[i]) / gain;
+            max_strength = std::max(max_strength, strengths[i]);
+        }
+    }
+    if (max_strength < 0.1) {
+        return params;
+    }
+
+    // The grain is (scaling * g) >> scaling_shift, where g has a standard
+    // deviation of 32 in the 8-bit scale before the model, so scaling is
+    // the strength times 2^(scaling_shift - 5). The shift keeps the
+    // largest one in 8 bits.
+    int max_log2 = std::clamp(static_cast<int>(std::floor(std::log2(max_strength))) + 1, 2, 5);
+    params.scaling_shift = 13 - max_log2;
+    double factor = std::ldexp(1.0, 8 - max_log2);
+
+    for (int i = 0; i < grain_num_bins; i++) {
+        if (strengths[i] >= 0.0) {
+            params.points[params.num_points][0] = (2 * i + 1) * 128 / grain_num_bins;
+            params.points[params.num_points][1] = std::clamp(static_cast<int>(std::lround(strengths[i] * factor)), 0, 255);
+            params.num_points++;
+        }
+    }
+
+    return params;
+}
+
+const char * write_grain_table(const char * path, const GrainSegment * segments, int num_segments) {
+    constexpr int num_coeffs = 2 * grain_ar_lag * (grain_ar_lag + 1);
+
+    auto file = std::fopen(path, "w");
+    if (!file) {
+        return "cannot open the film grain table for writing";
+    }
+
+    std::fprintf(file, "filmgrn1\n");
+    for (int i = 0; i < num_segments; i++) {
+        const auto & segment = segments[i];
+
+        GrainPlaneParams planes[3];
+        for (int plane = 0; plane < 3; plane++) {
+            planes[plane] = fit_grain(segment.planes[plane]);
+        }
+        // chroma grain is not coded without luma grain in 4:2:0
+        if (planes[0].num_points == 0) {
+            planes[1].num_points = 0;
+            planes[2].num_points = 0;
+        }
+
+        bool apply = planes[0].num_points || planes[1].num_points || planes[2].num_points;
+        std::fprintf(
+            file, "E %lld %lld %d %d 1\n",
+            static_cast<long long>(segment.start_time),
+            static_cast<long long>(segment.end_time),
+            apply ? 1 : 0,
+            (7391 + i) & 0xFFFF
+        );
+
+        // One scaling shift is shared by the planes, that of the strongest
+        // grain, and the points of the other planes are rescaled to it.
+        // Chroma is scaled by its own intensity (cb_mult 192, cb_luma_mult 128).
+        int scaling_shift = 11;
+        for (const auto & plane : planes) {
+            if (plane.num_points) {
+                scaling_shift = std::min(scaling_shift, plane.scaling_shift);
+            }
+        }
+        for (auto & plane : planes) {
+            for (int j = 0; j < plane.num_points; j++) {
+                int shift = plane.scaling_shift - scaling_shift;
+                auto & value = plane.points[j][1];
+                value = (value + ((1 << shift) >> 1)) >> shift;
+            }
+        }
+
+        std::fprintf(
+            file, "\tp %d %d %d %d %d %d %d %d %d %d %d %d\n",
+            grain_ar_lag, 7, 0, scaling_shift, 0, 1,
+            192, 128, 256, 192, 128, 256
+        );
+
+        const char * names[] { "sY", "sCb", "sCr" };
+        for (int plane = 0; plane < 3; plane++) {
+            std::fprintf(file, plane == 0 ? "\t%s %d " : "\n\t%s %d", names[plane], planes[plane].num_points);
+            for (int j = 0; j < planes[plane].num_points; j++) {
+                std::fprintf(file, " %d %d", planes[plane].points[j][0], planes[plane].points[j][1]);
+            }
+        }
+
+        // the chroma models have an extra coefficient for the luma grain,
+        // which is left at 0
+        const char * coeff_names[] { "cY", "cCb", "cCr" };
+        for (int plane = 0; plane < 3; plane++) {
+            std::fprintf(file, "\n\t%s", coeff_names[plane]);
+            for (int j = 0; j < num_coeffs; j++) {
+                std::fprintf(file, " %d", planes[plane].ar_coeffs[j]);
+            }
+            if (plane > 0) {
+                std::fprintf(file, " 0");
+            }
+        }
+        std::fprintf(file, "\n");
+    }
+
+    if (std::fclose(file)) {
+        return "cannot write the film grain table";
+    }
+    return nullptr;
+}
+
+// Returns the best time in seconds of `num_runs` runs of padding, filtering
+// and storing a synthetic plane.
+static double time_plane(const DFTTestCore & core, int width, int height, int bits_per_sample, int num_runs) {
+    int bytes_per_sample = bits_per_sample == 32 ? 4 : (bits_per_sample > 8 ? 2 : 1);
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    size_t pad_size = static_cast<size_t>(pad_height) * pad_stride;
+    size_t size = static_cast<size_t>(width) * height;
+
+    // uniform noise at a quarter of the sample range
+    auto src = std::make_unique<uint8_t []>(size * bytes_per_sample);
+    uint32_t state = 1;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1664525u + 1013904223u;
+        float value = static_cast<float>(state >> 8) / static_cast<float>(1 << 24);
+        if (bytes_per_sample == 4) {
+            reinterpret_cast<float *>(src.get())[i] = 0.375f + 0.25f * value;
+        } else {
+            auto sample = static_cast<uint16_t>((3.0f + 2.0f * value) * (1 << (bits_per_sample - 3)));
+            if (bytes_per_sample == 2) {
+                reinterpret_cast<uint16_t *>(src.get())[i] = sample;
+            } else {
+                src[i] = static_cast<uint8_t>(sample);
+            }
+        }
+    }
+
+    // the temporal neighbours are copies of the same plane, in separate
+    // buffers so that the memory traffic is that of real input
+    int num_slices = 2 * core.radius + 1;
+    auto padded = make_aligned_array<uint8_t>(num_slices * pad_size * bytes_per_sample);
+    auto filtered = make_aligned_array<float>(pad_size);
+    auto dst = std::make_unique<uint8_t []>(size * bytes_per_sample);
+    std::vector<const uint8_t *> srcs(num_slices);
+    for (int i = 0; i < num_slices; i++) {
+        srcs[i] = &padded[i * pad_size * bytes_per_sample];
+    }
+    auto workspace = alloc_workspace(core, width, height);
+
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < num_runs; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_slices; i++) {
+            reflection_padding(
+                &padded[i * pad_size * bytes_per_sample], src.get(),
+                width, height, width,
+                core.block_size, core.block_step,
+                bytes_per_sample
+            );
+        }
+        filter_plane(filtered.get(), srcs.data(), width, height, bits_per_sample, core, workspace);
+        store_plane(dst.get(), filtered.get(), width, height, width, bits_per_sample, core);
+        auto end = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+
+    free_workspace(workspace);
+
+    return best;
+}
+
+double measure_block_time(const DFTTestCore & core, int bits_per_sample) {
+    // large enough to amortize the per-plane setup, small enough to stay in L2
+    constexpr int width = 128;
+    constexpr int height = 128;
+
+    // smode 0 filters one block per sample
+    int num_blocks = core.smode == 0 ? width * height : (
+        calc_pad_num(height, core.block_size, core.block_step) *
+        calc_pad_num(width, core.block_size, core.block_step)
+    );
+    return time_plane(core, width, height, bits_per_sample, 5) / num_blocks;
+}
+
+// Kernels compiled into this binary. The plugins built with and without VCL
+// share the database, and their timings do not carry over to each other.
+static std::string get_kernel_variant() {
+#if defined(DFTTEST2_SCALAR)
+    return "scalar";
+#elif defined(DFTTEST2_PORTABLE)
+    // vector extensions, lowered for the target flags
+#if defined(__AVX512F__)
+    return "portable-avx512";
+#elif defined(__AVX2__)
+    return "portable-avx2";
+#elif defined(__AVX__)
+    return "portable-avx";
+#elif defined(__ARM_FEATURE_SVE)
+    return "portable-sve";
+#elif defined(__ARM_NEON)
+    return "portable-neon";
+#elif defined(__SSE2__) || defined(_M_X64)
+    return "portable-sse2";
+#else
+    return "portable";
+#endif
+#else
+    return "vcl" + std::to_string(INSTRSET) + (spatial_avx512 ? "-avx512" : "");
+#endif
+}
+
+int autotune(DFTTestCore & core, int width, int height, int bits_per_sample) {
+    // smode 0 has its own traversal
+    if (core.smode == 0) {
+        core.strip_width = 0;
+        return 0;
+    }
+
+    // without a machine identity, the choice is measured but not stored
+    auto cpu_name = get_cpu_name();
+
+    auto key = (
+        cpu_name +
+        ":" + get_kernel_variant() +
+        ":strip_width"
+        ":w" + std::to_string(width) +
+        ":h" + std::to_string(height) +
+        ":b" + std::to_string(bits_per_sample) +
+        ":r" + std::to_string(core.radius) +
+        ":o" + std::to_string(core.output_slice) +
+        ":s" + std::to_string(core.block_step) +
+        ":p" + std::to_string(core.sparse_block_step) +
+        ":a" + std::to_string(core.auto_sigma) +
+        // options that change the work per block
+        ":t" + std::to_string(core.filter_type) +
+        ":z" + std::to_string(core.zero_mean) +
+        ":m" + std::to_string(core.motion_threshold) +
+        ":c" + std::to_string(core.recursive) +
+        ":d" + std::to_string(core.downscale) +
+        ":e" + std::to_string(core.exclude_borders) +
+        ":g" + std::to_string(core.align)
+    );
+
+    int strip_width;
+    if (!cpu_name.empty() && load_tuned_value(key, strip_width)) {
+        core.strip_width = std::max(strip_width, 0);
+        return core.strip_width;
+    }
+
+    // a band of the plane is enough to see whether the rows shared by
+    // vertically adjacent blocks stay in cache
+    int band_height = std::min(height, 8 * core.block_size);
+    int num_x = calc_pad_num(width, core.block_size, core.block_step);
+
+    int best_strip_width = 0;
+    double best_time = std::numeric_limits<double>::max();
+    for (int candidate : { 0, 64, 32, 16, 8 }) {
+        if (candidate >= num_x) {
+            continue;
+        }
+
+        core.strip_width = candidate;
+        double time = time_plane(core, width, band_height, bits_per_sample, 3);
+
+        // the full width is kept unless a strip width is clearly faster
+        if (time < best_time * (candidate == 0 ? 1.0 : 0.97)) {
+            best_time = time;
+            best_strip_width = candidate;
+        }
+    }
+
+    core.strip_width = best_strip_width;
+    if (!cpu_name.empty()) {
+        store_tuned_value(key, best_strip_width);
+    }
+    return best_strip_width;
+}
+
+#if defined(__F16C__)
+static inline uint16_t float_to_half(float x) {
+    return static_cast<uint16_t>(_cvtss_sh(x, 0));
+}
+
+static inline float half_to_float(uint16_t x) {
+    return _cvtsh_ss(x);
+}
+#else
+// round to nearest even
+static inline uint16_t float_to_half(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = static_cast<int>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    }
+    if (exponent >= 31) {
+        return static_cast<uint16_t>(sign | 0x7C00);
+    }
+
+    int shift = 13;
+    uint32_t half = static_cast<uint32_t>(std::max(exponent, 0)) << 10;
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return static_cast<uint16_t>(sign);
+        }
+        mantissa |= 0x800000;
+        shift = 14 - exponent;
+    }
+
+    half |= mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t midpoint = 1u << (shift - 1);
+    if (remainder > midpoint || (remainder == midpoint && (half & 1))) {
+        half++; // may carry into the exponent
+    }
+
+    return static_cast<uint16_t>(sign | half);
+}
+
+static inline float half_to_float(uint16_t x) {
+    uint32_t sign = static_cast<uint32_t>(x & 0x8000) << 16;
+    uint32_t exponent = (x >> 10) & 0x1F;
+    uint32_t mantissa = x & 0x3FF;
+
+    if (exponent == 0) {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+
+    uint32_t bits;
+    if (exponent == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+#endif
+
+size_t spectrum_plane_size(int width, int height, const DFTTestCore & core) {
+    return (
+        static_cast<size_t>(calc_pad_num(height, core.block_size, core.block_step)) *
+        calc_pad_num(width, core.block_size, core.block_step) *
+        spectrum_block_size
+    );
+}
+
+const char * get_slice_scales(float * scales, const double * window, int radius, int block_size) {
+    int slice_size = block_size * block_size;
+    const double * center = &window[radius * slice_size];
+
+    double energy = 0.0;
+    for (int i = 0; i < slice_size; i++) {
+        energy += center[i] * center[i];
+    }
+    if (energy == 0.0) {
+        return "the centre slice of \"window\" must not be zero";
+    }
+
+    for (int t = 0; t < 2 * radius + 1; t++) {
+        double dot = 0.0;
+        for (int i = 0; i < slice_size; i++) {
+            dot += window[t * slice_size + i] * center[i];
+        }
+        double scale = dot / energy;
+
+        for (int i = 0; i < slice_size; i++) {
+            if (std::abs(window[t * slice_size + i] - scale * center[i]) > 1e-6 * std::sqrt(energy)) {
+                return "\"window\" must be separable in time";
+            }
+        }
+
+        scales[t] = static_cast<float>(scale);
+    }
+
+    return nullptr;
+}
+
+void export_plane(
+    void * __restrict dst,
+    const uint8_t * __restrict src,
+    int width, int height,
+    int bits_per_sample,
+    bool half,
+    const DFTTestCore & core
+) {
+
+    auto mxcsr = get_control_word();
+    no_subnormals();
+
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    int num_x = calc_pad_num(width, core.block_size, core.block_step);
+    const uint8_t * srcs[] { src };
+
+    for (int i = 0; i < calc_pad_num(height, core.block_size, core.block_step); i++) {
+        for (int j = 0; j < num_x; j++) {
+            assert(core.block_size == 16);
+            constexpr int block_size = 16;
+
+            Vec16f block[block_size * 2];
+
+            load_block(
+                block,
+                srcs, (i * pad_stride + j) * core.block_step,
+                0, core.block_size, core.block_step,
+                width, height,
+                &core.window[core.radius * block_size], bits_per_sample
+            );
+
+            forward_spatial(block);
+
+            size_t offset = static_cast<size_t>(i * num_x + j) * spectrum_block_size;
+            for (int k = 0; k < block_size * 2; k++) {
+                float temp[16];
+                block[k].store(temp);
+
+                if (half) {
+                    auto dstp = &static_cast<uint16_t *>(dst)[offset + k * 9];
+                    for (int l = 0; l < 9; l++) {
+                        dstp[l] = float_to_half(temp[l]);
+                    }
+                } else {
+                    std::memcpy(&static_cast<float *>(dst)[offset + k * 9], temp, 9 * sizeof(float));
+                }
+            }
+        }
+    }
+
+    set_control_word(mxcsr);
+}
+
+void filter_plane_cached(
+    float * __restrict dst,
+    const void * const * srcs,
+    const float * slice_scales,
+    int width, int height,
+    bool half,
+    const DFTTestCore & core
+) {
+
+    auto mxcsr = get_control_word();
+    no_subnormals();
+
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    int num_x = calc_pad_num(width, core.block_size, core.block_step);
+
+    std::memset(dst, 0, static_cast<size_t>(pad_height) * pad_stride * sizeof(float));
+
+    for (int i = 0; i < calc_pad_num(height, core.block_size, core.block_step); i++) {
+        for (int j = 0; j < num_x; j++) {
+            assert(core.block_size == 16);
+            constexpr int block_size = 16;
+
+            Vec16f block[7 * block_size * 2];
+
+            size_t offset = static_cast<size_t>(i * num_x + j) * spectrum_block_size;
+            for (int t = 0; t < 2 * core.radius + 1; t++) {
+                for (int k = 0; k < block_size * 2; k++) {
+                    float temp[16] {};
+
+                    if (half) {
+                        auto srcp = &static_cast<const uint16_t *>(srcs[t])[offset + k * 9];
+                        for (int l = 0; l < 9; l++) {
+                            temp[l] = half_to_float(srcp[l]);
+                        }
+                    } else {
+                        std::memcpy(temp, &static_cast<const float *>(srcs[t])[offset + k * 9], 9 * sizeof(float));
+                    }
+
+                    block[t * block_size * 2 + k] = slice_scales[t] * Vec16f().load(temp);
+                }
+            }
+
+            temporal_filtering(
+                block,
+                core.sigma.get(),
+                core.sigma2,
+                core.pmin,
+                core.pmax,
+                core.filter_type,
+                core.zero_mean,
+                core.window_freq.get(),
+                core.radius
+            );
+
+            inverse_spatial(&block[core.radius * block_size * 2]);
+
+            store_block(
+                &dst[(i * pad_stride + j) * core.block_step],
+                &block[core.radius * block_size * 2],
+                block_size,
+                core.block_step,
+                width,
+                height,
+                &core.window[core.radius * block_size * 2]
+            );
+        }
+    }
+
+    set_control_word(mxcsr);
+}
+
+void real_dft(std::complex<double> * dst, const double * src, int ndim, const int * shape) {
+    int size = 1;
+    for (int i = 0; i < ndim; i++) {
+        size *= shape[i];
+    }
+
+    int complex_size = shape[ndim - 1] / 2 + 1;
+    for (int i = 0; i < ndim - 1; i++) {
+        complex_size *= shape[i];
+    }
+
+    if (ndim == 1) {
+        dft(dst, src, size, 1);
+    } else if (ndim == 2) {
+        auto temp = std::make_unique<std::complex<double> []>(complex_size);
+
+        for (int i = 0; i < shape[0]; i++) {
+            dft(&temp[i * (shape[1] / 2 + 1)], &src[i * shape[1]], shape[1], 1);
+        }
+
+        for (int i = 0; i < shape[1] / 2 + 1; i++) {
+            dft(&dst[i], &temp[i], shape[0], shape[1] / 2 + 1);
+        }
+    } else {
+        auto temp = std::make_unique<std::complex<double> []>(complex_size);
+
+        for (int i = 0; i < shape[0] * shape[1]; i++) {
+            dft(&dst[i * (shape[2] / 2 + 1)], &src[i * shape[2]], shape[2], 1);
+        }
+
+        for (int i = 0; i < shape[0]; i++) {
+            for (int j = 0; j < shape[2] / 2 + 1; j++) {
+                dft(
+                    &temp[i * shape[1] * (shape[2] / 2 + 1) + j],
+                    &dst[i * shape[1] * (shape[2] / 2 + 1) + j],
+                    shape[1],
+                    (shape[2] / 2 + 1)
+                );
+            }
+        }
+
+        for (int i = 0; i < shape[1] * (shape[2] / 2 + 1); i++) {
+            dft(&dst[i], &temp[i], shape[0], shape[1] * (shape[2] / 2 + 1));
+        }
+    }
+}
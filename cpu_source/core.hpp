@@ -0,0 +1,346 @@
+#ifndef CORE_HPP
+#define CORE_HPP
+
+#include <algorithm>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "kernel.hpp"
+
+static inline int calc_pad_size(int size, int block_size, int block_step) {
+    return (
+        size
+        + ((size % block_size) ? block_size - size % block_size : 0)
+        + std::max(block_size - block_step, block_step) * 2
+    );
+}
+
+static inline int calc_pad_num(int size, int block_size, int block_step) {
+    return (calc_pad_size(size, block_size, block_step) - block_size) / block_step + 1;
+}
+
+// Row pitch of padded planes, in samples.
+//
+// The pitch is a multiple of 64 samples, so rows are 64-byte aligned for
+// every sample type.
+static inline int calc_pad_stride(int size, int block_size, int block_step) {
+    return (calc_pad_size(size, block_size, block_step) + 63) / 64 * 64;
+}
+
+static constexpr int tile_size = 16;
+
+// output columns processed together in smode 0
+static constexpr int pixel_strip_width = 32;
+
+static inline int calc_tile_num(int size) {
+    return (size + tile_size - 1) / tile_size;
+}
+
+// Arguments of `init_core()`, with the same meaning as those of the DFTTest
+// function of the VapourSynth plugin.
+struct DFTTestCoreArgs {
+    int radius = 0;
+    int block_size = 16;
+    int block_step = 16;
+    const double * window; // shape: (2 * radius + 1, block_size, block_size)
+    const double * sigma; // shape: (2 * radius + 1, block_size, block_size / 2 + 1)
+    float sigma2;
+    float pmin;
+    float pmax;
+    int filter_type;
+    bool zero_mean = true;
+    const double * window_freq = nullptr; // shape: (2 * radius + 1, block_size, block_size / 2 + 1, 2)
+    int sparse_block_step = 0;
+    float sparse_threshold = 64.0f;
+    // `sigma` is relative to the noise power estimated on each plane
+    bool auto_sigma = false;
+    // future frames in the temporal block, in [0, 2 * radius], -1 for radius
+    // 0 is causal: the block is frames [n - 2 * radius, n]
+    int lookahead = -1;
+    // 1 overlap-adds the blocks, 0 filters every pixel in its own block, in
+    // which it is the centre sample (block_step must be 1)
+    int smode = 1;
+    // Blocks whose frame at distance d from the centre one differs from it
+    // by a mean absolute difference above `motion_threshold` (8-bit scale)
+    // are filtered with radius d - 1. 0 disables the test. Requires a
+    // centred temporal block, i.e. lookahead == radius.
+    float motion_threshold = 0.0f;
+    // windows of radius 0 to radius - 1, built as `window` for those radii,
+    // shape: (radius * radius, block_size, block_size)
+    const double * motion_window = nullptr;
+    // The output has half the width and height of the input: each block is
+    // synthesized at half resolution from its frequencies below the half-size
+    // nyquist frequency. Requires an even block_step and planes whose
+    // dimensions are multiples of 4.
+    bool downscale = false;
+    // Weight of the previous frame in [0, 1) when each frame is filtered
+    // against the spectra of the previous one instead of a temporal block,
+    // see `fused_recursive()`. 0 disables it. Requires radius 0 and
+    // filter_type 0, 1, 5 or 6.
+    float recursive = 0.0f;
+    // Skips the blocks outside of the uniform borders (letterbox or
+    // pillarbox) of the centre frame, which are copied to the output.
+    // Not supported with smode 0, downscale or recursive.
+    bool exclude_borders = false;
+    // Largest displacement, in samples, of the blocks of the other frames
+    // when they are aligned to the block of the output frame, see
+    // `fused_aligned()`. 0 disables alignment. Requires radius > 0, and is
+    // not supported with smode 0, motion_threshold or downscale.
+    int align = 0;
+};
+
+// read-only state shared by all workers of a filter instance
+struct DFTTestCore {
+    int radius;
+    int output_slice; // temporal index of the output frame, 2 * radius - lookahead
+    int block_size;
+    int block_step;
+    bool zero_mean;
+    std::unique_ptr<Vec16f []> window;
+    std::unique_ptr<Vec16f []> window_freq;
+    std::unique_ptr<Vec16f []> sigma;
+    int filter_type;
+    float sigma2;
+    float pmin;
+    float pmax;
+
+    int sparse_block_step; // 0 if disabled
+    float sparse_threshold;
+    std::unique_ptr<Vec16f []> window_weight; // overlap-add weight of a block
+
+    bool auto_sigma;
+
+    int strip_width; // blocks per column strip of the traversal, 0 for the full width
+
+    int smode;
+    // smode 0 only: factors of the separable window, and weights of the
+    // spectrum of the output slice that give its centre sample
+    std::unique_ptr<float []> window_x; // shape: (block_size), 1 at the centre
+    std::unique_ptr<float []> window_ty; // shape: (2 * radius + 1, block_size)
+    std::unique_ptr<Vec16f []> centre_weight; // shape: (block_size * 2)
+
+    // Motion-adaptive radius only. The tables of radius r < `radius` start
+    // at slice r * r, the sigma and the bounds are scaled to the energy of
+    // the smaller window, and the synthesis window keeps the gain of the
+    // overlap-add equal to that of full radius blocks.
+    float motion_threshold; // 0 if disabled
+    std::unique_ptr<Vec16f []> motion_window; // shape: (radius * radius, block_size, block_size)
+    std::unique_ptr<Vec16f []> motion_window_freq; // shape: (radius * radius, block_size, 2)
+    std::unique_ptr<Vec16f []> motion_sigma; // shape: (radius * radius, block_size)
+    std::unique_ptr<Vec16f []> motion_synthesis; // shape: (radius, block_size, block_size)
+    float motion_pmin[3];
+    float motion_pmax[3];
+
+    // Half-resolution output only, see `inverse_spatial_half()`. The blocks
+    // are weighted by the synthesis of the window itself, and the plane is
+    // normalized by the sum of the weights.
+    bool downscale;
+    std::unique_ptr<Vec8f []> half_phase; // shape: (8, 2)
+    std::unique_ptr<Vec8f []> half_basis; // shape: (4, 2)
+    std::unique_ptr<Vec8f []> half_synthesis; // shape: (8)
+    std::unique_ptr<Vec8f []> half_weight; // shape: (8)
+
+    float recursive; // 0 if disabled
+
+    bool exclude_borders;
+
+    // alignment only
+    int align; // 0 if disabled
+    std::unique_ptr<Vec16f []> slice_window_freq; // shape: (2 * radius + 1, block_size, 2)
+};
+
+// scratch buffers of a single worker
+struct DFTTestWorkspace {
+    // adaptive block placement and half-resolution output only
+    float * weight; // shape: (pad_height, pad_stride), (pad_height / 2, pad_stride) for the latter
+    uint8_t * dense; // shape: (tile_num_y, tile_num_x)
+    float * energy; // shape: (tile_num_y, tile_num_x)
+
+    // automatic sigma only
+    Vec16f * sigma; // `DFTTestCore::sigma`, followed by `motion_sigma` if present
+    float * noise; // one value per non-overlapping block
+
+    // smode 0 only, horizontal spectra of the last block_size rows of a
+    // column strip, shape: (2 * radius + 1, block_size, pixel_strip_width, 2)
+    Vec16f * row_spectra;
+};
+
+// returns an error message on failure
+//
+// `bits_per_sample` is 8-16 for integer and 32 for float input
+const char * init_core(DFTTestCore & core, const DFTTestCoreArgs & args, int bits_per_sample);
+
+// Makes a deep copy of an initialized core. The tables are written by the
+// calling thread, so that first-touch places them on its NUMA node.
+void copy_core(DFTTestCore & dst, const DFTTestCore & src);
+
+// `width` and `height` are the dimensions of the largest plane, the buffers
+// are bound to NUMA node `numa_node` if it is not negative
+DFTTestWorkspace alloc_workspace(const DFTTestCore & core, int width, int height, int numa_node = -1);
+
+void free_workspace(DFTTestWorkspace & workspace);
+
+// Resource estimation
+//
+// The sizes below follow the same arithmetic as the allocations, so they are
+// exact rather than approximate.
+
+// bytes of the tables of one copy of `core`
+size_t core_table_size(const DFTTestCore & core);
+
+// bytes allocated by `alloc_workspace()`
+size_t workspace_size(const DFTTestCore & core, int width, int height);
+
+// Measures the time in seconds taken by one thread to process one block of
+// a plane with `core`, including the padding and the output conversion.
+// The result is the best of a few runs on a synthetic plane.
+double measure_block_time(const DFTTestCore & core, int bits_per_sample);
+
+// Autotuning
+//
+// Chooses the implementation parameters of `core` that do not change the
+// filter, currently `strip_width`, by timing the candidates on a synthetic
+// plane of the given geometry. Strips only reorder the overlap-add sums at
+// their seams, i.e. the output changes by float rounding at most. The choice
+// is stored in an on-disk database keyed by processor model, kernel variant
+// and the parameters that change the work per block, so that it is only
+// measured once. Returns the chosen strip width.
+int autotune(DFTTestCore & core, int width, int height, int bits_per_sample);
+
+void reflection_padding(
+    uint8_t * __restrict dst, // shape: (pad_height, pad_stride)
+    const uint8_t * __restrict src, // shape: (height, stride)
+    int width, int height, int stride,
+    int block_size, int block_step,
+    int bytes_per_sample
+);
+
+// Filters one plane of the centre frame.
+//
+// `srcs` are the 2 * radius + 1 planes padded by `reflection_padding()`, the
+// result is written to `dst` of shape (pad_height, pad_stride), of which only
+// the first pad_height / 2 rows are used with `DFTTestCore::downscale`. The hardware
+// counters of each stage are added to `perf` if it is not null.
+//
+// With `DFTTestCore::recursive`, `recursive_state` holds the filtered spectra
+// of the blocks, in the layout of the spectrum cache below. They are used as
+// the prior if `recursive_prior` is set, i.e. if they are those of the
+// previous frame of the same plane, and are replaced by those of this frame.
+// Without a state, every frame is filtered as with radius 0.
+void filter_plane(
+    float * __restrict dst,
+    const uint8_t * const * srcs,
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core,
+    DFTTestWorkspace & workspace,
+    PerfSession * perf = nullptr,
+    float * recursive_state = nullptr, // shape: (spectrum_plane_size())
+    bool recursive_prior = false
+);
+
+// Converts the output of `filter_plane()` to the sample type. `width` and
+// `height` are those of the input, the output has half of them with
+// `DFTTestCore::downscale`.
+void store_plane(
+    uint8_t * __restrict dst,
+    const float * __restrict src, // shape: (pad_height, pad_stride)
+    int width, int height, int dst_stride,
+    int bits_per_sample,
+    const DFTTestCore & core
+);
+
+// Film grain analysis
+//
+// The residual of the filter, i.e. the source minus the output, is taken as
+// the grain of the source. Its power is accumulated by output intensity for
+// the scaling function of AV1 film grain synthesis, and its autocovariance
+// for the auto-regressive model of the grain, which is fitted when the table
+// is written.
+
+static constexpr int grain_ar_lag = 3;
+static constexpr int grain_num_bins = 10; // points of the scaling function
+// autocovariance offsets (dy, dx), dy in [0, lag] and dx in [-2 * lag, 2 * lag]
+static constexpr int grain_cov_width = 4 * grain_ar_lag + 1;
+static constexpr int grain_cov_size = (grain_ar_lag + 1) * grain_cov_width;
+
+// sums over the frames of one entry of the table, for one plane
+struct GrainStats {
+    double count[grain_num_bins] {};
+    double power[grain_num_bins] {}; // residual power, in the 8-bit scale
+    double cov[grain_cov_size] {};
+    double cov_count[grain_cov_size] {};
+};
+
+// frames of one entry of the table, times are in units of 1e-7 seconds
+struct GrainSegment {
+    int64_t start_time;
+    int64_t end_time;
+    GrainStats planes[3];
+};
+
+void add_grain_stats(GrainStats & dst, const GrainStats & src);
+
+// Adds the residual of a plane to `stats`. `filtered` is the output of
+// `filter_plane()` and `src` the padded centre plane. Not supported with
+// `DFTTestCore::downscale`.
+void accumulate_grain(
+    GrainStats & stats,
+    const float * __restrict filtered, // shape: (pad_height, pad_stride)
+    const uint8_t * __restrict src, // shape: (pad_height, pad_stride)
+    int width, int height,
+    int bits_per_sample,
+    const DFTTestCore & core
+);
+
+// Writes an AV1 film grain table in the format of aomenc's
+// `--film-grain-table`, one entry per segment. Planes whose statistics are
+// empty get no grain. Returns an error message on failure.
+const char * write_grain_table(const char * path, const GrainSegment * segments, int num_segments);
+
+// Spectrum cache
+//
+// The cache holds the 2D spectrum of every block of a plane, computed with
+// the centre slice of the window. The window is separable in time, so the
+// spectrum of a frame is shared by the 2 * radius + 1 temporal blocks that
+// contain it, and only the temporal stages have to be recomputed.
+
+// values per block: the 9 non-redundant columns of 16 complex rows
+static constexpr int spectrum_block_size = 9 * 32;
+
+// values per plane
+size_t spectrum_plane_size(int width, int height, const DFTTestCore & core);
+
+// Computes the ratio of each temporal slice of `window` to the centre one,
+// returns an error message if the window is not separable in time.
+const char * get_slice_scales(float * scales, const double * window, int radius, int block_size);
+
+// `dst` holds floats, or binary16 values if `half` is set
+void export_plane(
+    void * __restrict dst,
+    const uint8_t * __restrict src, // shape: (pad_height, pad_stride)
+    int width, int height,
+    int bits_per_sample,
+    bool half,
+    const DFTTestCore & core
+);
+
+// same as `filter_plane()`, with the spectra of the 2 * radius + 1 planes
+// read from the cache
+void filter_plane_cached(
+    float * __restrict dst,
+    const void * const * srcs,
+    const float * slice_scales,
+    int width, int height,
+    bool half,
+    const DFTTestCore & core
+);
+
+// Unnormalized real dft of an array of 1, 2 or 3 dimensions.
+//
+// `dst` has shape[0] * ... * shape[ndim - 2] * (shape[ndim - 1] / 2 + 1) elements.
+void real_dft(std::complex<double> * dst, const double * src, int ndim, const int * shape);
+
+#endif // CORE_HPP
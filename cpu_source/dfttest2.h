@@ -0,0 +1,160 @@
+#ifndef DFTTEST2_H
+#define DFTTEST2_H
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(DFTTEST2_BUILD)
+#    define DFTTEST2_API __declspec(dllexport)
+#  else
+#    define DFTTEST2_API __declspec(dllimport)
+#  endif
+#else
+#  define DFTTEST2_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Standalone CPU implementation of DFTTest, usable without VapourSynth.
+ *
+ * Frames are pushed in display order and filtered frames are pulled in the
+ * same order. A frame is filtered once its `lookahead` successors have been
+ * pushed, or after `dfttest2_finish()`. Work is spread over an internal
+ * thread pool. */
+
+typedef struct DFTTest2 DFTTest2;
+
+enum {
+    DFTTEST2_OK = 0,
+    DFTTEST2_AGAIN = 1, /* nothing can be done without blocking */
+    DFTTEST2_EOF = 2, /* all frames have been pulled */
+    DFTTEST2_ERROR = -1
+};
+
+enum {
+    DFTTEST2_INTEGER = 0,
+    DFTTEST2_FLOAT = 1
+};
+
+/* same meaning and defaults as the arguments of dfttest2.DFTTest() */
+typedef struct DFTTest2Params {
+    int ftype;
+    float sigma;
+    /* optional, shape: (tbsize, sbsize, sbsize / 2 + 1), overrides `sigma` */
+    const float * sigma_array;
+    float sigma2;
+    float pmin;
+    float pmax;
+    int sbsize;
+    int sosize;
+    /* 0 filters every pixel in its own block, of which it is the centre
+     * sample, `sosize` is then ignored */
+    int smode;
+    int tbsize;
+    int swin;
+    int twin;
+    float sbeta;
+    float tbeta;
+    int zmean;
+    float f0beta;
+    int planes; /* bitmask of planes to process */
+
+    int flat_sosize; /* negative if disabled */
+    float flat_threshold;
+    /* If positive, the noise power of each plane of each frame is estimated
+     * and `sigma` becomes this factor times the estimate, with `sigma_array`
+     * as relative weights. Requires ftype 0 or 1. */
+    float auto_sigma;
+    /* Future frames in the temporal block, in [0, tbsize - 1], negative for
+     * tbsize / 2. 0 is causal: frame n is filtered with its tbsize - 1
+     * predecessors, so it can be pulled as soon as it is pushed. */
+    int lookahead;
+    /* If positive, blocks whose frame at distance d from the centre one
+     * differs from it by a mean absolute difference above this value, in the
+     * 8-bit scale, are filtered with tbsize 2 * d - 1. Requires a centred
+     * temporal block. */
+    float motion_threshold;
+    /* If positive, frames are filtered recursively instead of with a
+     * temporal block, with this weight of the previous frame in [0, 1).
+     * Requires tbsize 1 and ftype 0 or 1. The frames are filtered in order
+     * on a single worker. */
+    float recursive;
+    /* If nonzero, the blocks outside of the uniform borders (letterbox or
+     * pillarbox) of each frame are skipped and the borders are copied. */
+    int exclude_borders;
+    /* If positive, the blocks of the other frames of the temporal block are
+     * aligned to the block of the output frame before the temporal
+     * transform, with displacements of up to this many samples estimated by
+     * phase correlation. At most sbsize / 2 - 1, requires tbsize > 1. */
+    int align;
+    /* If not NULL, an AV1 film grain table (aomenc's `--film-grain-table`)
+     * describing the residual of the filter is written to this path when all
+     * frames have been pulled. */
+    const char * grain_table;
+    /* frames per entry of the grain table, 0 for a single entry */
+    int grain_period;
+    /* frame rate, for the timestamps of the grain table */
+    int fps_num;
+    int fps_den;
+    /* If nonzero, internal parameters are tuned for the frame size on the
+     * first use, and the choice is kept in an on-disk database. */
+    int autotune;
+
+    int num_threads; /* 0 for the number of logical processors */
+} DFTTest2Params;
+
+typedef struct DFTTest2Format {
+    int width;
+    int height;
+    int num_planes;
+    int subsampling_w;
+    int subsampling_h;
+    int sample_type;
+    int bits_per_sample;
+} DFTTest2Format;
+
+DFTTEST2_API void dfttest2_params_init(DFTTest2Params * params);
+
+/* returns NULL and fills `error` on failure */
+DFTTEST2_API DFTTest2 * dfttest2_create(
+    const DFTTest2Params * params,
+    const DFTTest2Format * format,
+    char * error, size_t error_size
+);
+
+/* Copies the next input frame. `strides` are in bytes.
+ *
+ * Returns DFTTEST2_AGAIN without copying if too many frames are waiting to be
+ * pulled, in which case a frame must be pulled first. */
+DFTTEST2_API int dfttest2_push(
+    DFTTest2 * d,
+    const void * const planes[],
+    const ptrdiff_t strides[]
+);
+
+/* signals the end of input */
+DFTTEST2_API int dfttest2_finish(DFTTest2 * d);
+
+/* Writes the next filtered frame. `strides` are in bytes.
+ *
+ * Returns DFTTEST2_AGAIN if the frame needs more input, or if it is still
+ * being filtered and `wait` is zero. Returns DFTTEST2_ERROR instead of the
+ * first DFTTEST2_EOF if the grain table cannot be written. */
+DFTTEST2_API int dfttest2_pull(
+    DFTTest2 * d,
+    void * const planes[],
+    const ptrdiff_t strides[],
+    int wait
+);
+
+DFTTEST2_API void dfttest2_free(DFTTest2 * d);
+
+DFTTEST2_API const char * dfttest2_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFTTEST2_H */
@@ -0,0 +1,86 @@
+#ifndef DFTTEST2_SHM_H
+#define DFTTEST2_SHM_H
+
+#include <stddef.h>
+
+#include "dfttest2.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shared-memory frame ring (POSIX only).
+ *
+ * A server process denoises a clip once and publishes the filtered frames
+ * into a ring of `num_slots` frames in a named shared-memory object. Up to
+ * `num_consumers` client processes attach to the ring and read every frame
+ * in order directly from the shared mapping. A slot is reused once all
+ * consumers have released it, so the server runs at the pace of the slowest
+ * consumer, and the first frames are kept until every consumer has attached.
+ *
+ * Return values are the DFTTEST2_* codes of dfttest2.h. */
+
+typedef struct DFTTest2Shm DFTTest2Shm;
+
+typedef struct DFTTest2ShmFrame {
+    long long index;
+    int slot;
+    const void * planes[3];
+    ptrdiff_t strides[3]; /* in bytes */
+} DFTTest2ShmFrame;
+
+/* Creates the ring `name` (e.g. "/dfttest2"). `tag` is an optional string
+ * of at most 1023 bytes passed to the clients, e.g. a stream header. */
+DFTTEST2_API DFTTest2Shm * dfttest2_shm_create(
+    const char * name,
+    const DFTTest2Format * format,
+    int num_slots,
+    int num_consumers,
+    const char * tag,
+    char * error, size_t error_size
+);
+
+/* Returns the planes of the next slot to be written. Returns DFTTEST2_AGAIN
+ * if the slot is still used by a consumer and `wait` is zero. Calling it
+ * again before dfttest2_shm_end_write() returns the same slot. */
+DFTTEST2_API int dfttest2_shm_begin_write(
+    DFTTest2Shm * shm,
+    void * planes[],
+    ptrdiff_t strides[],
+    int wait
+);
+
+/* publishes the slot returned by dfttest2_shm_begin_write() */
+DFTTEST2_API int dfttest2_shm_end_write(DFTTest2Shm * shm);
+
+/* signals the end of the clip to the consumers */
+DFTTEST2_API int dfttest2_shm_finish(DFTTest2Shm * shm);
+
+/* Attaches to the ring `name` as a consumer. Fails if `num_consumers`
+ * clients have already attached. */
+DFTTEST2_API DFTTest2Shm * dfttest2_shm_attach(
+    const char * name,
+    char * error, size_t error_size
+);
+
+DFTTEST2_API void dfttest2_shm_get_format(const DFTTest2Shm * shm, DFTTest2Format * format);
+
+DFTTEST2_API const char * dfttest2_shm_get_tag(const DFTTest2Shm * shm);
+
+/* Acquires the next frame without copying it. The frame stays valid until
+ * it is released. Returns DFTTEST2_AGAIN if the frame has not been published
+ * yet and `wait` is zero, or DFTTEST2_EOF after the last frame. */
+DFTTEST2_API int dfttest2_shm_acquire(DFTTest2Shm * shm, DFTTest2ShmFrame * frame, int wait);
+
+DFTTEST2_API int dfttest2_shm_release(DFTTest2Shm * shm, const DFTTest2ShmFrame * frame);
+
+/* For a consumer, all acquired frames must have been released, and frames
+ * not yet acquired are given up. For the server, waits until all published
+ * frames have been released and removes the ring. */
+DFTTEST2_API void dfttest2_shm_close(DFTTest2Shm * shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DFTTEST2_SHM_H */
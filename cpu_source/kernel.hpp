@@ -1,8 +1,16 @@
 #ifndef KERNEL_HPP
 #define KERNEL_HPP
 
-#include <vectorclass.h>
-#include <vectormath_exp.h>
+#include <algorithm>
+#include <cmath>
+
+#include "simd.hpp"
+
+#ifdef VCL_NAMESPACE
+using namespace VCL_NAMESPACE;
+#endif
+
+#include "perf.hpp"
 
 #define DK(name, value) const E name = E(value)
 #define FMA(a, b, c) mul_add(a, b, c)
@@ -17,10 +25,8 @@ template <int n>
 static void rdft(Vec16f data[(n / 2 + 1) * 2]);
 
 // ./gen_r2cf.native -standalone -with-rs 2 -with-csr 2 -with-csi 2 -fma -n 16
-template <>
-void rdft<16>(Vec16f data[18]) {
-    using E = Vec16f;
-
+template <typename E>
+static inline void rdft16_impl(E data[18]) {
     auto R0 = &data[0];
     auto R1 = &data[1];
     auto Cr = R0;
@@ -184,6 +190,11 @@ void rdft<16>(Vec16f data[18]) {
     Ci[16] = 0.0f;
 }
 
+template <>
+void rdft<16>(Vec16f data[18]) {
+    rdft16_impl(data);
+}
+
 template <int n>
 static void dft(Vec16f data[/* (n - 1) * stride * 2 + 2 */], int stride = 1);
 
@@ -495,10 +506,8 @@ void dft<7>(Vec16f data[/* 12 * stride + 2 */], int stride) {
 }
 
 // ./gen_notw.native -standalone -with-istride 2 -with-ostride 2 -fma -n 16 -sign -1
-template <>
-void dft<16>(Vec16f data[/* 30 * stride + 2 */], int stride) {
-    using E = Vec16f;
-
+template <typename E>
+static inline void dft16_impl(E data[/* 30 * stride + 2 */], int stride) {
     auto ri = &data[0];
     auto ii = &data[1];
     auto ro = ri;
@@ -870,6 +879,11 @@ void dft<16>(Vec16f data[/* 30 * stride + 2 */], int stride) {
     }
 }
 
+template <>
+void dft<16>(Vec16f data[/* 30 * stride + 2 */], int stride) {
+    dft16_impl(data, stride);
+}
+
 template <int n>
 static void idft(Vec16f data[/* (n - 1) * stride * 2 + 2 */], int stride = 1);
 
@@ -1181,11 +1195,83 @@ void idft<7>(Vec16f data[/* 8 * stride + 2 */], int stride) {
     }
 }
 
-// ./gen_notw.native -standalone -with-istride 2 -with-ostride 2 -fma -n 16 -sign 1
-template <>
-void idft<16>(Vec16f data[/* 30 * stride + 2 */], int stride) {
-    using E = Vec16f;
+// Radix-2 decimation in frequency, with the conventions of the generated
+// codelets. Used at half resolution, where it runs on Vec8f.
+template <typename E>
+static inline void idft8_impl(E data[/* 14 * stride + 2 */], int stride) {
+    auto ri = &data[0];
+    auto ii = &data[1];
+    auto ro = ri;
+    auto io = ii;
 
+    DK(KP707106781, +0.707106781186547524400844362104849039284835938);
+
+    // length-2 transforms of samples k and k + 4, the differences are
+    // multiplied by exp(2 pi i k / 8)
+    E S0r = ri[0 * stride] + ri[8 * stride];
+    E S0i = ii[0 * stride] + ii[8 * stride];
+    E D0r = ri[0 * stride] - ri[8 * stride];
+    E D0i = ii[0 * stride] - ii[8 * stride];
+    E S1r = ri[2 * stride] + ri[10 * stride];
+    E S1i = ii[2 * stride] + ii[10 * stride];
+    E T1r = ri[2 * stride] - ri[10 * stride];
+    E T1i = ii[2 * stride] - ii[10 * stride];
+    E S2r = ri[4 * stride] + ri[12 * stride];
+    E S2i = ii[4 * stride] + ii[12 * stride];
+    E D2r = ii[12 * stride] - ii[4 * stride];
+    E D2i = ri[4 * stride] - ri[12 * stride];
+    E S3r = ri[6 * stride] + ri[14 * stride];
+    E S3i = ii[6 * stride] + ii[14 * stride];
+    E T3r = ri[6 * stride] - ri[14 * stride];
+    E T3i = ii[6 * stride] - ii[14 * stride];
+    E D1r = KP707106781 * (T1r - T1i);
+    E D1i = KP707106781 * (T1r + T1i);
+    E D3r = -KP707106781 * (T3r + T3i);
+    E D3i = KP707106781 * (T3r - T3i);
+
+    // length-4 transforms of the sums to the even outputs and of the
+    // differences to the odd outputs
+    {
+        E E0r = S0r + S2r;
+        E E0i = S0i + S2i;
+        E E1r = S0r - S2r;
+        E E1i = S0i - S2i;
+        E F0r = S1r + S3r;
+        E F0i = S1i + S3i;
+        E F1r = S1r - S3r;
+        E F1i = S1i - S3i;
+        ro[0 * stride] = E0r + F0r;
+        io[0 * stride] = E0i + F0i;
+        ro[8 * stride] = E0r - F0r;
+        io[8 * stride] = E0i - F0i;
+        ro[4 * stride] = E1r - F1i;
+        io[4 * stride] = E1i + F1r;
+        ro[12 * stride] = E1r + F1i;
+        io[12 * stride] = E1i - F1r;
+    }
+    {
+        E E0r = D0r + D2r;
+        E E0i = D0i + D2i;
+        E E1r = D0r - D2r;
+        E E1i = D0i - D2i;
+        E F0r = D1r + D3r;
+        E F0i = D1i + D3i;
+        E F1r = D1r - D3r;
+        E F1i = D1i - D3i;
+        ro[2 * stride] = E0r + F0r;
+        io[2 * stride] = E0i + F0i;
+        ro[10 * stride] = E0r - F0r;
+        io[10 * stride] = E0i - F0i;
+        ro[6 * stride] = E1r - F1i;
+        io[6 * stride] = E1i + F1r;
+        ro[14 * stride] = E1r + F1i;
+        io[14 * stride] = E1i - F1r;
+    }
+}
+
+// ./gen_notw.native -standalone -with-istride 2 -with-ostride 2 -fma -n 16 -sign 1
+template <typename E>
+static inline void idft16_impl(E data[/* 30 * stride + 2 */], int stride) {
     auto ri = &data[0];
     auto ii = &data[1];
     auto ro = ri;
@@ -1557,14 +1643,17 @@ void idft<16>(Vec16f data[/* 30 * stride + 2 */], int stride) {
     }
 }
 
+template <>
+void idft<16>(Vec16f data[/* 30 * stride + 2 */], int stride) {
+    idft16_impl(data, stride);
+}
+
 template <int n>
 static void irdft(Vec16f data[(n / 2 + 1) * 2]);
 
 // ./gen_r2cb.native -standalone -with-rs 2 -with-csr 2 -with-csi 2 -fma -n 16
-template <>
-void irdft<16>(Vec16f data[18]) {
-    using E = Vec16f;
-
+template <typename E>
+static inline void irdft16_impl(E data[18]) {
     auto R0 = &data[0];
     auto R1 = &data[1];
     auto Cr = R0;
@@ -1727,6 +1816,11 @@ void irdft<16>(Vec16f data[18]) {
     }
 }
 
+template <>
+void irdft<16>(Vec16f data[18]) {
+    irdft16_impl(data);
+}
+
 template <int n>
 static void post_irdft(Vec16f data[n]);
 
@@ -1907,24 +2001,8 @@ static inline void add_mean(
     }
 }
 
-static inline void fused(
-    Vec16f * __restrict block,
-    const Vec16f * __restrict sigma,
-    float sigma2,
-    float pmin,
-    float pmax,
-    int filter_type,
-    bool zero_mean,
-    const Vec16f * __restrict window_freq,
-    int radius
-) {
-
-    for (int i = 0; i < 2 * radius + 1; i++) {
-        transpose_16x16(&block[i * 32]);
-        rdft<16>(&block[i * 32]);
-        transpose_32x16(&block[i * 32]);
-        dft<16>(&block[i * 32]);
-    }
+// temporal dft of the 2D spectra of the 2 * radius + 1 slices, in place
+static inline void forward_temporal(Vec16f * block, int radius) {
     if (radius == 0) {
         #pragma GCC unroll 16
         for (int i = 0; i < 16; i++) {
@@ -1949,19 +2027,9 @@ static inline void fused(
             dft<7>(&block[i * 2], 16);
         }
     }
+}
 
-    float gf {};
-    if (zero_mean) {
-        gf = block[0].extract(0) / window_freq[0].extract(0);
-        remove_mean(block, gf, window_freq, radius);
-    }
-
-    frequency_filtering(block, sigma, sigma2, pmin, pmax, filter_type, radius);
-
-    if (zero_mean) {
-        add_mean(block, gf, window_freq, radius);
-    }
-
+static inline void inverse_temporal(Vec16f * block, int radius) {
     if (radius == 0) {
         #pragma GCC unroll 16
         for (int i = 0; i < 16; i++) {
@@ -1986,11 +2054,437 @@ static inline void fused(
             idft<7>(&block[i * 2], 16);
         }
     }
-    idft<16>(&block[radius * 32]);
-    transpose_32x16(&block[radius * 32]);
-    irdft<16>(&block[radius * 32]);
-    post_irdft<16>(&block[radius * 32]);
-    transpose_16x16(&block[radius * 32]);
+}
+
+template <typename Probe = NoProbe>
+static inline void temporal_filtering(
+    Vec16f * __restrict block,
+    const Vec16f * __restrict sigma,
+    float sigma2,
+    float pmin,
+    float pmax,
+    int filter_type,
+    bool zero_mean,
+    const Vec16f * __restrict window_freq,
+    int radius,
+    Probe probe = {}
+) {
+
+    forward_temporal(block, radius);
+    probe(perf_transform);
+
+    float gf {};
+    if (zero_mean) {
+        gf = block[0].extract(0) / window_freq[0].extract(0);
+        remove_mean(block, gf, window_freq, radius);
+    }
+
+    frequency_filtering(block, sigma, sigma2, pmin, pmax, filter_type, radius);
+
+    if (zero_mean) {
+        add_mean(block, gf, window_freq, radius);
+    }
+    probe(perf_filter);
+
+    inverse_temporal(block, radius);
+}
+
+#ifndef DFTTEST2_PORTABLE
+// AVX-512 versions of the spatial transforms below, in kernel_avx512.cpp
+void forward_spatial_avx512(float * block);
+void inverse_spatial_avx512(float * block);
+
+// set at startup if the processor supports AVX-512F
+extern const bool spatial_avx512;
+#endif
+
+// 2D spectrum of one windowed spatial slice, in place
+static inline void forward_spatial(Vec16f block[/* 32 */]) {
+#if INSTRSET < 9 && !defined(DFTTEST2_PORTABLE)
+    if (spatial_avx512) {
+        forward_spatial_avx512(reinterpret_cast<float *>(block));
+        return ;
+    }
+#endif
+
+    transpose_16x16(block);
+    rdft<16>(block);
+    transpose_32x16(block);
+    dft<16>(block);
+}
+
+static inline void inverse_spatial(Vec16f block[/* 32 */]) {
+#if INSTRSET < 9 && !defined(DFTTEST2_PORTABLE)
+    if (spatial_avx512) {
+        inverse_spatial_avx512(reinterpret_cast<float *>(block));
+        return ;
+    }
+#endif
+
+    idft<16>(block);
+    transpose_32x16(block);
+    irdft<16>(block);
+    post_irdft<16>(block);
+    transpose_16x16(block);
+}
+
+// `probe` is notified at the end of the transform, filter and inverse stages,
+// only slice `output_slice` of the 2 * radius + 1 slices is synthesized
+template <typename Probe = NoProbe>
+static inline void fused(
+    Vec16f * __restrict block,
+    const Vec16f * __restrict sigma,
+    float sigma2,
+    float pmin,
+    float pmax,
+    int filter_type,
+    bool zero_mean,
+    const Vec16f * __restrict window_freq,
+    int radius,
+    int output_slice,
+    Probe probe = {}
+) {
+
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        forward_spatial(&block[i * 32]);
+    }
+
+    temporal_filtering(block, sigma, sigma2, pmin, pmax, filter_type, zero_mean, window_freq, radius, probe);
+
+    inverse_spatial(&block[output_slice * 32]);
+    probe(perf_inverse);
+}
+
+// Displacement (dy, dx), within `range` samples, that best aligns the
+// content of the 2D spectrum `neighbour` to that of `centre`, by phase
+// correlation: the inverse transform of their cross-power spectrum, the
+// correlation surface, peaks at the displacement. The mean of each slice,
+// i.e. its window times its mean, is removed first since it does not move
+// with the content. Noise dominates the weak frequencies of a block, so
+// the cross-power spectrum is only normalized down to a floor relative to
+// its mean magnitude. Returns false for no motion.
+static inline bool phase_correlation(
+    int & dy,
+    int & dx,
+    const Vec16f * __restrict centre, // shape: (16, 2)
+    const Vec16f * __restrict neighbour, // shape: (16, 2)
+    const Vec16f * __restrict centre_window, // 2D spectrum of the window of `centre`
+    const Vec16f * __restrict neighbour_window, // 2D spectrum of the window of `neighbour`
+    int range
+) {
+
+    constexpr float relative_floor = 16.0f;
+
+    float centre_mean = centre[0].extract(0) / centre_window[0].extract(0);
+    float neighbour_mean = neighbour[0].extract(0) / neighbour_window[0].extract(0);
+
+    // conj(centre) * neighbour peaks at +displacement
+    Vec16f surface[32];
+    Vec16f magnitude[16];
+    Vec16f sum = 0.0f;
+    auto lanes = Vec16f(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15) < 9.0f;
+    for (int i = 0; i < 16; i++) {
+        auto c_re = nmul_add(centre_mean, centre_window[i * 2], centre[i * 2]);
+        auto c_im = nmul_add(centre_mean, centre_window[i * 2 + 1], centre[i * 2 + 1]);
+        auto n_re = nmul_add(neighbour_mean, neighbour_window[i * 2], neighbour[i * 2]);
+        auto n_im = nmul_add(neighbour_mean, neighbour_window[i * 2 + 1], neighbour[i * 2 + 1]);
+        surface[i * 2] = mul_add(c_re, n_re, c_im * n_im);
+        surface[i * 2 + 1] = mul_sub(c_re, n_im, c_im * n_re);
+        magnitude[i] = sqrt(square(surface[i * 2]) + square(surface[i * 2 + 1]));
+        sum += select(lanes, magnitude[i], 0.0f);
+    }
+
+    float magnitude_floor = relative_floor * horizontal_add(sum) / (16 * 9) + 1e-15f;
+    for (int i = 0; i < 16; i++) {
+        auto inv_magnitude = 1.0f / (magnitude[i] + magnitude_floor);
+        surface[i * 2] *= inv_magnitude;
+        surface[i * 2 + 1] *= inv_magnitude;
+    }
+
+    inverse_spatial(surface);
+
+    alignas(64) float values[16][16];
+    for (int i = 0; i < 16; i++) {
+        surface[i].store_a(values[i]);
+    }
+
+    float best = values[0][0];
+    dy = dx = 0;
+    for (int y = -range; y <= range; y++) {
+        for (int x = -range; x <= range; x++) {
+            float value = values[y & 15][x & 15];
+            if (value > best) {
+                best = value;
+                dy = y;
+                dx = x;
+            }
+        }
+    }
+
+    return dy != 0 || dx != 0;
+}
+
+// energy of the difference of two 2D spectra, `neighbour` scaled by `gain`
+static inline float slice_distance(
+    const Vec16f * __restrict centre, // shape: (16, 2)
+    const Vec16f * __restrict neighbour, // shape: (16, 2)
+    float gain
+) {
+
+    // the columns between 0 and the nyquist frequency stand for two of the full spectrum
+    const Vec16f weight(1, 2, 2, 2, 2, 2, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0);
+    Vec16f sum = 0.0f;
+    for (int i = 0; i < 32; i++) {
+        sum = mul_add(weight, square(nmul_add(gain, neighbour[i], centre[i])), sum);
+    }
+    return horizontal_add(sum);
+}
+
+// `fused()` with the slices aligned to the output slice before the temporal
+// transform. The displacement of each other slice is estimated by
+// `phase_correlation()` on the 2D spectra and clamped to `bounds`, then
+// `fetch(i, dy, dx, slice)` loads the windowed samples of slice i at that
+// displacement into `slice`. The displaced slice is kept only if the energy
+// of its difference to the output slice falls below `acceptance` times the
+// previous one, so that peaks of the noise do not move static content. The
+// window shrinks the estimates of large displacements, so the spectrum of
+// the displaced slice is correlated again for the residual, up to
+// `iterations` times. Static blocks cost one inverse transform per slice.
+template <typename Fetch, typename Probe = NoProbe>
+static inline void fused_aligned(
+    Vec16f * __restrict block,
+    const Vec16f * __restrict sigma,
+    float sigma2,
+    float pmin,
+    float pmax,
+    int filter_type,
+    bool zero_mean,
+    const Vec16f * __restrict window_freq,
+    int radius,
+    int output_slice,
+    const Vec16f * __restrict slice_window_freq, // shape: (2 * radius + 1, 16, 2)
+    const int bounds[/* min_dy, max_dy, min_dx, max_dx */],
+    int range,
+    int iterations,
+    float acceptance,
+    Fetch && fetch,
+    Probe probe = {}
+) {
+
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        forward_spatial(&block[i * 32]);
+    }
+
+    // displacements of the slices, which are visited from the output slice
+    // outwards so that those further away start from the motion of their
+    // inner neighbour, assuming a constant velocity
+    int displacements[7][2] {};
+
+    auto try_displacement = [&](int i, int dy, int dx, float gain) -> bool {
+        dy = std::clamp(dy, bounds[0], bounds[1]);
+        dx = std::clamp(dx, bounds[2], bounds[3]);
+        if (dy == displacements[i][0] && dx == displacements[i][1]) {
+            return false;
+        }
+
+        Vec16f previous[32];
+        std::copy_n(&block[i * 32], 32, previous);
+        fetch(i, dy, dx, &block[i * 32]);
+        forward_spatial(&block[i * 32]);
+
+        if (slice_distance(&block[output_slice * 32], &block[i * 32], gain) >=
+            acceptance * slice_distance(&block[output_slice * 32], previous, gain)
+        ) {
+            std::copy_n(previous, 32, &block[i * 32]);
+            return false;
+        }
+
+        displacements[i][0] = dy;
+        displacements[i][1] = dx;
+        return true;
+    };
+
+    for (int distance = 1; distance <= 2 * radius; distance++) {
+        for (int side : { -1, 1 }) {
+            int i = output_slice + side * distance;
+            if (i < 0 || i > 2 * radius) {
+                continue;
+            }
+
+            // brings the slice to the scale of the output slice
+            float gain = slice_window_freq[output_slice * 32].extract(0) / slice_window_freq[i * 32].extract(0);
+
+            if (distance > 1) {
+                auto inner = displacements[i - side];
+                if (inner[0] != 0 || inner[1] != 0) {
+                    try_displacement(
+                        i,
+                        static_cast<int>(std::lround(inner[0] * distance / (distance - 1.0))),
+                        static_cast<int>(std::lround(inner[1] * distance / (distance - 1.0))),
+                        gain
+                    );
+                }
+            }
+
+            for (int iteration = 0; iteration < iterations; iteration++) {
+                int dy, dx;
+                if (!phase_correlation(
+                    dy, dx,
+                    &block[output_slice * 32], &block[i * 32],
+                    &slice_window_freq[output_slice * 32], &slice_window_freq[i * 32],
+                    range
+                )) {
+                    break;
+                }
+
+                if (!try_displacement(i, displacements[i][0] + dy, displacements[i][1] + dx, gain)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    temporal_filtering(block, sigma, sigma2, pmin, pmax, filter_type, zero_mean, window_freq, radius, probe);
+
+    inverse_spatial(&block[output_slice * 32]);
+    probe(perf_inverse);
+}
+
+template <int i>
+static inline Vec8f broadcast(Vec8f a) {
+    return permute8<i, i, i, i, i, i, i, i>(a);
+}
+
+// Synthesizes the 8x8 half-resolution block of a 2D spectrum from its
+// frequencies below the nyquist frequency of the half-size grid.
+//
+// `phase` crops rows -3 to 3 and columns 0 to 3 of the spectrum and delays
+// them by half a sample, so that output sample (m, n) lies at (2m + 0.5,
+// 2n + 0.5) of the block, i.e. at the centre of the 2x2 samples it
+// replaces. The columns are then synthesized with `basis`, the real
+// inverse of the 4 columns, which are in lanes and stay there.
+static inline void inverse_spatial_half(
+    Vec8f half_block[/* 8 */],
+    const Vec16f * __restrict block, // 2D spectrum, shape: (16, 2)
+    const Vec8f * __restrict phase, // shape: (8, 2)
+    const Vec8f * __restrict basis // shape: (4, 2)
+) {
+
+    Vec8f data[16];
+    for (int i = 0; i < 8; i++) {
+        int row = i < 4 ? i : i + 8;
+        auto re = block[row * 2].get_low();
+        auto im = block[row * 2 + 1].get_low();
+        data[i * 2] = mul_sub(re, phase[i * 2], im * phase[i * 2 + 1]);
+        data[i * 2 + 1] = mul_add(re, phase[i * 2 + 1], im * phase[i * 2]);
+    }
+
+    idft8_impl(data, 1);
+
+    for (int i = 0; i < 8; i++) {
+        auto re = data[i * 2];
+        auto im = data[i * 2 + 1];
+        Vec8f sum = broadcast<0>(re) * basis[0];
+        sum = mul_add(broadcast<1>(re), basis[2], sum);
+        sum = nmul_add(broadcast<1>(im), basis[3], sum);
+        sum = mul_add(broadcast<2>(re), basis[4], sum);
+        sum = nmul_add(broadcast<2>(im), basis[5], sum);
+        sum = mul_add(broadcast<3>(re), basis[6], sum);
+        sum = nmul_add(broadcast<3>(im), basis[7], sum);
+        half_block[i] = sum;
+    }
+}
+
+// `fused()` with the output slice synthesized at half resolution
+template <typename Probe = NoProbe>
+static inline void fused_half(
+    Vec8f half_block[/* 8 */],
+    Vec16f * __restrict block,
+    const Vec16f * __restrict sigma,
+    float sigma2,
+    float pmin,
+    float pmax,
+    int filter_type,
+    bool zero_mean,
+    const Vec16f * __restrict window_freq,
+    int radius,
+    int output_slice,
+    const Vec8f * __restrict phase,
+    const Vec8f * __restrict basis,
+    Probe probe = {}
+) {
+
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        forward_spatial(&block[i * 32]);
+    }
+
+    temporal_filtering(block, sigma, sigma2, pmin, pmax, filter_type, zero_mean, window_freq, radius, probe);
+
+    inverse_spatial_half(half_block, &block[output_slice * 32], phase, basis);
+    probe(perf_inverse);
+}
+
+// `fused()` of a single slice, filtered recursively in time.
+//
+// `estimate` is the temporally filtered spectrum of the block in the previous
+// frame if `prior` is set. Each frequency moves from it towards the current
+// spectrum by the larger of 1 - `recursive` and the wiener gain of their
+// difference against `sigma`, so that static content is averaged over time
+// and moving content follows the current frame. The result replaces
+// `estimate`, and is then filtered spatially against `sigma` scaled by its
+// noise power relative to a single frame, k / (2 - k) for a gain k.
+// Without `prior` the block is filtered as with radius 0.
+template <typename Probe = NoProbe>
+static inline void fused_recursive(
+    Vec16f * __restrict block,
+    Vec16f * __restrict estimate, // shape: (16, 2)
+    bool prior,
+    float recursive,
+    const Vec16f * __restrict sigma,
+    float sigma2,
+    float pmin,
+    float pmax,
+    int filter_type,
+    bool zero_mean,
+    const Vec16f * __restrict window_freq,
+    Probe probe = {}
+) {
+
+    forward_spatial(block);
+    probe(perf_transform);
+
+    float gf {};
+    if (zero_mean) {
+        gf = block[0].extract(0) / window_freq[0].extract(0);
+        remove_mean(block, gf, window_freq, 0);
+    }
+
+    Vec16f scaled_sigma[16];
+    for (int i = 0; i < 16; i++) {
+        if (prior) {
+            auto re = block[i * 2] - estimate[i * 2];
+            auto im = block[i * 2 + 1] - estimate[i * 2 + 1];
+            auto psd = square(re) + square(im);
+            auto gain = max(max((psd - sigma[i]) / (psd + 1e-15f), 0.0f), 1.0f - recursive);
+            block[i * 2] = mul_add(gain, re, estimate[i * 2]);
+            block[i * 2 + 1] = mul_add(gain, im, estimate[i * 2 + 1]);
+            scaled_sigma[i] = sigma[i] * gain / (2.0f - gain);
+        } else {
+            scaled_sigma[i] = sigma[i];
+        }
+        estimate[i * 2] = block[i * 2];
+        estimate[i * 2 + 1] = block[i * 2 + 1];
+    }
+
+    frequency_filtering(block, scaled_sigma, sigma2, pmin, pmax, filter_type, 0);
+
+    if (zero_mean) {
+        add_mean(block, gf, window_freq, 0);
+    }
+    probe(perf_filter);
+
+    inverse_spatial(block);
+    probe(perf_inverse);
 }
 
 #endif // KERNEL_HPP
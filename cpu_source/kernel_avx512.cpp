@@ -0,0 +1,186 @@
+// AVX-512 versions of forward_spatial() and inverse_spatial().
+//
+// This file is compiled with AVX-512F enabled and only called when the
+// processor supports it (`spatial_avx512`). With 32 zmm registers, the 16
+// real and 16 imaginary rows of a spatial slice are loaded once and stay in
+// registers through both transposes and both 16-point transforms, instead of
+// going through the `block` array between the stages.
+//
+// The vector classes are put in their own namespace, so that their
+// non-inlined members cannot replace those of the AVX2 build at link time.
+// The functions and types of kernel.hpp have internal linkage. The results
+// are checked against the generic transforms by tests/avx512.cpp.
+
+#define VCL_NAMESPACE dfttest2_avx512
+#include "kernel.hpp"
+
+#include <cstdint>
+
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define FLATTEN __attribute__((flatten))
+#else
+#define FLATTEN
+#endif
+
+namespace {
+
+// element type of the generated codelets
+struct Zmm {
+    __m512 v;
+
+    Zmm() = default;
+    Zmm(__m512 v) : v(v) {}
+    Zmm(float x) : v(_mm512_set1_ps(x)) {}
+};
+
+static inline Zmm operator+(Zmm a, Zmm b) {
+    return _mm512_add_ps(a.v, b.v);
+}
+
+static inline Zmm operator-(Zmm a, Zmm b) {
+    return _mm512_sub_ps(a.v, b.v);
+}
+
+static inline Zmm operator*(Zmm a, Zmm b) {
+    return _mm512_mul_ps(a.v, b.v);
+}
+
+static inline Zmm operator-(Zmm a) {
+    return _mm512_sub_ps(_mm512_setzero_ps(), a.v);
+}
+
+static inline Zmm mul_add(Zmm a, Zmm b, Zmm c) {
+    return _mm512_fmadd_ps(a.v, b.v, c.v);
+}
+
+static inline Zmm mul_sub(Zmm a, Zmm b, Zmm c) {
+    return _mm512_fmsub_ps(a.v, b.v, c.v);
+}
+
+static inline Zmm nmul_add(Zmm a, Zmm b, Zmm c) {
+    return _mm512_fnmadd_ps(a.v, b.v, c.v);
+}
+
+// blend16<i...>() of two vectors, a single vpermt2ps
+template <int... i>
+static inline Zmm blend(Zmm a, Zmm b) {
+    alignas(64) static constexpr int32_t index[16] { i... };
+    return _mm512_permutex2var_ps(a.v, _mm512_load_si512(index), b.v);
+}
+
+// blend8<i...>() of two vectors reinterpreted as Vec8d, a single vpermt2pd
+template <int... i>
+static inline Zmm blend_pd(Zmm a, Zmm b) {
+    alignas(64) static constexpr int64_t index[8] { i... };
+    return _mm512_castpd_ps(_mm512_permutex2var_pd(
+        _mm512_castps_pd(a.v), _mm512_load_si512(index), _mm512_castps_pd(b.v)
+    ));
+}
+
+// same permutations as transpose_16x16() in kernel.hpp
+template <int stride = 1>
+static inline void transpose_16x16(Zmm block[/* 16 */]) {
+    #pragma GCC unroll 2
+    for (int i = 0; i < 2; i++) {
+        #pragma GCC unroll 2
+        for (int j = 0; j < 2; j++) {
+            #pragma GCC unroll 2
+            for (int k = 0; k < 2; k++) {
+                auto id1 = ((i * 2 + j) * 2 + k) * 2 * stride;
+                auto id2 = (((i * 2 + j) * 2 + k) * 2 + 1) * stride;
+                Zmm temp1 = blend<0, 2, 16, 18, 4, 6, 20, 22, 8, 10, 24, 26, 12, 14, 28, 30>(block[id1], block[id2]);
+                Zmm temp2 = blend<1, 3, 17, 19, 5, 7, 21, 23, 9, 11, 25, 27, 13, 15, 29, 31>(block[id1], block[id2]);
+                block[id1] = temp1;
+                block[id2] = temp2;
+            }
+
+            #pragma GCC unroll 2
+            for (int k = 0; k < 2; k++) {
+                auto id1 = (((i * 2 + j) * 2) * 2 + k) * stride;
+                auto id2 = (((i * 2 + j) * 2 + 1) * 2 + k) * stride;
+                Zmm temp1 = blend<0, 2, 16, 18, 4, 6, 20, 22, 8, 10, 24, 26, 12, 14, 28, 30>(block[id1], block[id2]);
+                Zmm temp2 = blend<1, 3, 17, 19, 5, 7, 21, 23, 9, 11, 25, 27, 13, 15, 29, 31>(block[id1], block[id2]);
+                block[id1] = temp1;
+                block[id2] = temp2;
+            }
+        }
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < 4; j++) {
+            auto id1 = (i * 8 + j) * stride;
+            auto id2 = (i * 8 + 4 + j) * stride;
+            Zmm temp1 = blend_pd<0, 1, 8, 9, 4, 5, 12, 13>(block[id1], block[id2]);
+            Zmm temp2 = blend_pd<2, 3, 10, 11, 6, 7, 14, 15>(block[id1], block[id2]);
+            block[id1] = temp1;
+            block[id2] = temp2;
+        }
+    }
+
+    #pragma GCC unroll 8
+    for (int i = 0; i < 8; i++) {
+        Zmm temp1 = blend_pd<0, 1, 2, 3, 8, 9, 10, 11>(block[i * stride], block[(i + 8) * stride]);
+        Zmm temp2 = blend_pd<4, 5, 6, 7, 12, 13, 14, 15>(block[i * stride], block[(i + 8) * stride]);
+        block[i * stride] = temp1;
+        block[(i + 8) * stride] = temp2;
+    }
+}
+
+template <int stride = 1>
+static inline void transpose_32x16(Zmm block[/* 16 * 2 */]) {
+    transpose_16x16<2 * stride>(block);
+    transpose_16x16<2 * stride>(block + stride);
+}
+
+} // namespace
+
+// `block` is only accessed with constant indices once everything is inlined,
+// so it lives in registers. Only temporaries of the codelets may be spilled.
+FLATTEN void forward_spatial_avx512(float * data) {
+    Zmm block[32];
+
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) {
+        block[i] = _mm512_loadu_ps(&data[i * 16]);
+    }
+    // frequencies above 8 are not produced by rdft16_impl()
+    #pragma GCC unroll 14
+    for (int i = 18; i < 32; i++) {
+        block[i] = _mm512_setzero_ps();
+    }
+
+    transpose_16x16(block);
+    rdft16_impl(block);
+    transpose_32x16(block);
+    dft16_impl(block, 1);
+
+    #pragma GCC unroll 32
+    for (int i = 0; i < 32; i++) {
+        _mm512_storeu_ps(&data[i * 16], block[i].v);
+    }
+}
+
+FLATTEN void inverse_spatial_avx512(float * data) {
+    Zmm block[32];
+
+    #pragma GCC unroll 32
+    for (int i = 0; i < 32; i++) {
+        block[i] = _mm512_loadu_ps(&data[i * 16]);
+    }
+
+    idft16_impl(block, 1);
+    transpose_32x16(block);
+    irdft16_impl(block);
+    // post_irdft<16>()
+    #pragma GCC unroll 7
+    for (int i = 1; i < 8; i++) {
+        std::swap(block[i], block[16 - i]);
+    }
+    transpose_16x16(block);
+
+    #pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) {
+        _mm512_storeu_ps(&data[i * 16], block[i].v);
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct MappedFile {
+    uint8_t * data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+// Maps `path` into memory, or returns an error message.
+//
+// A non-zero `size` creates (or truncates) the file with that size and maps
+// it for writing, otherwise the existing file is mapped read-only.
+static inline const char * map_file(MappedFile & file, const char * path, size_t size) {
+    file = {};
+    bool writable = size != 0;
+
+#ifdef _WIN32
+    file.file = CreateFileA(
+        path,
+        writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        writable ? CREATE_ALWAYS : OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (file.file == INVALID_HANDLE_VALUE) {
+        return "cannot open the spectrum cache";
+    }
+
+    if (!writable) {
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file.file, &file_size)) {
+            CloseHandle(file.file);
+            return "cannot open the spectrum cache";
+        }
+        size = static_cast<size_t>(file_size.QuadPart);
+    }
+
+    file.mapping = CreateFileMappingA(
+        file.file, nullptr,
+        writable ? PAGE_READWRITE : PAGE_READONLY,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+        static_cast<DWORD>(size & 0xFFFFFFFF),
+        nullptr
+    );
+    if (file.mapping == nullptr) {
+        CloseHandle(file.file);
+        return "cannot map the spectrum cache";
+    }
+
+    file.data = static_cast<uint8_t *>(MapViewOfFile(
+        file.mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size
+    ));
+    if (file.data == nullptr) {
+        CloseHandle(file.mapping);
+        CloseHandle(file.file);
+        return "cannot map the spectrum cache";
+    }
+#else
+    file.fd = open(path, writable ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+    if (file.fd < 0) {
+        return "cannot open the spectrum cache";
+    }
+
+    if (writable) {
+        if (ftruncate(file.fd, static_cast<off_t>(size)) != 0) {
+            close(file.fd);
+            return "cannot resize the spectrum cache";
+        }
+    } else {
+        struct stat st;
+        if (fstat(file.fd, &st) != 0) {
+            close(file.fd);
+            return "cannot open the spectrum cache";
+        }
+        size = static_cast<size_t>(st.st_size);
+    }
+
+    if (size == 0) {
+        close(file.fd);
+        return "the spectrum cache is empty";
+    }
+
+    void * data = mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file.fd, 0);
+    if (data == MAP_FAILED) {
+        close(file.fd);
+        return "cannot map the spectrum cache";
+    }
+    file.data = static_cast<uint8_t *>(data);
+#endif
+
+    file.size = size;
+    return nullptr;
+}
+
+static inline void unmap_file(MappedFile & file) {
+    if (file.data == nullptr) {
+        return ;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle(file.mapping);
+    CloseHandle(file.file);
+#else
+    munmap(file.data, file.size);
+    close(file.fd);
+#endif
+
+    file = {};
+}
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,194 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NUMA placement without libnuma.
+//
+// On a single-node machine (and on systems other than linux and windows),
+// `numa_num_nodes()` returns 1, `numa_current_node()` returns 0 and
+// `numa_alloc()` falls back to `std::malloc()`. Otherwise node ids are below
+// `numa_num_nodes()`, but may be sparse. All allocations are 64-byte aligned.
+
+static constexpr int numa_max_nodes = 1024;
+
+static inline int numa_num_nodes() {
+    static const int num_nodes = []() -> int {
+#ifdef _WIN32
+        ULONG highest;
+        if (!GetNumaHighestNodeNumber(&highest)) {
+            return 1;
+        }
+        return static_cast<int>(highest) + 1;
+#elif defined(__linux__)
+        // a list of ranges, e.g. "0-1", "0,2" or "0"
+        auto file = std::fopen("/sys/devices/system/node/online", "r");
+        if (file == nullptr) {
+            return 1;
+        }
+        int num_online = 0;
+        int highest = 0;
+        int first;
+        while (std::fscanf(file, "%d", &first) == 1) {
+            int last = first;
+            if (std::fscanf(file, "-%d", &last) != 1) {
+                last = first;
+            }
+            if (first < 0 || last < first || last >= numa_max_nodes) {
+                num_online = 0;
+                break;
+            }
+            num_online += last - first + 1;
+            highest = last > highest ? last : highest;
+            if (std::fgetc(file) != ',') {
+                break;
+            }
+        }
+        std::fclose(file);
+        // node ids may be sparse, so the pools are indexed up to the highest
+        if (num_online <= 1) {
+            return 1;
+        }
+        return highest + 1;
+#else
+        return 1;
+#endif
+    }();
+
+    return num_nodes;
+}
+
+// node of the processor running the calling thread
+static inline int numa_current_node() {
+    if (numa_num_nodes() == 1) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node;
+    if (!GetNumaProcessorNodeEx(&processor, &node)) {
+        return 0;
+    }
+    return static_cast<int>(node);
+#elif defined(__linux__)
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return 0;
+    }
+    return static_cast<int>(node) < numa_num_nodes() ? static_cast<int>(node) : 0;
+#else
+    return 0;
+#endif
+}
+
+// bookkeeping in front of every allocation
+struct NumaHeader {
+    void * base; // of the mapping or of the std::malloc() block
+    size_t size; // of the whole mapping, 0 if allocated by std::malloc()
+};
+
+static constexpr size_t numa_alignment = 64;
+
+// Allocates `size` bytes preferably on `node`. The pages are bound when the
+// memory is reserved, so they stay on `node` even if the first thread
+// touching them runs elsewhere. A negative `node` allocates normally.
+static inline void * numa_alloc(size_t size, int node) {
+    NumaHeader * header = nullptr;
+
+    if (node >= 0 && numa_num_nodes() > 1) {
+        // the data starts one alignment unit into the page aligned mapping
+        size_t total_size = numa_alignment + size;
+
+#ifdef _WIN32
+        header = static_cast<NumaHeader *>(VirtualAllocExNuma(
+            GetCurrentProcess(), nullptr, total_size,
+            MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
+            static_cast<DWORD>(node)
+        ));
+#elif defined(__linux__)
+        void * data = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data != MAP_FAILED) {
+            // MPOL_PREFERRED falls back to other nodes instead of failing
+            // when the node is full, errors only lose the placement
+            constexpr int mpol_preferred = 1;
+            constexpr int bits_per_word = 8 * sizeof(unsigned long);
+            unsigned long node_mask[numa_max_nodes / bits_per_word] {};
+            node_mask[node / bits_per_word] = 1UL << (node % bits_per_word);
+            syscall(SYS_mbind, data, total_size, mpol_preferred, node_mask, numa_max_nodes + 1, 0);
+
+            header = static_cast<NumaHeader *>(data);
+        }
+#endif
+
+        if (header != nullptr) {
+            auto data = reinterpret_cast<uint8_t *>(header) + numa_alignment;
+            header = reinterpret_cast<NumaHeader *>(data) - 1;
+            header->base = reinterpret_cast<uint8_t *>(data) - numa_alignment;
+            header->size = total_size;
+            return data;
+        }
+    }
+
+    auto base = std::malloc(sizeof(NumaHeader) + numa_alignment - 1 + size);
+    if (base == nullptr) {
+        return nullptr;
+    }
+    auto address = reinterpret_cast<uintptr_t>(base) + sizeof(NumaHeader);
+    auto data = reinterpret_cast<void *>((address + numa_alignment - 1) & ~(numa_alignment - 1));
+    header = static_cast<NumaHeader *>(data) - 1;
+    header->base = base;
+    header->size = 0;
+    return data;
+}
+
+static inline void numa_free(void * ptr) {
+    if (ptr == nullptr) {
+        return ;
+    }
+
+    auto header = static_cast<NumaHeader *>(ptr) - 1;
+    if (header->size == 0) {
+        std::free(header->base);
+        return ;
+    }
+
+#ifdef _WIN32
+    VirtualFree(header->base, 0, MEM_RELEASE);
+#elif defined(__linux__)
+    munmap(header->base, header->size);
+#endif
+}
+
+struct NumaDeleter {
+    void operator()(void * ptr) const {
+        numa_free(ptr);
+    }
+};
+
+// 64-byte aligned array, e.g. of padded planes
+template <typename T>
+using AlignedArray = std::unique_ptr<T [], NumaDeleter>;
+
+template <typename T>
+static inline AlignedArray<T> make_aligned_array(size_t size, int node = -1) {
+    return AlignedArray<T>(static_cast<T *>(numa_alloc(size * sizeof(T), node)));
+}
+
+#endif // NUMA_HPP
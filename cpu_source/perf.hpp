@@ -0,0 +1,261 @@
+#ifndef PERF_HPP
+#define PERF_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Optional hardware counter instrumentation of the filtering pipeline.
+//
+// The kernels report the end of each stage to a probe. `NoProbe` compiles
+// to nothing, while `PerfProbe` attributes the counts since the previous
+// stage boundary to the stage that just ended.
+
+enum PerfStage {
+    perf_padding,
+    perf_load_block,
+    perf_transform, // spatial and temporal forward dft
+    perf_filter, // mean removal and frequency filtering
+    perf_inverse, // temporal and spatial inverse dft
+    perf_store_block,
+    perf_store_frame,
+    perf_other, // per-plane setup, e.g. noise estimation
+    perf_num_stages
+};
+
+static constexpr const char * perf_stage_names[perf_num_stages] {
+    "Padding", "LoadBlock", "Transform", "Filter",
+    "Inverse", "StoreBlock", "StoreFrame", "Other"
+};
+
+enum PerfEvent {
+    perf_cycles,
+    perf_instructions,
+    perf_l1d_misses, // L1D read misses
+    perf_llc_misses, // last level cache read misses
+    perf_num_events
+};
+
+// user space counters of one thread, read in a single group
+struct PerfCounters {
+    int fds[perf_num_events]; // -1 if the event is not supported
+#ifdef __linux__
+    perf_event_mmap_page * pages[perf_num_events];
+#endif
+    int thread_index; // set by `get_thread_perf_counters()`
+};
+
+#ifdef __linux__
+static inline int perf_open_event(uint32_t type, uint64_t config, int group_fd) {
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    // the calling thread on any cpu
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+#endif
+
+static inline void close_perf_counters(PerfCounters & counters) {
+#ifdef __linux__
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (int i = perf_num_events - 1; i >= 0; i--) {
+        if (counters.pages[i] != nullptr) {
+            munmap(counters.pages[i], page_size);
+        }
+        if (counters.fds[i] >= 0) {
+            close(counters.fds[i]);
+        }
+    }
+#endif
+    counters = {};
+}
+
+// Opens the counters of the calling thread, returns an error message on
+// failure. Only the cycle counter is mandatory.
+static inline const char * open_perf_counters(PerfCounters & counters) {
+    counters = {};
+    for (auto & fd : counters.fds) {
+        fd = -1;
+    }
+
+#ifdef __linux__
+    constexpr uint64_t l1d_read_miss = (
+        PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    );
+    constexpr uint64_t llc_read_miss = (
+        PERF_COUNT_HW_CACHE_LL |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    );
+
+    counters.fds[perf_cycles] = perf_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (counters.fds[perf_cycles] < 0) {
+        return "cannot open the cycle counter, check /proc/sys/kernel/perf_event_paranoid";
+    }
+    int leader = counters.fds[perf_cycles];
+    counters.fds[perf_instructions] = perf_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader);
+    counters.fds[perf_l1d_misses] = perf_open_event(PERF_TYPE_HW_CACHE, l1d_read_miss, leader);
+    counters.fds[perf_llc_misses] = perf_open_event(PERF_TYPE_HW_CACHE, llc_read_miss, leader);
+
+    // user space reads through rdpmc
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (int i = 0; i < perf_num_events; i++) {
+        if (counters.fds[i] < 0) {
+            continue;
+        }
+        void * page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, counters.fds[i], 0);
+        if (page != MAP_FAILED) {
+            counters.pages[i] = static_cast<perf_event_mmap_page *>(page);
+        }
+    }
+
+    return nullptr;
+#else
+    return "hardware counters are only supported on linux";
+#endif
+}
+
+#ifdef __linux__
+static inline bool perf_read_user(const perf_event_mmap_page * page, uint64_t & value) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (page == nullptr) {
+        return false;
+    }
+
+    // seqlock protocol of perf_event_mmap_page
+    uint32_t seq;
+    uint64_t count;
+    do {
+        seq = page->lock;
+        std::atomic_signal_fence(std::memory_order::seq_cst);
+
+        uint32_t index = page->index;
+        if (!page->cap_user_rdpmc || index == 0) {
+            // not scheduled on the pmu right now
+            return false;
+        }
+
+        auto pmc = static_cast<int64_t>(__builtin_ia32_rdpmc(static_cast<int>(index - 1)));
+        int shift = 64 - page->pmc_width;
+        count = page->offset + static_cast<uint64_t>((pmc << shift) >> shift);
+
+        std::atomic_signal_fence(std::memory_order::seq_cst);
+    } while (page->lock != seq);
+
+    value = count;
+    return true;
+#else
+    return false;
+#endif
+}
+#endif
+
+// `values` of unsupported events are left unchanged
+static inline void read_perf_counters(const PerfCounters & counters, uint64_t values[perf_num_events]) {
+#ifdef __linux__
+    uint64_t temp[perf_num_events];
+    bool user_read = true;
+    for (int i = 0; i < perf_num_events && user_read; i++) {
+        if (counters.fds[i] >= 0) {
+            user_read = perf_read_user(counters.pages[i], temp[i]);
+        }
+    }
+
+    if (!user_read) {
+        // { nr, values[nr] } in the order the events were opened
+        uint64_t group[1 + perf_num_events];
+        if (read(counters.fds[perf_cycles], group, sizeof(group)) <= 0) {
+            return ;
+        }
+        for (int i = 0, j = 1; i < perf_num_events; i++) {
+            if (counters.fds[i] >= 0 && j <= static_cast<int>(group[0])) {
+                temp[i] = group[j++];
+            }
+        }
+    }
+
+    for (int i = 0; i < perf_num_events; i++) {
+        if (counters.fds[i] >= 0) {
+            values[i] = temp[i];
+        }
+    }
+#endif
+}
+
+// Returns the counters of the calling thread, opened on first use, or
+// nullptr if they are not available.
+static inline PerfCounters * get_thread_perf_counters() {
+    thread_local struct ThreadCounters {
+        PerfCounters counters;
+        bool opened;
+
+        ThreadCounters() {
+            static std::atomic<int> num_threads;
+
+            opened = open_perf_counters(counters) == nullptr;
+            if (opened) {
+                counters.thread_index = num_threads.fetch_add(1, std::memory_order::relaxed);
+            }
+        }
+
+        ~ThreadCounters() {
+            if (opened) {
+                close_perf_counters(counters);
+            }
+        }
+    } thread_counters;
+
+    return thread_counters.opened ? &thread_counters.counters : nullptr;
+}
+
+// counts of one frame request, per stage
+struct PerfSession {
+    const PerfCounters * counters;
+    uint64_t last[perf_num_events];
+    uint64_t stages[perf_num_stages][perf_num_events];
+};
+
+static inline void start_perf_session(PerfSession & session, const PerfCounters * counters) {
+    session = {};
+    session.counters = counters;
+    read_perf_counters(*counters, session.last);
+}
+
+// attributes the counts since the previous call to `stage`
+static inline void perf_mark(PerfSession & session, PerfStage stage) {
+    uint64_t now[perf_num_events];
+    std::copy_n(session.last, perf_num_events, now);
+    read_perf_counters(*session.counters, now);
+    for (int i = 0; i < perf_num_events; i++) {
+        session.stages[stage][i] += now[i] - session.last[i];
+        session.last[i] = now[i];
+    }
+}
+
+struct NoProbe {
+    void operator()(PerfStage) const {}
+};
+
+struct PerfProbe {
+    PerfSession * session;
+
+    void operator()(PerfStage stage) const {
+        perf_mark(*session, stage);
+    }
+};
+
+#endif // PERF_HPP
@@ -0,0 +1,862 @@
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core.hpp"
+#include "mapped_file.hpp"
+#include "numa.hpp"
+#include "plugin.hpp"
+
+// saturating, as `int64ToIntS()` of VSHelper
+static int int64_to_int(int64_t value) {
+    return static_cast<int>(std::clamp<int64_t>(value, INT_MIN, INT_MAX));
+}
+
+// returns an error message if the samples are not supported
+static const char * check_format(const PluginVideoInfo & vi) {
+    if (!vi.float_samples && vi.bytes_per_sample > 2) {
+        return "only 8-16 bit integer format input is supported";
+    }
+    if (vi.float_samples && vi.bits_per_sample != 32) {
+        return "only 32-bit float format input is supported";
+    }
+    return nullptr;
+}
+
+const char * parse_args(DFTTestInstance & d, DFTTestCoreArgs & args, const PluginArgs & in, const PluginVideoInfo & vi) {
+    if (auto error_message = check_format(vi); error_message) {
+        return error_message;
+    }
+
+    int error;
+
+    args.radius = int64_to_int(in.get_int("radius", 0, &error));
+    if (error) {
+        args.radius = 0;
+    }
+
+    args.block_size = int64_to_int(in.get_int("block_size", 0, &error));
+    if (error) {
+        args.block_size = 16;
+    }
+
+    args.block_step = int64_to_int(in.get_int("block_step", 0, &error));
+    if (error) {
+        args.block_step = args.block_size;
+    }
+
+    args.sparse_block_step = int64_to_int(in.get_int("sparse_block_step", 0, &error));
+    if (error) {
+        args.sparse_block_step = 0;
+    }
+
+    args.sparse_threshold = static_cast<float>(in.get_float("sparse_threshold", 0, &error));
+    if (error) {
+        args.sparse_threshold = 64.0f;
+    }
+
+    int num_planes_args = in.num_elements("planes");
+    d.process.fill(num_planes_args <= 0);
+    for (int i = 0; i < num_planes_args; ++i) {
+        int plane = static_cast<int>(in.get_int("planes", i, nullptr));
+
+        if (plane < 0 || plane >= vi.num_planes) {
+            return "plane index out of range";
+        }
+
+        if (d.process[plane]) {
+            return "plane specified twice";
+        }
+
+        d.process[plane] = true;
+    }
+
+    args.auto_sigma = !!in.get_int("auto_sigma", 0, &error);
+    if (error) {
+        args.auto_sigma = false;
+    }
+
+    args.lookahead = int64_to_int(in.get_int("lookahead", 0, &error));
+    if (error) {
+        args.lookahead = -1;
+    }
+
+    args.smode = int64_to_int(in.get_int("smode", 0, &error));
+    if (error) {
+        args.smode = 1;
+    }
+
+    args.downscale = !!in.get_int("downscale", 0, &error);
+    if (error) {
+        args.downscale = false;
+    }
+    if (args.downscale) {
+        if (!d.process[0] || (vi.num_planes > 1 && !(d.process[1] && d.process[2]))) {
+            return "\"downscale\" requires all planes to be processed";
+        }
+        if (vi.width % (4 << vi.subsampling_w) || vi.height % (4 << vi.subsampling_h)) {
+            return "\"downscale\" requires planes whose dimensions are multiples of 4";
+        }
+    }
+
+    args.recursive = static_cast<float>(in.get_float("recursive", 0, &error));
+    if (error) {
+        args.recursive = 0.0f;
+    }
+
+    args.exclude_borders = !!in.get_int("exclude_borders", 0, &error);
+    if (error) {
+        args.exclude_borders = false;
+    }
+
+    args.align = int64_to_int(in.get_int("align", 0, &error));
+    if (error) {
+        args.align = 0;
+    }
+
+    if (auto grain_path = in.get_data("grain_table", &error); !error) {
+        d.grain_path = grain_path;
+    }
+    d.grain_period = int64_to_int(in.get_int("grain_period", 0, &error));
+    if (error) {
+        d.grain_period = 0;
+    }
+    if (!d.grain_path.empty()) {
+        if (d.grain_period < 0) {
+            return "\"grain_period\" must be non-negative";
+        }
+        if (args.downscale) {
+            return "\"grain_table\" is not supported with \"downscale\"";
+        }
+        if (vi.fps_num <= 0 || vi.fps_den <= 0 || vi.num_frames <= 0) {
+            return "\"grain_table\" requires a known frame rate and length";
+        }
+        d.grain_frames.resize(vi.num_frames);
+    }
+
+    d.numa = !!in.get_int("numa", 0, &error);
+    if (error) {
+        d.numa = false;
+    }
+    // a no-op on single-node machines
+    d.numa = d.numa && numa_num_nodes() > 1;
+
+    d.perf = !!in.get_int("perf", 0, &error);
+    if (error) {
+        d.perf = false;
+    }
+
+    d.autotune = !!in.get_int("autotune", 0, &error);
+    if (error) {
+        d.autotune = false;
+    }
+    if (d.perf) {
+        // fails early if the counters are not accessible
+        PerfCounters counters;
+        if (auto error_message = open_perf_counters(counters); error_message) {
+            return error_message;
+        }
+        close_perf_counters(counters);
+    }
+
+    args.window = in.get_float_array("window", nullptr);
+    args.sigma = in.get_float_array("sigma", nullptr);
+    args.sigma2 = static_cast<float>(in.get_float("sigma2", 0, nullptr));
+    args.pmin = static_cast<float>(in.get_float("pmin", 0, nullptr));
+    args.pmax = static_cast<float>(in.get_float("pmax", 0, nullptr));
+
+    args.filter_type = static_cast<int>(in.get_int("filter_type", 0, nullptr));
+
+    args.zero_mean = !!in.get_int("zero_mean", 0, &error);
+    if (error) {
+        args.zero_mean = true;
+    }
+    args.window_freq = in.get_float_array("window_freq", &error);
+    if (error) {
+        args.window_freq = nullptr;
+    }
+
+    args.motion_threshold = static_cast<float>(in.get_float("motion_threshold", 0, &error));
+    if (error) {
+        args.motion_threshold = 0.0f;
+    }
+    if (in.num_elements("motion_window") > 0) {
+        if (in.num_elements("motion_window") != args.radius * args.radius * args.block_size * args.block_size) {
+            return "\"motion_window\" must have radius * radius * block_size * block_size values";
+        }
+        args.motion_window = in.get_float_array("motion_window", nullptr);
+    }
+
+    return nullptr;
+}
+
+// DFTTest instances by key, see `make_registry_key()`
+static std::mutex instance_registry_lock;
+static std::map<std::string, DFTTestInstance *> instance_registry;
+
+static void append_key(std::string & key, const void * data, size_t size) {
+    key.append(static_cast<const char *>(data), size);
+}
+
+std::string make_registry_key(
+    const void * core, const void * source,
+    const DFTTestInstance & d, const DFTTestCoreArgs & args, const PluginArgs & in
+) {
+
+    std::string key;
+    if (args.recursive > 0.0f) {
+        return key;
+    }
+
+    auto core_address = reinterpret_cast<uintptr_t>(core);
+    auto source_address = reinterpret_cast<uintptr_t>(source);
+    append_key(key, &core_address, sizeof(core_address));
+    append_key(key, &source_address, sizeof(source_address));
+    append_key(key, &args.radius, sizeof(args.radius));
+    append_key(key, &args.block_size, sizeof(args.block_size));
+    append_key(key, &args.block_step, sizeof(args.block_step));
+    append_key(key, &args.sigma2, sizeof(args.sigma2));
+    append_key(key, &args.pmin, sizeof(args.pmin));
+    append_key(key, &args.pmax, sizeof(args.pmax));
+    append_key(key, &args.filter_type, sizeof(args.filter_type));
+    append_key(key, &args.zero_mean, sizeof(args.zero_mean));
+    append_key(key, &args.sparse_block_step, sizeof(args.sparse_block_step));
+    append_key(key, &args.sparse_threshold, sizeof(args.sparse_threshold));
+    append_key(key, &args.auto_sigma, sizeof(args.auto_sigma));
+    append_key(key, &args.lookahead, sizeof(args.lookahead));
+    append_key(key, &args.smode, sizeof(args.smode));
+    append_key(key, &args.downscale, sizeof(args.downscale));
+    append_key(key, &args.recursive, sizeof(args.recursive));
+    append_key(key, &args.exclude_borders, sizeof(args.exclude_borders));
+    append_key(key, &args.align, sizeof(args.align));
+    append_key(key, d.grain_path.c_str(), d.grain_path.size() + 1);
+    append_key(key, &d.grain_period, sizeof(d.grain_period));
+    append_key(key, &args.motion_threshold, sizeof(args.motion_threshold));
+    append_key(key, d.process.data(), sizeof(d.process));
+    append_key(key, &d.numa, sizeof(d.numa));
+    append_key(key, &d.perf, sizeof(d.perf));
+    append_key(key, &d.autotune, sizeof(d.autotune));
+    for (auto name : { "window", "sigma", "window_freq", "motion_window" }) {
+        int size = std::max(in.num_elements(name), 0);
+        append_key(key, &size, sizeof(size));
+        if (size > 0) {
+            append_key(key, in.get_float_array(name, nullptr), size * sizeof(double));
+        }
+    }
+
+    return key;
+}
+
+DFTTestInstance * find_instance(const std::string & key) {
+    if (key.empty()) {
+        return nullptr;
+    }
+
+    std::lock_guard _ { instance_registry_lock };
+    if (auto iter = instance_registry.find(key); iter != instance_registry.end()) {
+        iter->second->num_instances.fetch_add(1, std::memory_order::relaxed);
+        return iter->second;
+    }
+    return nullptr;
+}
+
+const char * init_instance(DFTTestInstance & d, const DFTTestCoreArgs & args, const PluginVideoInfo & vi, int num_threads) {
+    if (auto error_message = init_core(d.core, args, vi.bits_per_sample); error_message) {
+        return error_message;
+    }
+
+    if (d.autotune) {
+        // the buffers are sized for the largest plane, which is also tuned for
+        autotune(d.core, vi.width, vi.height, vi.bits_per_sample);
+    }
+
+    d.recursive_frame = -1;
+    for (int plane = 0; plane < vi.num_planes && d.core.recursive > 0.0f; plane++) {
+        if (d.process[plane]) {
+            int width = plane ? vi.width >> vi.subsampling_w : vi.width;
+            int height = plane ? vi.height >> vi.subsampling_h : vi.height;
+            d.recursive_states[plane] = std::make_unique<float []>(spectrum_plane_size(width, height, d.core));
+        }
+    }
+
+    d.num_uninitialized_threads.store(num_threads, std::memory_order::relaxed);
+    d.thread_data.reserve(num_threads);
+    if (d.numa) {
+        d.node_pools = std::make_unique<DFTTestNodePool []>(numa_num_nodes());
+    }
+
+    return nullptr;
+}
+
+void register_instance(DFTTestInstance & d, std::string key) {
+    d.num_instances.store(1, std::memory_order::relaxed);
+    if (!key.empty()) {
+        std::lock_guard _ { instance_registry_lock };
+        if (instance_registry.emplace(key, &d).second) {
+            d.registry_key = std::move(key);
+        }
+    }
+}
+
+bool release_instance(DFTTestInstance & d) {
+    std::lock_guard _ { instance_registry_lock };
+    if (d.num_instances.fetch_sub(1, std::memory_order::relaxed) > 1) {
+        return false;
+    }
+    if (!d.registry_key.empty()) {
+        instance_registry.erase(d.registry_key);
+    }
+    return true;
+}
+
+// bytes of `DFTTestThreadData::padded`
+static size_t padded_size(const DFTTestCore & core, int width, int height, int bytes_per_sample) {
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    return static_cast<size_t>(2 * core.radius + 1) * pad_height * pad_stride * bytes_per_sample;
+}
+
+// bytes of `DFTTestThreadData::padded2`
+static size_t padded2_size(const DFTTestCore & core, int width, int height) {
+    int pad_height = calc_pad_size(height, core.block_size, core.block_step);
+    int pad_stride = calc_pad_stride(width, core.block_size, core.block_step);
+    return static_cast<size_t>(pad_height) * pad_stride * sizeof(float);
+}
+
+static DFTTestThreadData alloc_thread_data(
+    const DFTTestCore & core, int width, int height, int bytes_per_sample, int numa_node
+) {
+    DFTTestThreadData thread_data;
+    thread_data.padded = static_cast<uint8_t *>(numa_alloc(
+        padded_size(core, width, height, bytes_per_sample),
+        numa_node
+    ));
+    thread_data.padded2 = static_cast<float *>(numa_alloc(padded2_size(core, width, height), numa_node));
+    thread_data.workspace = alloc_workspace(core, width, height, numa_node);
+    return thread_data;
+}
+
+static void free_thread_data(DFTTestThreadData & thread_data) {
+    free_workspace(thread_data.workspace);
+    numa_free(thread_data.padded2);
+    numa_free(thread_data.padded);
+}
+
+DFTTestCheckout check_out_thread_data(DFTTestInstance & d, int width, int height, int bytes_per_sample) {
+    DFTTestCheckout checkout;
+    checkout.core = &d.core;
+    checkout.pool = nullptr;
+
+    auto thread_id = std::this_thread::get_id();
+    if (d.numa) {
+        int numa_node = numa_current_node();
+        auto pool = &d.node_pools[numa_node];
+
+        std::lock_guard _ { pool->lock };
+        if (!pool->core_initialized) {
+            copy_core(pool->core, d.core);
+            pool->core_initialized = true;
+        }
+        if (pool->thread_data.empty()) {
+            checkout.thread_data = alloc_thread_data(pool->core, width, height, bytes_per_sample, numa_node);
+        } else {
+            checkout.thread_data = pool->thread_data.back();
+            pool->thread_data.pop_back();
+        }
+        checkout.core = &pool->core;
+        checkout.pool = pool;
+    } else if (d.num_uninitialized_threads.load(std::memory_order::acquire) == 0) {
+        const auto & const_data = d.thread_data;
+        checkout.thread_data = const_data.at(thread_id);
+    } else {
+        bool initialized = true;
+
+        d.thread_data_lock.lock_shared();
+        try {
+            const auto & const_data = d.thread_data;
+            checkout.thread_data = const_data.at(thread_id);
+        } catch (const std::out_of_range &) {
+            initialized = false;
+        }
+        d.thread_data_lock.unlock_shared();
+
+        if (!initialized) {
+            checkout.thread_data = alloc_thread_data(d.core, width, height, bytes_per_sample, -1);
+
+            {
+                std::lock_guard _ { d.thread_data_lock };
+                d.thread_data.emplace(thread_id, checkout.thread_data);
+            }
+
+            d.num_uninitialized_threads.fetch_sub(1, std::memory_order::release);
+        }
+    }
+
+    return checkout;
+}
+
+void check_in_thread_data(const DFTTestCheckout & checkout) {
+    // the buffers of a thread stay with it otherwise
+    if (checkout.pool) {
+        std::lock_guard _ { checkout.pool->lock };
+        checkout.pool->thread_data.push_back(checkout.thread_data);
+    }
+}
+
+void free_instance_buffers(DFTTestInstance & d) {
+    for (auto & [_, thread_data] : d.thread_data) {
+        free_thread_data(thread_data);
+    }
+
+    if (d.numa) {
+        for (int i = 0; i < numa_num_nodes(); i++) {
+            for (auto & thread_data : d.node_pools[i].thread_data) {
+                free_thread_data(thread_data);
+            }
+        }
+    }
+}
+
+void add_frame_grain(DFTTestInstance & d, int n, const GrainStats * stats, int num_planes) {
+    std::lock_guard _ { d.grain_lock };
+    if (!d.grain_frames[n]) {
+        d.grain_frames[n] = true;
+
+        int segment = d.grain_period ? n / d.grain_period : 0;
+        auto & entry = d.grain_segments[segment];
+        for (int plane = 0; plane < num_planes; plane++) {
+            add_grain_stats(entry.planes[plane], stats[plane]);
+        }
+    }
+}
+
+const char * write_grain(DFTTestInstance & d, const PluginVideoInfo & vi) {
+    // in units of 1e-7 seconds
+    auto frame_time = [&vi](int n) -> int64_t {
+        return static_cast<int64_t>(n) * 10000000 * vi.fps_den / vi.fps_num;
+    };
+
+    std::vector<GrainSegment> segments;
+    for (auto & [segment, entry] : d.grain_segments) {
+        int start = d.grain_period ? segment * d.grain_period : 0;
+        int end = d.grain_period ? std::min(start + d.grain_period, vi.num_frames) : vi.num_frames;
+        entry.start_time = frame_time(start);
+        entry.end_time = frame_time(end);
+        segments.push_back(entry);
+    }
+
+    return write_grain_table(d.grain_path.c_str(), segments.data(), static_cast<int>(segments.size()));
+}
+
+static constexpr char spectrum_cache_magic[8] { 'D', 'F', 'T', '2', 'S', 'P', 'E', 'C' };
+static constexpr int spectrum_cache_version = 1;
+
+static uint64_t align_offset(uint64_t offset, uint64_t alignment = 4096) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+const char * init_export(DFTTestSpectrumCache & d, const PluginArgs & in, const PluginVideoInfo & vi) {
+    if (auto error_message = check_format(vi); error_message) {
+        return error_message;
+    }
+
+    int error;
+
+    DFTTestCoreArgs args;
+
+    args.radius = int64_to_int(in.get_int("radius", 0, &error));
+    if (error) {
+        args.radius = 0;
+    }
+
+    args.block_size = int64_to_int(in.get_int("block_size", 0, &error));
+    if (error) {
+        args.block_size = 16;
+    }
+
+    args.block_step = int64_to_int(in.get_int("block_step", 0, &error));
+    if (error) {
+        args.block_step = args.block_size;
+    }
+
+    int num_planes_args = in.num_elements("planes");
+    d.process.fill(num_planes_args <= 0);
+    for (int i = 0; i < num_planes_args; ++i) {
+        int plane = static_cast<int>(in.get_int("planes", i, nullptr));
+
+        if (plane < 0 || plane >= vi.num_planes) {
+            return "plane index out of range";
+        }
+
+        if (d.process[plane]) {
+            return "plane specified twice";
+        }
+
+        d.process[plane] = true;
+    }
+
+    d.half = !!in.get_int("half", 0, &error);
+    if (error) {
+        d.half = false;
+    }
+
+    if (in.num_elements("window") != (2 * args.radius + 1) * args.block_size * args.block_size) {
+        return "\"window\" must have (2 * radius + 1) * block_size * block_size values";
+    }
+    args.window = in.get_float_array("window", nullptr);
+
+    // only the window is used by the forward transforms
+    std::vector<double> sigma((2 * args.radius + 1) * args.block_size * (args.block_size / 2 + 1));
+    args.sigma = sigma.data();
+    args.sigma2 = 0.0f;
+    args.pmin = 0.0f;
+    args.pmax = 0.0f;
+    args.filter_type = 2;
+
+    args.zero_mean = !!in.get_int("zero_mean", 0, &error);
+    if (error) {
+        args.zero_mean = true;
+    }
+    args.window_freq = in.get_float_array("window_freq", &error);
+    if (error) {
+        args.window_freq = nullptr;
+    }
+
+    if (auto error_message = init_core(d.core, args, vi.bits_per_sample); error_message) {
+        return error_message;
+    }
+
+    if (auto error_message = get_slice_scales(d.slice_scales.data(), args.window, args.radius, args.block_size); error_message) {
+        return error_message;
+    }
+
+    int window_size = (2 * args.radius + 1) * args.block_size * args.block_size;
+    int window_freq_size = (2 * args.radius + 1) * args.block_size * (args.block_size / 2 + 1) * 2;
+
+    SpectrumCacheHeader header {};
+    std::memcpy(header.magic, spectrum_cache_magic, sizeof(header.magic));
+    header.version = spectrum_cache_version;
+    header.width = vi.width;
+    header.height = vi.height;
+    header.num_planes = vi.num_planes;
+    header.subsampling_w = vi.subsampling_w;
+    header.subsampling_h = vi.subsampling_h;
+    header.sample_type = vi.float_samples;
+    header.bits_per_sample = vi.bits_per_sample;
+    header.num_frames = vi.num_frames;
+    header.radius = args.radius;
+    header.block_size = args.block_size;
+    header.block_step = args.block_step;
+    header.zero_mean = args.zero_mean;
+    header.half = d.half;
+    header.window_offset = align_offset(sizeof(header), 64);
+    header.window_freq_offset = args.zero_mean ? align_offset(header.window_offset + window_size * sizeof(double), 64) : 0;
+    header.valid_offset = align_offset(
+        (args.zero_mean ? header.window_freq_offset + window_freq_size * sizeof(double) : header.window_offset + window_size * sizeof(double)),
+        64
+    );
+    header.frames_offset = align_offset(header.valid_offset + vi.num_frames);
+
+    uint64_t frame_size = 0;
+    for (int plane = 0; plane < vi.num_planes; plane++) {
+        if (!d.process[plane]) {
+            continue;
+        }
+
+        header.planes |= 1 << plane;
+        header.plane_offsets[plane] = frame_size;
+
+        int width = plane ? vi.width >> vi.subsampling_w : vi.width;
+        int height = plane ? vi.height >> vi.subsampling_h : vi.height;
+        frame_size += align_offset(
+            spectrum_plane_size(width, height, d.core) * (d.half ? sizeof(uint16_t) : sizeof(float))
+        );
+    }
+    header.frame_size = frame_size;
+
+    auto path = in.get_data("path", nullptr);
+    if (auto error_message = map_file(d.file, path, header.frames_offset + vi.num_frames * frame_size); error_message) {
+        return error_message;
+    }
+
+    std::memcpy(d.file.data, &header, sizeof(header));
+    std::memcpy(&d.file.data[header.window_offset], args.window, window_size * sizeof(double));
+    if (args.zero_mean) {
+        std::memcpy(&d.file.data[header.window_freq_offset], args.window_freq, window_freq_size * sizeof(double));
+    }
+
+    return nullptr;
+}
+
+const char * init_cached(DFTTestSpectrumCache & d, const PluginArgs & in, const PluginVideoInfo * vi) {
+    auto path = in.get_data("path", nullptr);
+    if (auto error_message = map_file(d.file, path, 0); error_message) {
+        return error_message;
+    }
+
+    SpectrumCacheHeader header;
+    if (d.file.size < sizeof(header)) {
+        return "invalid spectrum cache";
+    }
+    std::memcpy(&header, d.file.data, sizeof(header));
+    if (std::memcmp(header.magic, spectrum_cache_magic, sizeof(header.magic)) != 0 ||
+        header.version != spectrum_cache_version ||
+        d.file.size < header.frames_offset + header.num_frames * header.frame_size
+    ) {
+        return "invalid spectrum cache";
+    }
+
+    if (!vi ||
+        vi->width != header.width ||
+        vi->height != header.height ||
+        vi->num_frames != header.num_frames ||
+        vi->num_planes != header.num_planes ||
+        vi->subsampling_w != header.subsampling_w ||
+        vi->subsampling_h != header.subsampling_h ||
+        vi->float_samples != !!header.sample_type ||
+        vi->bits_per_sample != header.bits_per_sample
+    ) {
+        return "\"clip\" does not match the format of the spectrum cache";
+    }
+
+    int num_planes_args = in.num_elements("planes");
+    for (int plane = 0; plane < 3; plane++) {
+        d.process[plane] = num_planes_args <= 0 && (header.planes & (1 << plane));
+    }
+    for (int i = 0; i < num_planes_args; ++i) {
+        int plane = static_cast<int>(in.get_int("planes", i, nullptr));
+
+        if (plane < 0 || plane >= vi->num_planes) {
+            return "plane index out of range";
+        }
+
+        if (d.process[plane]) {
+            return "plane specified twice";
+        }
+
+        if (!(header.planes & (1 << plane))) {
+            return "plane is missing from the spectrum cache";
+        }
+
+        d.process[plane] = true;
+    }
+
+    d.half = header.half;
+
+    int radius = header.radius;
+    int block_size = header.block_size;
+
+    DFTTestCoreArgs args;
+    args.radius = radius;
+    args.block_size = block_size;
+    args.block_step = header.block_step;
+    args.window = reinterpret_cast<const double *>(&d.file.data[header.window_offset]);
+    args.zero_mean = header.zero_mean;
+    args.window_freq = header.zero_mean ? reinterpret_cast<const double *>(&d.file.data[header.window_freq_offset]) : nullptr;
+
+    int window_size = (2 * radius + 1) * block_size * block_size;
+    if (in.num_elements("window") > 0) {
+        auto window = in.get_float_array("window", nullptr);
+        if (in.num_elements("window") != window_size) {
+            return "\"window\" does not match the spectrum cache";
+        }
+        for (int i = 0; i < window_size; i++) {
+            if (std::abs(window[i] - args.window[i]) > 1e-9) {
+                return "\"window\" does not match the spectrum cache";
+            }
+        }
+    }
+
+    if (in.num_elements("sigma") != (2 * radius + 1) * block_size * (block_size / 2 + 1)) {
+        return "\"sigma\" does not match the radius and block size of the spectrum cache";
+    }
+    args.sigma = in.get_float_array("sigma", nullptr);
+    args.sigma2 = static_cast<float>(in.get_float("sigma2", 0, nullptr));
+    args.pmin = static_cast<float>(in.get_float("pmin", 0, nullptr));
+    args.pmax = static_cast<float>(in.get_float("pmax", 0, nullptr));
+    args.filter_type = static_cast<int>(in.get_int("filter_type", 0, nullptr));
+
+    if (auto error_message = init_core(d.core, args, header.bits_per_sample); error_message) {
+        return error_message;
+    }
+
+    if (auto error_message = get_slice_scales(d.slice_scales.data(), args.window, radius, block_size); error_message) {
+        return error_message;
+    }
+
+    return nullptr;
+}
+
+// Time per block of a configuration, measured once per process since the
+// measurement takes a few milliseconds.
+static double get_block_time(const DFTTestCore & core, int bits_per_sample) {
+    static std::mutex lock;
+    static std::map<std::array<int, 7>, double> block_times;
+
+    std::array<int, 7> key {
+        core.radius, core.block_step, core.filter_type, core.sparse_block_step,
+        core.auto_sigma, core.smode, bits_per_sample
+    };
+
+    std::lock_guard<std::mutex> guard { lock };
+    if (auto iter = block_times.find(key); iter != block_times.end()) {
+        return iter->second;
+    }
+    double block_time = measure_block_time(core, bits_per_sample);
+    block_times.emplace(key, block_time);
+    return block_time;
+}
+
+const char * estimate(DFTTestEstimate & result, const PluginArgs & in, const PluginVideoInfo & vi, int default_num_threads) {
+    if (auto error_message = check_format(vi); error_message) {
+        return error_message;
+    }
+
+    int error;
+
+    DFTTestCoreArgs args;
+
+    args.radius = int64_to_int(in.get_int("radius", 0, &error));
+    if (error) {
+        args.radius = 0;
+    }
+
+    args.block_size = int64_to_int(in.get_int("block_size", 0, &error));
+    if (error) {
+        args.block_size = 16;
+    }
+
+    args.block_step = int64_to_int(in.get_int("block_step", 0, &error));
+    if (error) {
+        args.block_step = args.block_size;
+    }
+
+    args.sparse_block_step = int64_to_int(in.get_int("sparse_block_step", 0, &error));
+    if (error) {
+        args.sparse_block_step = 0;
+    }
+
+    args.filter_type = int64_to_int(in.get_int("filter_type", 0, &error));
+    if (error) {
+        args.filter_type = 0;
+    }
+
+    args.auto_sigma = !!in.get_int("auto_sigma", 0, &error);
+    if (error) {
+        args.auto_sigma = false;
+    }
+
+    args.smode = int64_to_int(in.get_int("smode", 0, &error));
+    if (error) {
+        args.smode = 1;
+    }
+
+    result.num_threads = int64_to_int(in.get_int("threads", 0, &error));
+    if (error || result.num_threads <= 0) {
+        result.num_threads = default_num_threads;
+    }
+
+    if (args.radius < 0 || args.radius > 3) {
+        // checked by `init_core()` as well, but the tables are sized first
+        return "\"radius\" must be in [0, 1, 2, 3]";
+    }
+    if (args.block_size != 16) {
+        return "\"block_size\" must be 16";
+    }
+
+    // the values of the tables do not affect the sizes, and only affect
+    // the time per block through the number of dense tiles
+    int window_size = (2 * args.radius + 1) * args.block_size * args.block_size;
+    int sigma_size = (2 * args.radius + 1) * args.block_size * (args.block_size / 2 + 1);
+    auto window = std::make_unique<double []>(window_size);
+    auto sigma = std::make_unique<double []>(sigma_size);
+    auto window_freq = std::make_unique<double []>(sigma_size * 2);
+    std::fill_n(window.get(), window_size, 1.0 / std::sqrt(static_cast<double>(window_size)));
+    std::fill_n(sigma.get(), sigma_size, args.auto_sigma ? 1.0 : 64.0);
+    std::fill_n(window_freq.get(), sigma_size * 2, 0.0);
+    args.window = window.get();
+    args.sigma = sigma.get();
+    args.window_freq = window_freq.get();
+    args.sigma2 = args.auto_sigma ? 1.0f : 64.0f;
+    args.pmin = 0.0f;
+    args.pmax = 500.0f;
+
+    DFTTestCore filter_core;
+    if (auto error_message = init_core(filter_core, args, vi.bits_per_sample); error_message) {
+        return error_message;
+    }
+
+    // same arithmetic as `alloc_thread_data()`
+    result.thread_bytes = (
+        padded_size(filter_core, vi.width, vi.height, vi.bytes_per_sample) +
+        padded2_size(filter_core, vi.width, vi.height) +
+        workspace_size(filter_core, vi.width, vi.height)
+    );
+    result.table_bytes = core_table_size(filter_core);
+
+    result.blocks = {};
+    result.frame_blocks = 0;
+    for (int plane = 0; plane < vi.num_planes; plane++) {
+        int plane_width = plane == 0 ? vi.width : (vi.width >> vi.subsampling_w);
+        int plane_height = plane == 0 ? vi.height : (vi.height >> vi.subsampling_h);
+        if (filter_core.smode == 0) {
+            // one block per sample
+            result.blocks[plane] = static_cast<int64_t>(plane_height) * plane_width;
+        } else {
+            result.blocks[plane] = (
+                static_cast<int64_t>(calc_pad_num(plane_height, filter_core.block_size, filter_core.block_step)) *
+                calc_pad_num(plane_width, filter_core.block_size, filter_core.block_step)
+            );
+        }
+        result.frame_blocks += result.blocks[plane];
+    }
+
+    result.block_seconds = get_block_time(filter_core, vi.bits_per_sample);
+    result.frame_seconds = result.block_seconds * result.frame_blocks;
+
+    return nullptr;
+}
+
+const char * rdft(std::unique_ptr<std::complex<double> []> & output, int & output_size, const PluginArgs & in) {
+    int ndim = in.num_elements("shape");
+    if (ndim != 1 && ndim != 2 && ndim != 3) {
+        return "\"shape\" must be an array of ints with 1, 2 or 3 values";
+    }
+
+    std::array<int, 3> shape {};
+    for (int i = 0; i < ndim; i++) {
+        shape[i] = int64_to_int(in.get_int("shape", i, nullptr));
+    }
+
+    int size = 1;
+    for (int i = 0; i < ndim; i++) {
+        size *= shape[i];
+    }
+    if (in.num_elements("data") != size) {
+        return "cannot reshape array";
+    }
+
+    output_size = shape[ndim - 1] / 2 + 1;
+    for (int i = 0; i < ndim - 1; i++) {
+        output_size *= shape[i];
+    }
+
+    auto input = in.get_float_array("data", nullptr);
+
+    output = std::make_unique<std::complex<double> []>(output_size);
+
+    real_dft(output.get(), input, ndim, shape.data());
+
+    return nullptr;
+}
@@ -0,0 +1,222 @@
+#ifndef PLUGIN_HPP
+#define PLUGIN_HPP
+
+// Parts of the VapourSynth plugin that do not depend on the API version.
+//
+// source.cpp (API 3) and source_api4.cpp (API 4) only hold the glue: the
+// frame requests, the creation of the filters and the access to the maps.
+
+#include <array>
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "core.hpp"
+#include "mapped_file.hpp"
+
+// Arguments of a plugin function, read from the map of the API version.
+// `error` is set if the argument is missing, as by the VapourSynth API.
+struct PluginArgs {
+    std::function<int64_t (const char * key, int index, int * error)> get_int;
+    std::function<double (const char * key, int index, int * error)> get_float;
+    std::function<const double * (const char * key, int * error)> get_float_array;
+    std::function<const char * (const char * key, int * error)> get_data;
+    std::function<int (const char * key)> num_elements; // -1 if missing
+};
+
+// constant format of a clip
+struct PluginVideoInfo {
+    int width;
+    int height;
+    int num_frames;
+    int64_t fps_num;
+    int64_t fps_den;
+    int num_planes;
+    int subsampling_w;
+    int subsampling_h;
+    bool float_samples;
+    int bits_per_sample;
+    int bytes_per_sample;
+};
+
+struct DFTTestThreadData {
+    uint8_t * padded; // shape: (2 * radius + 1, pad_height, pad_stride)
+    float * padded2; // shape: (pad_height, pad_stride)
+    DFTTestWorkspace workspace;
+};
+
+// Buffers and tables of a NUMA node. A frame request checks out the buffers
+// of the node it is running on, since threads may migrate between requests.
+struct DFTTestNodePool {
+    std::mutex lock;
+    std::vector<DFTTestThreadData> thread_data; // not in use
+    DFTTestCore core; // copy of `DFTTestInstance::core` local to the node
+    bool core_initialized = false;
+};
+
+// state of a DFTTest instance, extended with the nodes and frames of the API
+struct DFTTestInstance {
+    std::array<bool, 3> process;
+    DFTTestCore core;
+    bool autotune;
+
+    std::atomic<int> num_uninitialized_threads;
+    std::unordered_map<std::thread::id, DFTTestThreadData> thread_data;
+    std::shared_mutex thread_data_lock;
+
+    // per-node pools replace `thread_data` on multi-node machines
+    bool numa;
+    std::unique_ptr<DFTTestNodePool []> node_pools;
+
+    // attach hardware counters to the frames
+    bool perf;
+
+    // Instances with the same source and parameters share this state, see
+    // `make_registry_key()`. While it is shared, the glue keeps the recent
+    // output frames so that each frame is filtered once for all of the
+    // instances.
+    std::string registry_key; // empty if not registered
+    std::atomic<int> num_instances; // guarded by the registry
+
+    // Recursive mode only. The filtered spectra of the processed planes of
+    // frame `recursive_frame`, -1 if there is none, which are the prior of
+    // frame `recursive_frame + 1` and are otherwise overwritten. The filter
+    // is serial and never shared between nodes in this mode.
+    std::array<std::unique_ptr<float []>, 3> recursive_states;
+    int recursive_frame;
+
+    // Film grain table only, written when the filter is freed. Entries
+    // cover `grain_period` frames, and frames filtered again after being
+    // evicted from the caches of VapourSynth are not counted twice.
+    std::string grain_path; // empty if disabled
+    int grain_period;
+    std::mutex grain_lock;
+    std::map<int, GrainSegment> grain_segments;
+    std::vector<bool> grain_frames;
+};
+
+// Reads the arguments of DFTTest into `d` and `args`, whose arrays point
+// into the map of `in`. Returns an error message on failure.
+const char * parse_args(DFTTestInstance & d, DFTTestCoreArgs & args, const PluginArgs & in, const PluginVideoInfo & vi);
+
+// Key of the instance registry: the core, the source and every argument, so
+// that wrappers calling DFTTest more than once with the same arguments on the
+// same clip do not repeat the work. Empty if the instance cannot be shared,
+// i.e. in the recursive mode, whose state follows the requests of a single
+// node.
+std::string make_registry_key(
+    const void * core, const void * source,
+    const DFTTestInstance & d, const DFTTestCoreArgs & args, const PluginArgs & in
+);
+
+// Returns the instance registered under `key` after counting one more node
+// on it, or nullptr.
+DFTTestInstance * find_instance(const std::string & key);
+
+// Initializes the core and the buffers of a new instance. Returns an error
+// message on failure.
+const char * init_instance(DFTTestInstance & d, const DFTTestCoreArgs & args, const PluginVideoInfo & vi, int num_threads);
+
+// Counts the first node on `d`, and registers it under `key` unless the key
+// is empty or already taken.
+void register_instance(DFTTestInstance & d, std::string key);
+
+// Counts one node less on `d`, and unregisters it after the last one.
+// Returns whether `d` is no longer used.
+bool release_instance(DFTTestInstance & d);
+
+// buffers checked out by a frame request, and the core of its NUMA node
+struct DFTTestCheckout {
+    DFTTestThreadData thread_data;
+    const DFTTestCore * core;
+    DFTTestNodePool * pool; // nullptr unless `DFTTestInstance::numa`
+};
+
+// `width` and `height` are those of the largest plane
+DFTTestCheckout check_out_thread_data(DFTTestInstance & d, int width, int height, int bytes_per_sample);
+
+void check_in_thread_data(const DFTTestCheckout & checkout);
+
+void free_instance_buffers(DFTTestInstance & d);
+
+// Adds the grain statistics of the planes of frame `n` to its entry, unless
+// the frame is already counted.
+void add_frame_grain(DFTTestInstance & d, int n, const GrainStats * stats, int num_planes);
+
+// Writes the film grain table, returns an error message on failure.
+const char * write_grain(DFTTestInstance & d, const PluginVideoInfo & vi);
+
+// layout of a spectrum cache file, in native byte order
+struct SpectrumCacheHeader {
+    char magic[8]; // "DFT2SPEC"
+    int32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t num_planes;
+    int32_t subsampling_w;
+    int32_t subsampling_h;
+    int32_t sample_type; // 0 for integer, 1 for float, as `VSSampleType`
+    int32_t bits_per_sample;
+    int32_t num_frames;
+    int32_t radius;
+    int32_t block_size;
+    int32_t block_step;
+    int32_t zero_mean;
+    int32_t half;
+    int32_t planes; // bitmask
+    uint64_t window_offset; // double, shape: (2 * radius + 1, block_size, block_size)
+    uint64_t window_freq_offset; // double, shape: (2 * radius + 1, block_size, block_size / 2 + 1, 2)
+    uint64_t valid_offset; // uint8_t, shape: (num_frames,)
+    uint64_t frames_offset;
+    uint64_t frame_size; // in bytes
+    uint64_t plane_offsets[3]; // in bytes, relative to a frame
+};
+
+// state of a DFTTestExport or DFTTestCached instance
+struct DFTTestSpectrumCache {
+    std::array<bool, 3> process;
+    DFTTestCore core;
+    bool half;
+    std::array<float, 7> slice_scales;
+    MappedFile file;
+};
+
+// Reads the arguments of DFTTestExport and maps the cache file with its
+// header and tables. Returns an error message on failure.
+const char * init_export(DFTTestSpectrumCache & d, const PluginArgs & in, const PluginVideoInfo & vi);
+
+// Maps and validates the cache file of DFTTestCached, then reads the other
+// arguments. `vi` is nullptr if the clip has no constant format. Returns an
+// error message on failure.
+const char * init_cached(DFTTestSpectrumCache & d, const PluginArgs & in, const PluginVideoInfo * vi);
+
+// results of Estimate
+struct DFTTestEstimate {
+    size_t thread_bytes;
+    size_t table_bytes;
+    int num_threads;
+    std::array<int64_t, 3> blocks;
+    int64_t frame_blocks;
+    double block_seconds;
+    double frame_seconds;
+};
+
+// Reads the arguments of Estimate other than the format, which is that of
+// `vi`. Returns an error message on failure.
+const char * estimate(DFTTestEstimate & result, const PluginArgs & in, const PluginVideoInfo & vi, int default_num_threads);
+
+// Reads the arguments of RDFT and computes the transform of `output_size`
+// complex values. Returns an error message on failure.
+const char * rdft(std::unique_ptr<std::complex<double> []> & output, int & output_size, const PluginArgs & in);
+
+#endif // PLUGIN_HPP
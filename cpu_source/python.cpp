@@ -0,0 +1,244 @@
+// Python extension running libdfttest2 on objects supporting the buffer
+// protocol, used by dfttest2.process()
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstring>
+
+#include "dfttest2.h"
+
+// releases the buffers on scope exit
+struct Buffer {
+    Py_buffer view {};
+
+    ~Buffer() {
+        if (view.obj) {
+            PyBuffer_Release(&view);
+        }
+    }
+};
+
+static int get_sample_type(const Py_buffer & view, int & bits_per_sample) {
+    const char * format = view.format ? view.format : "B";
+    if (format[0] == '@' || format[0] == '=' || format[0] == '<') {
+        format++;
+    }
+
+    if (std::strcmp(format, "B") == 0) {
+        bits_per_sample = 8;
+        return DFTTEST2_INTEGER;
+    } else if (std::strcmp(format, "H") == 0) {
+        bits_per_sample = 16;
+        return DFTTEST2_INTEGER;
+    } else if (std::strcmp(format, "f") == 0) {
+        bits_per_sample = 32;
+        return DFTTEST2_FLOAT;
+    }
+
+    return -1;
+}
+
+// Filters frames pushed from `src` into `dst`, which may be the same buffer.
+// The GIL is released while filtering.
+static int run(DFTTest2 * d, const Py_buffer & src, const Py_buffer & dst, int num_planes) {
+    auto num_frames = static_cast<int>(src.shape[0]);
+    int row_axis = src.ndim - 2;
+
+    auto get_planes = [&](const Py_buffer & view, int n, void * planes[3], ptrdiff_t strides[3]) {
+        auto frame = static_cast<char *>(view.buf) + n * view.strides[0];
+        for (int plane = 0; plane < num_planes; plane++) {
+            planes[plane] = view.ndim == 4 ? frame + plane * view.strides[1] : frame;
+            strides[plane] = view.strides[row_axis];
+        }
+    };
+
+    int ret = DFTTEST2_OK;
+    int num_pushed = 0;
+    int num_pulled = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    // a frame is only overwritten after the frames it depends on are pushed,
+    // which is what makes in-place processing possible
+    while (num_pulled < num_frames) {
+        if (num_pushed < num_frames) {
+            void * planes[3];
+            ptrdiff_t strides[3];
+            get_planes(src, num_pushed, planes, strides);
+
+            ret = dfttest2_push(d, planes, strides);
+            if (ret == DFTTEST2_OK) {
+                if (++num_pushed == num_frames) {
+                    dfttest2_finish(d);
+                }
+                continue;
+            } else if (ret != DFTTEST2_AGAIN) {
+                break;
+            }
+        }
+
+        void * planes[3];
+        ptrdiff_t strides[3];
+        get_planes(dst, num_pulled, planes, strides);
+
+        ret = dfttest2_pull(d, planes, strides, 1);
+        if (ret == DFTTEST2_OK) {
+            num_pulled++;
+        } else if (ret != DFTTEST2_AGAIN) {
+            break;
+        }
+    }
+
+    Py_END_ALLOW_THREADS
+
+    return num_pulled == num_frames ? DFTTEST2_OK : DFTTEST2_ERROR;
+}
+
+static PyObject * process(PyObject *, PyObject * args, PyObject * kwargs) {
+    static const char * keywords[] {
+        "src", "dst", "ftype", "sigma", "sigma_array", "sigma2", "pmin", "pmax",
+        "sbsize", "sosize", "tbsize", "swin", "twin", "sbeta", "tbeta",
+        "zmean", "f0beta", "planes", "flat_sosize", "flat_threshold",
+        "auto_sigma", "lookahead", "autotune", "smode", "motion_threshold", "recursive", "exclude_borders", "align", "bits", "num_threads", nullptr
+    };
+
+    DFTTest2Params params;
+    dfttest2_params_init(&params);
+
+    PyObject * src_object;
+    PyObject * dst_object;
+    PyObject * sigma_array_object = Py_None;
+    int bits = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "OO|ifOfffiiiiiffpfiiffipiffpiii", const_cast<char **>(keywords),
+        &src_object, &dst_object, &params.ftype, &params.sigma, &sigma_array_object,
+        &params.sigma2, &params.pmin, &params.pmax,
+        &params.sbsize, &params.sosize, &params.tbsize, &params.swin, &params.twin,
+        &params.sbeta, &params.tbeta, &params.zmean, &params.f0beta, &params.planes,
+        &params.flat_sosize, &params.flat_threshold,
+        &params.auto_sigma, &params.lookahead, &params.autotune, &params.smode,
+        &params.motion_threshold, &params.recursive, &params.exclude_borders, &params.align, &bits, &params.num_threads
+    )) {
+        return nullptr;
+    }
+
+    Buffer src, dst, sigma_array;
+    if (PyObject_GetBuffer(src_object, &src.view, PyBUF_RECORDS_RO) != 0) {
+        return nullptr;
+    }
+    if (PyObject_GetBuffer(dst_object, &dst.view, PyBUF_RECORDS) != 0) {
+        return nullptr;
+    }
+
+    if (src.view.ndim != 3 && src.view.ndim != 4) {
+        PyErr_SetString(PyExc_ValueError, "the shape must be (T, H, W) or (T, C, H, W)");
+        return nullptr;
+    }
+    if (dst.view.ndim != src.view.ndim ||
+        std::memcmp(dst.view.shape, src.view.shape, src.view.ndim * sizeof(Py_ssize_t)) != 0
+    ) {
+        PyErr_SetString(PyExc_ValueError, "the output must have the same shape as the input");
+        return nullptr;
+    }
+
+    DFTTest2Format format {};
+    int bits_per_sample;
+    format.sample_type = get_sample_type(src.view, bits_per_sample);
+    if (format.sample_type < 0) {
+        PyErr_SetString(PyExc_TypeError, "only uint8, uint16 and float32 input is supported");
+        return nullptr;
+    }
+    int dst_bits_per_sample;
+    if (get_sample_type(dst.view, dst_bits_per_sample) != format.sample_type ||
+        dst_bits_per_sample != bits_per_sample
+    ) {
+        PyErr_SetString(PyExc_TypeError, "the output must have the same dtype as the input");
+        return nullptr;
+    }
+
+    if (bits != 0) {
+        if (format.sample_type != DFTTEST2_INTEGER || bits > bits_per_sample || bits <= bits_per_sample - 8) {
+            PyErr_SetString(PyExc_ValueError, "\"bits\" does not match the dtype");
+            return nullptr;
+        }
+        bits_per_sample = bits;
+    }
+    format.bits_per_sample = bits_per_sample;
+
+    int ndim = src.view.ndim;
+    format.num_planes = ndim == 4 ? static_cast<int>(src.view.shape[1]) : 1;
+    format.height = static_cast<int>(src.view.shape[ndim - 2]);
+    format.width = static_cast<int>(src.view.shape[ndim - 1]);
+    if (format.num_planes < 1 || format.num_planes > 3) {
+        PyErr_SetString(PyExc_ValueError, "the number of channels must be 1, 2 or 3");
+        return nullptr;
+    }
+    if (src.view.shape[0] == 0) {
+        Py_RETURN_NONE;
+    }
+    if (src.view.strides[ndim - 1] != src.view.itemsize || dst.view.strides[ndim - 1] != dst.view.itemsize) {
+        PyErr_SetString(PyExc_ValueError, "the rows must be contiguous");
+        return nullptr;
+    }
+
+    if (format.num_planes == 1) {
+        params.planes &= 1;
+    }
+
+    if (sigma_array_object != Py_None) {
+        if (PyObject_GetBuffer(sigma_array_object, &sigma_array.view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+            return nullptr;
+        }
+
+        int sigma_bits;
+        auto expected = static_cast<Py_ssize_t>(params.tbsize) * params.sbsize * (params.sbsize / 2 + 1);
+        if (get_sample_type(sigma_array.view, sigma_bits) != DFTTEST2_FLOAT ||
+            sigma_array.view.len != expected * static_cast<Py_ssize_t>(sizeof(float))
+        ) {
+            PyErr_SetString(PyExc_ValueError, "\"sigma_array\" must hold tbsize * sbsize * (sbsize // 2 + 1) float32");
+            return nullptr;
+        }
+        params.sigma_array = static_cast<const float *>(sigma_array.view.buf);
+    }
+
+    char error[256];
+    auto d = dfttest2_create(&params, &format, error, sizeof error);
+    if (d == nullptr) {
+        PyErr_SetString(PyExc_ValueError, error);
+        return nullptr;
+    }
+
+    int ret = run(d, src.view, dst.view, format.num_planes);
+    dfttest2_free(d);
+
+    if (ret != DFTTEST2_OK) {
+        PyErr_SetString(PyExc_RuntimeError, "filtering failed");
+        return nullptr;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject * version(PyObject *, PyObject *) {
+    return PyUnicode_FromString(dfttest2_version());
+}
+
+static PyMethodDef methods[] {
+    { "process", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(process)), METH_VARARGS | METH_KEYWORDS, nullptr },
+    { "version", version, METH_NOARGS, nullptr },
+    { nullptr, nullptr, 0, nullptr }
+};
+
+static PyModuleDef module {
+    PyModuleDef_HEAD_INIT,
+    "_dfttest2",
+    nullptr,
+    -1,
+    methods
+};
+
+PyMODINIT_FUNC PyInit__dfttest2() {
+    return PyModule_Create(&module);
+}
@@ -0,0 +1,554 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "dfttest2_shm.h"
+
+static constexpr uint64_t shm_magic = 0x4D48533254464444; // "DDFT2SHM"
+static constexpr uint32_t shm_version = 1;
+
+struct ShmSlot {
+    int64_t frame; // index of the frame in the slot, or -1
+    int32_t refs; // number of consumers that have not released the frame
+    int32_t padding;
+};
+
+struct ShmConsumer {
+    int32_t pid;
+    int32_t state; // one of the values below
+    int64_t next; // next frame to be acquired
+};
+
+enum { consumer_free = 0, consumer_attached = 1, consumer_detached = 2 };
+
+// followed by `num_slots` ShmSlot, `num_consumers` ShmConsumer and the
+// bitmaps of the slots held by each consumer, then by the slots themselves
+struct ShmHeader {
+    uint64_t magic; // written last by the server
+    uint32_t version;
+    int32_t num_slots;
+    int32_t num_consumers;
+    DFTTest2Format format;
+    uint64_t plane_offsets[3];
+    int64_t strides[3];
+    uint64_t slot_size;
+    uint64_t held_words; // per consumer
+    uint64_t slots_offset;
+    uint64_t size;
+    char tag[1024];
+
+    // A process-shared condition variable cannot be used since a waiter
+    // killed by a signal may block the other processes, so waiters poll a
+    // counter that is incremented on each change, using a futex on linux.
+    pthread_mutex_t mutex; // robust
+    uint32_t sequence;
+    int64_t num_written;
+    int32_t finished;
+    int32_t num_detached;
+    int32_t server_pid;
+};
+
+struct DFTTest2Shm {
+    ShmHeader * header;
+    size_t size;
+    std::string name;
+    bool owner;
+    int64_t next; // next frame to be written or acquired
+    bool reserved; // whether the server holds the slot of `next`
+    int consumer; // index of the consumer
+};
+
+static ShmSlot * get_slots(ShmHeader * header) {
+    return reinterpret_cast<ShmSlot *>(header + 1);
+}
+
+static ShmConsumer * get_consumers(ShmHeader * header) {
+    return reinterpret_cast<ShmConsumer *>(get_slots(header) + header->num_slots);
+}
+
+static uint64_t * get_held(ShmHeader * header, int consumer) {
+    auto held = reinterpret_cast<uint64_t *>(get_consumers(header) + header->num_consumers);
+    return held + consumer * header->held_words;
+}
+
+static bool is_held(const uint64_t * held, int slot) {
+    return (held[slot / 64] >> (slot % 64)) & 1;
+}
+
+static bool is_alive(int32_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+static void lock(ShmHeader * header) {
+    if (pthread_mutex_lock(&header->mutex) == EOWNERDEAD) {
+        // a process exited while holding the mutex
+        pthread_mutex_consistent(&header->mutex);
+    }
+}
+
+static void unlock(ShmHeader * header) {
+    pthread_mutex_unlock(&header->mutex);
+}
+
+// wakes up the waiters. The mutex must be held.
+static void notify_locked(ShmHeader * header) {
+    __atomic_add_fetch(&header->sequence, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+    syscall(SYS_futex, &header->sequence, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+// Drops the references of a consumer to the published frames, which it will
+// not read anymore. The mutex must be held.
+static void detach_locked(ShmHeader * header, int consumer) {
+    auto slots = get_slots(header);
+    auto & state = get_consumers(header)[consumer];
+    auto held = get_held(header, consumer);
+
+    for (int i = 0; i < header->num_slots; i++) {
+        if (is_held(held, i) || (slots[i].frame >= state.next && slots[i].refs > 0)) {
+            slots[i].refs--;
+        }
+    }
+    std::memset(held, 0, header->held_words * sizeof(uint64_t));
+
+    state.state = consumer_detached;
+    header->num_detached++;
+    notify_locked(header);
+}
+
+// Waits for a change of the ring for a limited time, after which consumers
+// that exited without detaching are detached. The mutex must be held.
+static void wait_locked(ShmHeader * header) {
+    uint32_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+    unlock(header);
+
+#ifdef __linux__
+    timespec timeout { 0, 100'000'000 };
+    syscall(SYS_futex, &header->sequence, FUTEX_WAIT, sequence, &timeout, nullptr, 0);
+#else
+    for (int i = 0; i < 100 && __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE) == sequence; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#endif
+
+    lock(header);
+    if (__atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE) == sequence) {
+        auto consumers = get_consumers(header);
+        for (int i = 0; i < header->num_consumers; i++) {
+            if (consumers[i].state == consumer_attached && !is_alive(consumers[i].pid)) {
+                detach_locked(header, i);
+            }
+        }
+    }
+}
+
+static uint8_t * get_slot_data(ShmHeader * header, int slot) {
+    return reinterpret_cast<uint8_t *>(header) + header->slots_offset + slot * header->slot_size;
+}
+
+static uint64_t align_up(uint64_t x, uint64_t alignment) {
+    return (x + alignment - 1) / alignment * alignment;
+}
+
+static void fill_planes(ShmHeader * header, int slot, void * planes[], ptrdiff_t strides[]) {
+    auto data = get_slot_data(header, slot);
+    for (int plane = 0; plane < header->format.num_planes; plane++) {
+        planes[plane] = data + header->plane_offsets[plane];
+        strides[plane] = static_cast<ptrdiff_t>(header->strides[plane]);
+    }
+}
+
+static void set_error(char * error, size_t error_size, const char * error_message) {
+    if (error && error_size) {
+        std::snprintf(error, error_size, "%s", error_message);
+    }
+}
+
+DFTTest2Shm * dfttest2_shm_create(
+    const char * name,
+    const DFTTest2Format * format,
+    int num_slots,
+    int num_consumers,
+    const char * tag,
+    char * error, size_t error_size
+) {
+
+    if (num_slots < 1) {
+        set_error(error, error_size, "\"num_slots\" must be positive");
+        return nullptr;
+    }
+    if (num_consumers < 1) {
+        set_error(error, error_size, "\"num_consumers\" must be positive");
+        return nullptr;
+    }
+    if (format->num_planes < 1 || format->num_planes > 3) {
+        set_error(error, error_size, "invalid number of planes");
+        return nullptr;
+    }
+    if (tag && std::strlen(tag) >= sizeof(ShmHeader::tag)) {
+        set_error(error, error_size, "\"tag\" is too long");
+        return nullptr;
+    }
+
+    int bytes_per_sample = (format->bits_per_sample + 7) / 8;
+
+    uint64_t plane_offsets[3] {};
+    int64_t strides[3] {};
+    uint64_t slot_size = 0;
+    for (int plane = 0; plane < format->num_planes; plane++) {
+        int width = plane ? format->width >> format->subsampling_w : format->width;
+        int height = plane ? format->height >> format->subsampling_h : format->height;
+        plane_offsets[plane] = slot_size;
+        strides[plane] = static_cast<int64_t>(align_up(static_cast<uint64_t>(width) * bytes_per_sample, 64));
+        slot_size += strides[plane] * height;
+    }
+    slot_size = align_up(slot_size, 4096);
+
+    uint64_t held_words = (num_slots + 63) / 64;
+    uint64_t slots_offset = align_up(
+        sizeof(ShmHeader) +
+        num_slots * sizeof(ShmSlot) +
+        num_consumers * (sizeof(ShmConsumer) + held_words * sizeof(uint64_t)),
+        4096
+    );
+    uint64_t size = slots_offset + num_slots * slot_size;
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        set_error(error, error_size, "cannot create the shared memory object");
+        return nullptr;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        set_error(error, error_size, "cannot resize the shared memory object");
+        return nullptr;
+    }
+    void * data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name);
+        set_error(error, error_size, "cannot map the shared memory object");
+        return nullptr;
+    }
+
+    auto header = static_cast<ShmHeader *>(data);
+    header->version = shm_version;
+    header->num_slots = num_slots;
+    header->num_consumers = num_consumers;
+    header->format = *format;
+    std::memcpy(header->plane_offsets, plane_offsets, sizeof plane_offsets);
+    std::memcpy(header->strides, strides, sizeof strides);
+    header->slot_size = slot_size;
+    header->held_words = held_words;
+    header->slots_offset = slots_offset;
+    header->size = size;
+    if (tag) {
+        std::snprintf(header->tag, sizeof header->tag, "%s", tag);
+    }
+    header->server_pid = static_cast<int32_t>(getpid());
+
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+
+    auto slots = get_slots(header);
+    for (int i = 0; i < num_slots; i++) {
+        slots[i].frame = -1;
+        slots[i].refs = 0;
+    }
+    // the rest of the object is zero-initialized by ftruncate()
+
+    __atomic_store_n(&header->magic, shm_magic, __ATOMIC_RELEASE);
+
+    auto shm = std::make_unique<DFTTest2Shm>();
+    shm->header = header;
+    shm->size = size;
+    shm->name = name;
+    shm->owner = true;
+    shm->next = 0;
+    shm->reserved = false;
+    shm->consumer = -1;
+    return shm.release();
+}
+
+int dfttest2_shm_begin_write(
+    DFTTest2Shm * shm,
+    void * planes[],
+    ptrdiff_t strides[],
+    int wait
+) {
+
+    if (!shm->owner) {
+        return DFTTEST2_ERROR;
+    }
+
+    auto header = shm->header;
+    int slot = static_cast<int>(shm->next % header->num_slots);
+
+    if (!shm->reserved) {
+        auto & state = get_slots(header)[slot];
+
+        lock(header);
+        while (state.refs > 0) {
+            if (!wait) {
+                unlock(header);
+                return DFTTEST2_AGAIN;
+            }
+            wait_locked(header);
+        }
+        unlock(header);
+
+        shm->reserved = true;
+    }
+
+    fill_planes(header, slot, planes, strides);
+    return DFTTEST2_OK;
+}
+
+int dfttest2_shm_end_write(DFTTest2Shm * shm) {
+    if (!shm->owner || !shm->reserved) {
+        return DFTTEST2_ERROR;
+    }
+
+    auto header = shm->header;
+    auto & state = get_slots(header)[shm->next % header->num_slots];
+
+    lock(header);
+    state.frame = shm->next;
+    state.refs = header->num_consumers - header->num_detached;
+    header->num_written = shm->next + 1;
+    notify_locked(header);
+    unlock(header);
+
+    shm->next++;
+    shm->reserved = false;
+    return DFTTEST2_OK;
+}
+
+int dfttest2_shm_finish(DFTTest2Shm * shm) {
+    if (!shm->owner) {
+        return DFTTEST2_ERROR;
+    }
+
+    auto header = shm->header;
+
+    lock(header);
+    header->finished = 1;
+    notify_locked(header);
+    unlock(header);
+
+    return DFTTEST2_OK;
+}
+
+DFTTest2Shm * dfttest2_shm_attach(
+    const char * name,
+    char * error, size_t error_size
+) {
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        set_error(error, error_size, "cannot open the shared memory object");
+        return nullptr;
+    }
+
+    // the server initializes the header after sizing the object
+    struct stat st;
+    uint64_t magic = 0;
+    void * data = MAP_FAILED;
+    for (int retry = 0; retry < 100; retry++) {
+        if (fstat(fd, &st) != 0) {
+            break;
+        }
+        if (static_cast<size_t>(st.st_size) >= sizeof(ShmHeader)) {
+            data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                break;
+            }
+            magic = __atomic_load_n(&static_cast<ShmHeader *>(data)->magic, __ATOMIC_ACQUIRE);
+            if (magic == shm_magic) {
+                break;
+            }
+            munmap(data, static_cast<size_t>(st.st_size));
+            data = MAP_FAILED;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        set_error(error, error_size, "the shared memory object is not a frame ring");
+        return nullptr;
+    }
+
+    auto header = static_cast<ShmHeader *>(data);
+    size_t size = static_cast<size_t>(st.st_size);
+    if (header->version != shm_version || header->size != size) {
+        munmap(data, size);
+        set_error(error, error_size, "unsupported frame ring version");
+        return nullptr;
+    }
+
+    int consumer = -1;
+
+    lock(header);
+    auto consumers = get_consumers(header);
+    for (int i = 0; i < header->num_consumers; i++) {
+        if (consumers[i].state == consumer_free) {
+            consumer = i;
+            consumers[i].pid = static_cast<int32_t>(getpid());
+            consumers[i].state = consumer_attached;
+            consumers[i].next = 0;
+            break;
+        }
+    }
+    unlock(header);
+
+    if (consumer < 0) {
+        munmap(data, size);
+        set_error(error, error_size, "all consumers of the frame ring have attached");
+        return nullptr;
+    }
+
+    auto shm = std::make_unique<DFTTest2Shm>();
+    shm->header = header;
+    shm->size = size;
+    shm->name = name;
+    shm->owner = false;
+    shm->next = 0;
+    shm->reserved = false;
+    shm->consumer = consumer;
+    return shm.release();
+}
+
+void dfttest2_shm_get_format(const DFTTest2Shm * shm, DFTTest2Format * format) {
+    *format = shm->header->format;
+}
+
+const char * dfttest2_shm_get_tag(const DFTTest2Shm * shm) {
+    return shm->header->tag;
+}
+
+int dfttest2_shm_acquire(DFTTest2Shm * shm, DFTTest2ShmFrame * frame, int wait) {
+    if (shm->owner) {
+        return DFTTEST2_ERROR;
+    }
+
+    auto header = shm->header;
+    int slot = static_cast<int>(shm->next % header->num_slots);
+    auto & state = get_slots(header)[slot];
+    auto held = get_held(header, shm->consumer);
+
+    lock(header);
+    while (state.frame != shm->next) {
+        if (header->finished && header->num_written <= shm->next) {
+            unlock(header);
+            return DFTTEST2_EOF;
+        }
+        if (!header->finished && !is_alive(header->server_pid)) {
+            unlock(header);
+            return DFTTEST2_ERROR;
+        }
+        if (!wait) {
+            unlock(header);
+            return DFTTEST2_AGAIN;
+        }
+        wait_locked(header);
+    }
+    held[slot / 64] |= uint64_t { 1 } << (slot % 64);
+    get_consumers(header)[shm->consumer].next = shm->next + 1;
+    unlock(header);
+
+    void * planes[3] {};
+    frame->index = shm->next;
+    frame->slot = slot;
+    fill_planes(header, slot, planes, frame->strides);
+    for (int plane = 0; plane < 3; plane++) {
+        frame->planes[plane] = planes[plane];
+    }
+
+    shm->next++;
+    return DFTTEST2_OK;
+}
+
+int dfttest2_shm_release(DFTTest2Shm * shm, const DFTTest2ShmFrame * frame) {
+    if (shm->owner || frame->slot < 0 || frame->slot >= shm->header->num_slots) {
+        return DFTTEST2_ERROR;
+    }
+
+    auto header = shm->header;
+    auto & state = get_slots(header)[frame->slot];
+    auto held = get_held(header, shm->consumer);
+
+    lock(header);
+    if (state.frame != frame->index || !is_held(held, frame->slot)) {
+        unlock(header);
+        return DFTTEST2_ERROR;
+    }
+    held[frame->slot / 64] &= ~(uint64_t { 1 } << (frame->slot % 64));
+    if (--state.refs == 0) {
+        notify_locked(header);
+    }
+    unlock(header);
+
+    return DFTTEST2_OK;
+}
+
+void dfttest2_shm_close(DFTTest2Shm * shm) {
+    if (shm == nullptr) {
+        return ;
+    }
+
+    auto header = shm->header;
+    auto slots = get_slots(header);
+
+    lock(header);
+    if (shm->owner) {
+        header->finished = 1;
+        notify_locked(header);
+
+        auto busy = [&] {
+            for (int i = 0; i < header->num_slots; i++) {
+                if (slots[i].refs > 0) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        while (busy()) {
+            wait_locked(header);
+        }
+    } else {
+        detach_locked(header, shm->consumer);
+    }
+    unlock(header);
+
+    munmap(header, shm->size);
+    if (shm->owner) {
+        shm_unlink(shm->name.c_str());
+    }
+
+    delete shm;
+}
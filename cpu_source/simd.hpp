@@ -0,0 +1,613 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// The kernels are written against the vector class library (VCL) v2, which
+// only targets x86. With DFTTEST2_PORTABLE defined, the part of its interface
+// that the kernels use is implemented below on top of the vector extensions
+// of GCC and Clang, and the compiler lowers every vector to whatever the
+// target flags provide (SSE2, AVX2, AVX-512, NEON, ...). With DFTTEST2_SCALAR
+// as well, or on other compilers, each operation is a plain loop over lanes.
+//
+// Only the semantics that the kernels rely on are kept: integer arithmetic
+// wraps, comparisons return per-lane masks and shuffle indices below zero give
+// zero lanes.
+
+#ifndef DFTTEST2_PORTABLE
+
+#include <vectorclass.h>
+#include <vectormath_exp.h>
+
+#else // DFTTEST2_PORTABLE
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#endif
+
+// none of the x86 specific paths of the kernels are taken
+#define INSTRSET 0
+
+#if !defined(DFTTEST2_SCALAR) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_VECTOR_EXTENSIONS 1
+#else
+#define SIMD_VECTOR_EXTENSIONS 0
+#endif
+
+#ifdef __has_builtin
+#define SIMD_HAS_BUILTIN(x) __has_builtin(x)
+#else
+#define SIMD_HAS_BUILTIN(x) 0
+#endif
+
+// the alignment of the VCL types on AVX2, which the buffers of the filter
+// are allocated for
+#define SIMD_ALIGNMENT(bytes) ((bytes) < 32 ? (bytes) : 32)
+
+template <typename T>
+using simd_lane_int = std::conditional_t<sizeof(T) == 1, int8_t,
+                      std::conditional_t<sizeof(T) == 2, int16_t,
+                      std::conditional_t<sizeof(T) == 4, int32_t, int64_t>>>;
+
+template <typename T, int N>
+struct Vec;
+
+// per-lane result of a comparison of Vec<T, N>
+template <typename T, int N>
+struct Mask {
+    using I = simd_lane_int<T>;
+#if SIMD_VECTOR_EXTENSIONS
+    // all bits set in true lanes
+    typedef I native __attribute__((vector_size(sizeof(I) * N), aligned(SIMD_ALIGNMENT(sizeof(I) * N))));
+    native m;
+#else
+    bool m[N];
+#endif
+
+    bool extract(int i) const {
+        return m[i] != 0;
+    }
+
+    bool operator[](int i) const {
+        return extract(i);
+    }
+
+#if SIMD_VECTOR_EXTENSIONS
+#define SIMD_MASK_BINARY(op, lane_op) \
+    friend Mask operator op(Mask a, Mask b) { \
+        Mask r; \
+        r.m = a.m lane_op b.m; \
+        return r; \
+    }
+#else
+#define SIMD_MASK_BINARY(op, lane_op) \
+    friend Mask operator op(Mask a, Mask b) { \
+        Mask r; \
+        for (int i = 0; i < N; i++) { \
+            r.m[i] = a.m[i] op b.m[i]; \
+        } \
+        return r; \
+    }
+#endif
+    SIMD_MASK_BINARY(&&, &)
+    SIMD_MASK_BINARY(||, |)
+    SIMD_MASK_BINARY(&, &)
+    SIMD_MASK_BINARY(|, |)
+#undef SIMD_MASK_BINARY
+
+    friend Mask operator!(Mask a) {
+        Mask r;
+#if SIMD_VECTOR_EXTENSIONS
+        r.m = ~a.m;
+#else
+        for (int i = 0; i < N; i++) {
+            r.m[i] = !a.m[i];
+        }
+#endif
+        return r;
+    }
+
+    friend bool horizontal_or(Mask a) {
+        for (int i = 0; i < N; i++) {
+            if (a.extract(i)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    friend bool horizontal_and(Mask a) {
+        for (int i = 0; i < N; i++) {
+            if (!a.extract(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename T, int N>
+struct Vec {
+#if SIMD_VECTOR_EXTENSIONS
+    typedef T native __attribute__((vector_size(sizeof(T) * N), aligned(SIMD_ALIGNMENT(sizeof(T) * N))));
+    native v;
+#else
+    T v[N];
+#endif
+
+    Vec() = default;
+
+    Vec(T x) {
+#if SIMD_VECTOR_EXTENSIONS
+        v = native {} + x;
+#else
+        std::fill_n(v, N, x);
+#endif
+    }
+
+    template <typename... Args>
+        requires (N > 1 && sizeof...(Args) == N)
+    Vec(Args... args) : v { static_cast<T>(args)... } {}
+
+    Vec(Vec<T, N / 2> low, Vec<T, N / 2> high) requires (N % 2 == 0) {
+        std::memcpy(&v, &low.v, sizeof(low.v));
+        std::memcpy(reinterpret_cast<char *>(&v) + sizeof(low.v), &high.v, sizeof(high.v));
+    }
+
+    // between the signed and unsigned variants of an integer type
+    template <typename U>
+        requires (
+            std::is_integral_v<T> && std::is_integral_v<U> &&
+            sizeof(U) == sizeof(T) && !std::is_same_v<U, T>
+        )
+    Vec(Vec<U, N> x) {
+        std::memcpy(&v, &x.v, sizeof(v));
+    }
+
+    static constexpr int size() {
+        return N;
+    }
+
+    Vec & load(const void * p) {
+        std::memcpy(&v, p, sizeof(v));
+        return *this;
+    }
+
+    Vec & load_a(const void * p) {
+        return load(p);
+    }
+
+    Vec & load_partial(int n, const void * p) {
+        *this = Vec(T {});
+        std::memcpy(&v, p, std::clamp(n, 0, N) * sizeof(T));
+        return *this;
+    }
+
+    void store(void * p) const {
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    void store_a(void * p) const {
+        store(p);
+    }
+
+    void store_nt(void * p) const {
+        store(p);
+    }
+
+    void store_partial(int n, void * p) const {
+        std::memcpy(p, &v, std::clamp(n, 0, N) * sizeof(T));
+    }
+
+    T extract(int i) const {
+        return v[i];
+    }
+
+    T operator[](int i) const {
+        return v[i];
+    }
+
+    Vec & insert(int i, T x) {
+        v[i] = x;
+        return *this;
+    }
+
+    Vec<T, N / 2> get_low() const {
+        Vec<T, N / 2> r;
+        std::memcpy(&r.v, &v, sizeof(r.v));
+        return r;
+    }
+
+    Vec<T, N / 2> get_high() const {
+        Vec<T, N / 2> r;
+        std::memcpy(&r.v, reinterpret_cast<const char *>(&v) + sizeof(r.v), sizeof(r.v));
+        return r;
+    }
+
+#if SIMD_VECTOR_EXTENSIONS
+#define SIMD_BINARY(op) \
+    friend Vec operator op(Vec a, Vec b) { \
+        Vec r; \
+        r.v = a.v op b.v; \
+        return r; \
+    } \
+    Vec & operator op##=(Vec b) { \
+        v = v op b.v; \
+        return *this; \
+    }
+#else
+#define SIMD_BINARY(op) \
+    friend Vec operator op(Vec a, Vec b) { \
+        Vec r; \
+        for (int i = 0; i < N; i++) { \
+            r.v[i] = static_cast<T>(a.v[i] op b.v[i]); \
+        } \
+        return r; \
+    } \
+    Vec & operator op##=(Vec b) { \
+        *this = *this op b; \
+        return *this; \
+    }
+#endif
+    SIMD_BINARY(+)
+    SIMD_BINARY(-)
+    SIMD_BINARY(*)
+    SIMD_BINARY(/)
+#undef SIMD_BINARY
+
+#if SIMD_VECTOR_EXTENSIONS
+#define SIMD_INTEGER_BINARY(op) \
+    friend Vec operator op(Vec a, Vec b) requires std::is_integral_v<T> { \
+        Vec r; \
+        r.v = a.v op b.v; \
+        return r; \
+    }
+#define SIMD_SHIFT(op) \
+    friend Vec operator op(Vec a, int b) requires std::is_integral_v<T> { \
+        Vec r; \
+        r.v = a.v op b; \
+        return r; \
+    }
+#else
+#define SIMD_INTEGER_BINARY(op) \
+    friend Vec operator op(Vec a, Vec b) requires std::is_integral_v<T> { \
+        Vec r; \
+        for (int i = 0; i < N; i++) { \
+            r.v[i] = static_cast<T>(a.v[i] op b.v[i]); \
+        } \
+        return r; \
+    }
+#define SIMD_SHIFT(op) \
+    friend Vec operator op(Vec a, int b) requires std::is_integral_v<T> { \
+        Vec r; \
+        for (int i = 0; i < N; i++) { \
+            r.v[i] = static_cast<T>(a.v[i] op b); \
+        } \
+        return r; \
+    }
+#endif
+    SIMD_INTEGER_BINARY(&)
+    SIMD_INTEGER_BINARY(|)
+    SIMD_INTEGER_BINARY(^)
+    SIMD_SHIFT(<<)
+    SIMD_SHIFT(>>)
+#undef SIMD_INTEGER_BINARY
+#undef SIMD_SHIFT
+
+    friend Vec operator-(Vec a) {
+        return Vec(T {}) - a;
+    }
+
+#if SIMD_VECTOR_EXTENSIONS
+#define SIMD_COMPARE(op) \
+    friend Mask<T, N> operator op(Vec a, Vec b) { \
+        Mask<T, N> r; \
+        r.m = (typename Mask<T, N>::native) (a.v op b.v); \
+        return r; \
+    }
+#else
+#define SIMD_COMPARE(op) \
+    friend Mask<T, N> operator op(Vec a, Vec b) { \
+        Mask<T, N> r; \
+        for (int i = 0; i < N; i++) { \
+            r.m[i] = a.v[i] op b.v[i]; \
+        } \
+        return r; \
+    }
+#endif
+    SIMD_COMPARE(<)
+    SIMD_COMPARE(<=)
+    SIMD_COMPARE(>)
+    SIMD_COMPARE(>=)
+    SIMD_COMPARE(==)
+    SIMD_COMPARE(!=)
+#undef SIMD_COMPARE
+
+    friend Vec select(Mask<T, N> m, Vec a, Vec b) {
+        Vec r;
+#if SIMD_VECTOR_EXTENSIONS
+        using I = typename Mask<T, N>::native;
+        r.v = (native) (((I) a.v & m.m) | ((I) b.v & ~m.m));
+#else
+        for (int i = 0; i < N; i++) {
+            r.v[i] = m.m[i] ? a.v[i] : b.v[i];
+        }
+#endif
+        return r;
+    }
+
+    friend Vec if_add(Mask<T, N> m, Vec a, Vec b) {
+        return select(m, a + b, a);
+    }
+
+    friend Vec max(Vec a, Vec b) {
+        return select(a > b, a, b);
+    }
+
+    friend Vec min(Vec a, Vec b) {
+        return select(a < b, a, b);
+    }
+
+    friend Vec abs(Vec a) {
+        return select(a < Vec(T {}), -a, a);
+    }
+
+    friend Vec square(Vec a) {
+        return a * a;
+    }
+
+    friend Vec mul_add(Vec a, Vec b, Vec c) {
+        return a * b + c;
+    }
+
+    friend Vec mul_sub(Vec a, Vec b, Vec c) {
+        return a * b - c;
+    }
+
+    friend Vec nmul_add(Vec a, Vec b, Vec c) {
+        return c - a * b;
+    }
+
+    friend Vec sqrt(Vec a) requires std::is_floating_point_v<T> {
+#if SIMD_VECTOR_EXTENSIONS && SIMD_HAS_BUILTIN(__builtin_elementwise_sqrt)
+        Vec r;
+        r.v = __builtin_elementwise_sqrt(a.v);
+        return r;
+#else
+        return a.map([](T x) { return std::sqrt(x); });
+#endif
+    }
+
+    friend Vec pow(Vec a, Vec b) requires std::is_floating_point_v<T> {
+        Vec r;
+        for (int i = 0; i < N; i++) {
+            r.v[i] = std::pow(a.v[i], b.v[i]);
+        }
+        return r;
+    }
+
+    friend Vec exp(Vec a) requires std::is_floating_point_v<T> {
+        return a.map([](T x) { return std::exp(x); });
+    }
+
+    friend Vec log(Vec a) requires std::is_floating_point_v<T> {
+        return a.map([](T x) { return std::log(x); });
+    }
+
+    friend Vec round(Vec a) requires std::is_floating_point_v<T> {
+        return a.map([](T x) { return std::nearbyint(x); });
+    }
+
+    friend T horizontal_add(Vec a) {
+        T sum {};
+        for (int i = 0; i < N; i++) {
+            sum += a.v[i];
+        }
+        return sum;
+    }
+
+    friend T horizontal_max(Vec a) {
+        T m = a.v[0];
+        for (int i = 1; i < N; i++) {
+            m = std::max<T>(m, a.v[i]);
+        }
+        return m;
+    }
+
+    friend T horizontal_min(Vec a) {
+        T m = a.v[0];
+        for (int i = 1; i < N; i++) {
+            m = std::min<T>(m, a.v[i]);
+        }
+        return m;
+    }
+
+private:
+    template <typename F>
+    Vec map(F f) const {
+        Vec r;
+        for (int i = 0; i < N; i++) {
+            r.v[i] = f(v[i]);
+        }
+        return r;
+    }
+};
+
+using Vec4f = Vec<float, 4>;
+using Vec8f = Vec<float, 8>;
+using Vec16f = Vec<float, 16>;
+using Vec2d = Vec<double, 2>;
+using Vec4d = Vec<double, 4>;
+using Vec8d = Vec<double, 8>;
+using Vec16c = Vec<int8_t, 16>;
+using Vec16uc = Vec<uint8_t, 16>;
+using Vec32uc = Vec<uint8_t, 32>;
+using Vec8s = Vec<int16_t, 8>;
+using Vec8us = Vec<uint16_t, 8>;
+using Vec16us = Vec<uint16_t, 16>;
+using Vec4i = Vec<int32_t, 4>;
+using Vec8i = Vec<int32_t, 8>;
+using Vec16i = Vec<int32_t, 16>;
+using Vec8ui = Vec<uint32_t, 8>;
+using Vec16ui = Vec<uint32_t, 16>;
+using Vec4q = Vec<int64_t, 4>;
+using Vec8q = Vec<int64_t, 8>;
+
+using Vec4fb = Mask<float, 4>;
+using Vec8fb = Mask<float, 8>;
+using Vec16fb = Mask<float, 16>;
+using Vec4db = Mask<double, 4>;
+using Vec8db = Mask<double, 8>;
+using Vec8ib = Mask<int32_t, 8>;
+using Vec16ib = Mask<int32_t, 16>;
+
+// lane-wise conversion, truncating towards zero from floating point
+template <typename U, typename T, int N>
+static inline Vec<U, N> simd_convert(Vec<T, N> a) {
+    Vec<U, N> r;
+#if SIMD_VECTOR_EXTENSIONS
+    r.v = __builtin_convertvector(a.v, typename Vec<U, N>::native);
+#else
+    for (int i = 0; i < N; i++) {
+        r.v[i] = static_cast<U>(a.v[i]);
+    }
+#endif
+    return r;
+}
+
+template <typename T, int N>
+static inline Vec<float, N> to_float(Vec<T, N> a) {
+    return simd_convert<float>(a);
+}
+
+template <typename T, int N>
+static inline Vec<double, N> to_double(Vec<T, N> a) {
+    return simd_convert<double>(a);
+}
+
+template <int N>
+static inline Vec<int32_t, N> truncatei(Vec<float, N> a) {
+    return simd_convert<int32_t>(a);
+}
+
+// widens each lane to the integer type of twice the size
+template <typename T, int N>
+    requires (std::is_integral_v<T> && sizeof(T) < 8)
+static inline auto extend(Vec<T, N> a) {
+    using W = std::conditional_t<sizeof(T) == 1, int16_t,
+              std::conditional_t<sizeof(T) == 2, int32_t, int64_t>>;
+    return simd_convert<std::conditional_t<std::is_signed_v<T>, W, std::make_unsigned_t<W>>>(a);
+}
+
+template <typename U, typename T, int N>
+static inline auto simd_reinterpret(Vec<T, N> a) {
+    static_assert(N * sizeof(T) % sizeof(U) == 0);
+    Vec<U, N * sizeof(T) / sizeof(U)> r;
+    static_assert(sizeof(r.v) == sizeof(a.v));
+    std::memcpy(&r.v, &a.v, sizeof(r.v));
+    return r;
+}
+
+template <typename T, int N>
+static inline auto reinterpret_f(Vec<T, N> a) {
+    return simd_reinterpret<float>(a);
+}
+
+template <typename T, int N>
+static inline auto reinterpret_d(Vec<T, N> a) {
+    return simd_reinterpret<double>(a);
+}
+
+template <typename T, int N>
+static inline auto reinterpret_i(Vec<T, N> a) {
+    return simd_reinterpret<int32_t>(a);
+}
+
+// lane i of the result is lane I[i] of the concatenation of a and b
+template <int... I, typename T, int N>
+static inline Vec<T, N> simd_shuffle(Vec<T, N> a, Vec<T, N> b) {
+    static_assert(sizeof...(I) == N);
+    static_assert(((I < 2 * N) && ...));
+
+    Vec<T, N> r;
+#if SIMD_VECTOR_EXTENSIONS && SIMD_HAS_BUILTIN(__builtin_shufflevector)
+    r.v = __builtin_shufflevector(a.v, b.v, (I < 0 ? 0 : I)...);
+    if constexpr (((I < 0) || ...)) {
+        r = select(Vec<T, N>((I < 0 ? T(1) : T(0))...) == Vec<T, N>(T {}), r, Vec<T, N>(T {}));
+    }
+#else
+    constexpr int index[] { I... };
+    for (int i = 0; i < N; i++) {
+        if (index[i] < 0) {
+            r.v[i] = T {};
+        } else if (index[i] < N) {
+            r.v[i] = a.v[index[i]];
+        } else {
+            r.v[i] = b.v[index[i] - N];
+        }
+    }
+#endif
+    return r;
+}
+
+#define SIMD_BLEND(n) \
+    template <int... I, typename T> \
+    static inline Vec<T, n> blend##n(Vec<T, n> a, Vec<T, n> b) { \
+        return simd_shuffle<I...>(a, b); \
+    } \
+    template <int... I, typename T> \
+    static inline Vec<T, n> permute##n(Vec<T, n> a) { \
+        static_assert(((I < n) && ...)); \
+        return simd_shuffle<I...>(a, a); \
+    }
+SIMD_BLEND(2)
+SIMD_BLEND(4)
+SIMD_BLEND(8)
+SIMD_BLEND(16)
+SIMD_BLEND(32)
+#undef SIMD_BLEND
+
+// The filter flushes subnormals to zero while it runs, which only matters
+// for speed. The control word is the MXCSR on x86 and the FPCR on AArch64,
+// elsewhere these do nothing.
+static inline uint32_t get_control_word() {
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    return _mm_getcsr();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    uint64_t fpcr;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    return static_cast<uint32_t>(fpcr);
+#else
+    return 0;
+#endif
+}
+
+static inline void set_control_word(uint32_t word) {
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    _mm_setcsr(word);
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    uint64_t fpcr = word;
+    __asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+#else
+    (void) word;
+#endif
+}
+
+static inline void no_subnormals() {
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    // flush to zero and denormals are zero
+    set_control_word(get_control_word() | 0x8040);
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    // flush to zero
+    set_control_word(get_control_word() | (1u << 24));
+#endif
+}
+
+#endif // DFTTEST2_PORTABLE
+
+#endif // SIMD_HPP
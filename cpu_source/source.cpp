@@ -1,301 +1,95 @@
 #include <algorithm>
 #include <array>
-#include <atomic>
-#include <cassert>
-#include <cmath>
 #include <complex>
 #include <cstdint>
-#include <cstring>
+#include <deque>
 #include <memory>
 #include <mutex>
-#if __cplusplus >= 202002L
-#include <numbers>
-#endif
-#include <shared_mutex>
-#include <thread>
-#include <type_traits>
-#include <unordered_map>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <VapourSynth.h>
 #include <VSHelper.h>
 
-#include "kernel.hpp"
+#include "core.hpp"
+#include "mapped_file.hpp"
+#include "numa.hpp"
+#include "plugin.hpp"
 
 #include <config.h> // generated by cmake
 
-template <typename T, typename T_in>
-    requires
-        (std::is_same_v<T_in, T> || std::is_same_v<T_in, std::complex<T>>)
-static void dft(
-    std::complex<T> * VS_RESTRICT dst,
-    const T_in * VS_RESTRICT src,
-    int n,
-    int stride
-) {
-#if __cplusplus >= 202002L
-    const auto pi = std::numbers::pi_v<T>;
-#else
-    const auto pi = static_cast<T>(M_PI);
-#endif
-
-    int out_num = std::is_floating_point_v<T_in> ? (n / 2 + 1) : n;
-    for (int i = 0; i < out_num; i++) {
-        std::complex<T> sum {};
-        for (int j = 0; j < n; j++) {
-            auto imag = -2 * i * j * pi / n;
-            auto weight = std::complex(std::cos(imag), std::sin(imag));
-            sum += src[j * stride] * weight;
-        }
-        dst[i * stride] = sum;
-    }
-}
-
-template <typename T>
-static T square(const T & x) {
-    return x * x;
-}
-
-static int calc_pad_size(int size, int block_size, int block_step) {
-    return (
-        size
-        + ((size % block_size) ? block_size - size % block_size : 0)
-        + std::max(block_size - block_step, block_step) * 2
-    );
-}
-
-static int calc_pad_num(int size, int block_size, int block_step) {
-    return (calc_pad_size(size, block_size, block_step) - block_size) / block_step + 1;
-}
-
-template <typename T>
-static void reflection_padding_impl(
-    T * VS_RESTRICT dst, // shape: (pad_height, pad_width)
-    const T * VS_RESTRICT src, // shape: (height, stride)
-    int width, int height, int stride,
-    int block_size, int block_step
-) {
-
-    int pad_width = calc_pad_size(width, block_size, block_step);
-    int pad_height = calc_pad_size(height, block_size, block_step);
-
-    int offset_y = (pad_height - height) / 2;
-    int offset_x = (pad_width - width) / 2;
-
-    vs_bitblt(
-        &dst[offset_y * pad_width + offset_x], pad_width * sizeof(T),
-        src, stride * sizeof(T),
-        width * sizeof(T), height
-    );
-
-    // copy left and right regions
-    for (int y = offset_y; y < offset_y + height; y++) {
-        auto dst_line = &dst[y * pad_width];
+struct DFTTestData : DFTTestInstance {
+    VSNodeRef * node;
 
-        for (int x = 0; x < offset_x; x++) {
-            dst_line[x] = dst_line[offset_x * 2 - x];
-        }
+    // recent output frames while the instance is shared
+    std::mutex frame_cache_lock;
+    std::deque<std::pair<int, const VSFrameRef *>> frame_cache;
+    int frame_cache_size;
+};
 
-        for (int x = offset_x + width; x < pad_width; x++) {
-            dst_line[x] = dst_line[2 * (offset_x + width) - 2 - x];
+static PluginArgs get_args(const VSMap * in, const VSAPI * vsapi) {
+    return {
+        .get_int = [in, vsapi](const char * key, int index, int * error) {
+            return vsapi->propGetInt(in, key, index, error);
+        },
+        .get_float = [in, vsapi](const char * key, int index, int * error) {
+            return vsapi->propGetFloat(in, key, index, error);
+        },
+        .get_float_array = [in, vsapi](const char * key, int * error) {
+            return vsapi->propGetFloatArray(in, key, error);
+        },
+        .get_data = [in, vsapi](const char * key, int * error) {
+            return vsapi->propGetData(in, key, 0, error);
+        },
+        .num_elements = [in, vsapi](const char * key) {
+            return vsapi->propNumElements(in, key);
         }
-    }
-
-    // copy top region
-    for (int y = 0; y < offset_y; y++) {
-        std::memcpy(
-            &dst[y * pad_width],
-            &dst[(offset_y * 2 - y) * pad_width],
-            pad_width * sizeof(T)
-        );
-    }
-
-    // copy bottom region
-    for (int y = offset_y + height; y < pad_height; y++) {
-        std::memcpy(
-            &dst[y * pad_width],
-            &dst[(2 * (offset_y + height) - 2 - y) * pad_width],
-            pad_width * sizeof(T)
-        );
-    }
+    };
 }
 
-static void reflection_padding(
-    uint8_t * VS_RESTRICT dst, // shape: (pad_height, pad_width)
-    const uint8_t * VS_RESTRICT src, // shape: (height, stride)
-    int width, int height, int stride,
-    int block_size, int block_step,
-    int bytes_per_sample
-) {
-
-    if (bytes_per_sample == 1) {
-        reflection_padding_impl(
-            static_cast<uint8_t *>(dst),
-            static_cast<const uint8_t *>(src),
-            width, height, stride,
-            block_size, block_step
-        );
-    } else if (bytes_per_sample == 2) {
-        reflection_padding_impl(
-            reinterpret_cast<uint16_t *>(dst),
-            reinterpret_cast<const uint16_t *>(src),
-            width, height, stride,
-            block_size, block_step
-        );
-    } else if (bytes_per_sample == 4) {
-        reflection_padding_impl(
-            reinterpret_cast<uint32_t *>(dst),
-            reinterpret_cast<const uint32_t *>(src),
-            width, height, stride,
-            block_size, block_step
-        );
-    }
+static PluginVideoInfo get_format_info(const VSFormat * format) {
+    PluginVideoInfo info {};
+    info.num_planes = format->numPlanes;
+    info.subsampling_w = format->subSamplingW;
+    info.subsampling_h = format->subSamplingH;
+    info.float_samples = format->sampleType == stFloat;
+    info.bits_per_sample = format->bitsPerSample;
+    info.bytes_per_sample = format->bytesPerSample;
+    return info;
 }
 
-static void load_block(
-    Vec16f * VS_RESTRICT block,
-    const uint8_t * VS_RESTRICT shifted_src,
-    int radius,
-    int block_size,
-    int block_step,
-    int width,
-    int height,
-    const Vec16f * VS_RESTRICT window,
-    int bits_per_sample
-) {
-
-    float scale = 1.0f / (1 << (bits_per_sample - 8));
-    if (bits_per_sample == 32) {
-        scale = 255.0f;
-    }
-
-    int bytes_per_sample = (bits_per_sample + 7) / 8;
-
-    assert(block_size == 16);
-    block_size = 16; // unsafe
-
-    int offset_x = calc_pad_size(width, block_size, block_step);
-    int offset_y = calc_pad_size(height, block_size, block_step);
-
-    if (bytes_per_sample == 1) {
-        for (int i = 0; i < 2 * radius + 1; i++) {
-            for (int j = 0; j < block_size; j++) {
-                auto vec_input = Vec16uc().load((const uint8_t *) shifted_src + (i * offset_y + j) * offset_x);
-                auto vec_input_f = to_float(Vec16i(extend(extend(vec_input))));
-                block[i * block_size * 2 + j] = scale * window[i * block_size + j] * vec_input_f;
-            }
-        }
-    }
-    if (bytes_per_sample == 2) {
-        for (int i = 0; i < 2 * radius + 1; i++) {
-            for (int j = 0; j < block_size; j++) {
-                auto vec_input = Vec16us().load((const uint16_t *) shifted_src + (i * offset_y + j) * offset_x);
-                auto vec_input_f = to_float(Vec16i(extend(vec_input)));
-                block[i * block_size * 2 + j] = scale * window[i * block_size + j] * vec_input_f;
-            }
-        }
-    }
-    if (bytes_per_sample == 4) {
-        for (int i = 0; i < 2 * radius + 1; i++) {
-            for (int j = 0; j < block_size; j++) {
-                auto vec_input_f = Vec16f().load((const float *) shifted_src + (i * offset_y + j) * offset_x);
-                block[i * block_size * 2 + j] = scale * window[i * block_size + j] * vec_input_f;
-            }
-        }
-    }
+// `vi` has a constant format
+static PluginVideoInfo get_video_info(const VSVideoInfo * vi) {
+    auto info = get_format_info(vi->format);
+    info.width = vi->width;
+    info.height = vi->height;
+    info.num_frames = vi->numFrames;
+    info.fps_num = vi->fpsNum;
+    info.fps_den = vi->fpsDen;
+    return info;
 }
 
-static void store_block(
-    float * VS_RESTRICT shifted_dst,
-    const Vec16f * VS_RESTRICT shifted_block,
-    int block_size,
-    int block_step,
-    int width,
-    int height,
-    const Vec16f * VS_RESTRICT shifted_window
-) {
-
-    assert(block_size == 16);
-    block_size = 16; // unsafe
-
-    for (int i = 0; i < block_size; i++) {
-        Vec16f acc = Vec16f().load((const float *) shifted_dst + (i * calc_pad_size(width, block_size, block_step)));
-        acc = mul_add(shifted_block[i], shifted_window[i], acc);
-        acc.store((float *) shifted_dst + (i * calc_pad_size(width, block_size, block_step)));
+// returns nullptr if frame `n` is not cached
+static const VSFrameRef * find_cached_frame(DFTTestData * d, int n, const VSAPI * vsapi) {
+    std::lock_guard _ { d->frame_cache_lock };
+    for (const auto & [i, frame] : d->frame_cache) {
+        if (i == n) {
+            return vsapi->cloneFrameRef(frame);
+        }
     }
+    return nullptr;
 }
 
-static void store_frame(
-    uint8_t * VS_RESTRICT dst,
-    const float * VS_RESTRICT shifted_src,
-    int width,
-    int height,
-    int dst_stride,
-    int src_stride,
-    int bits_per_sample
-) {
-
-    float scale = 1.0f / (1 << (bits_per_sample - 8));
-    if (bits_per_sample == 32) {
-        scale = 255.0f;
-    }
-
-    int bytes_per_sample = (bits_per_sample + 7) / 8;
-    int peak = (1 << bits_per_sample) - 1;
-
-    if (bytes_per_sample == 1) {
-        auto dstp = (uint8_t *) dst;
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                auto clamped = std::clamp(static_cast<int>(shifted_src[y * src_stride + x] / scale + 0.5f), 0, peak);
-                dstp[y * dst_stride + x] = static_cast<uint8_t>(clamped);
-            }
-        }
-    }
-    if (bytes_per_sample == 2) {
-        auto dstp = (uint16_t *) dst;
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                auto clamped = std::clamp(static_cast<int>(shifted_src[y * src_stride + x] / scale + 0.5f), 0, peak);
-                dstp[y * dst_stride + x] = static_cast<uint16_t>(clamped);
-            }
-        }
-    }
-    if (bytes_per_sample == 4) {
-        auto dstp = (float *) dst;
-        for (int y = 0; y < height; y++) {
-            for (int x = 0; x < width; x++) {
-                dstp[y * dst_stride + x] = shifted_src[y * src_stride + x] / scale;
-            }
-        }
+static void cache_frame(DFTTestData * d, int n, const VSFrameRef * frame, const VSAPI * vsapi) {
+    std::lock_guard _ { d->frame_cache_lock };
+    d->frame_cache.emplace_back(n, vsapi->cloneFrameRef(frame));
+    if (static_cast<int>(d->frame_cache.size()) > d->frame_cache_size) {
+        vsapi->freeFrame(d->frame_cache.front().second);
+        d->frame_cache.pop_front();
     }
 }
 
-struct DFTTestThreadData {
-    uint8_t * padded; // shape: (pad_height, pad_width)
-    float * padded2; // shape: (pad_height, pad_width)
-};
-
-struct DFTTestData {
-    VSNodeRef * node;
-    int radius;
-    int block_size;
-    int block_step;
-    std::array<bool, 3> process;
-    bool zero_mean;
-    std::unique_ptr<Vec16f []> window;
-    std::unique_ptr<Vec16f []> window_freq;
-    std::unique_ptr<Vec16f []> sigma;
-    int filter_type;
-    float sigma2;
-    float pmin;
-    float pmax;
-
-    std::atomic<int> num_uninitialized_threads;
-    std::unordered_map<std::thread::id, DFTTestThreadData> thread_data;
-    std::shared_mutex thread_data_lock;
-};
-
 static void VS_CC DFTTestInit(
     VSMap *in, VSMap *out, void **instanceData, VSNode *node,
     VSCore *core, const VSAPI *vsapi
@@ -303,8 +97,13 @@ static void VS_CC DFTTestInit(
 
     auto d = static_cast<const DFTTestData *>(*instanceData);
 
-    auto vi = vsapi->getVideoInfo(d->node);
-    vsapi->setVideoInfo(vi, 1, node);
+    // `downscale` halves the output dimensions
+    VSVideoInfo vi = *vsapi->getVideoInfo(d->node);
+    if (d->core.downscale) {
+        vi.width /= 2;
+        vi.height /= 2;
+    }
+    vsapi->setVideoInfo(&vi, 1, node);
 }
 
 static const VSFrameRef *VS_CC DFTTestGetFrame(
@@ -314,10 +113,20 @@ static const VSFrameRef *VS_CC DFTTestGetFrame(
 
     auto d = static_cast<DFTTestData *>(*instanceData);
 
+    bool shared = d->num_instances.load(std::memory_order::relaxed) > 1;
+
     if (activationReason == arInitial) {
-        int start = std::max(n - d->radius, 0);
+        if (shared) {
+            if (auto frame = find_cached_frame(d, n, vsapi); frame) {
+                return frame;
+            }
+        }
+
+        // frames [n - output_slice, n - output_slice + 2 * radius]
+        int first = n - d->core.output_slice;
+        int start = std::max(first, 0);
         auto vi = vsapi->getVideoInfo(d->node);
-        int end = std::min(n + d->radius, vi->numFrames - 1);
+        int end = std::min(first + 2 * d->core.radius, vi->numFrames - 1);
         for (int i = start; i <= end; i++) {
             vsapi->requestFrameFilter(i, d->node, frameCtx);
         }
@@ -326,63 +135,34 @@ static const VSFrameRef *VS_CC DFTTestGetFrame(
         return nullptr;
     }
 
-    auto mxcsr = get_control_word();
-    no_subnormals();
-
     auto vi = vsapi->getVideoInfo(d->node);
 
-    DFTTestThreadData thread_data;
-
-    auto thread_id = std::this_thread::get_id();
-    if (d->num_uninitialized_threads.load(std::memory_order::acquire) == 0) {
-        const auto & const_data = d->thread_data;
-        thread_data = const_data.at(thread_id);
-    } else {
-        bool initialized = true;
-
-        d->thread_data_lock.lock_shared();
-        try {
-            const auto & const_data = d->thread_data;
-            thread_data = const_data.at(thread_id);
-        } catch (const std::out_of_range &) {
-            initialized = false;
-        }
-        d->thread_data_lock.unlock_shared();
-
-        if (!initialized) {
-            auto padded_size = (
-                (2 * d->radius + 1) *
-                calc_pad_size(vi->height, d->block_size, d->block_step) *
-                calc_pad_size(vi->width, d->block_size, d->block_step) *
-                vi->format->bytesPerSample
-            );
-
-            thread_data.padded = static_cast<uint8_t *>(std::malloc(padded_size));
-            thread_data.padded2 = static_cast<float *>(std::malloc(
-                calc_pad_size(vi->height, d->block_size, d->block_step) *
-                calc_pad_size(vi->width, d->block_size, d->block_step) *
-                sizeof(float)
-            ));
-
-            {
-                std::lock_guard _ { d->thread_data_lock };
-                d->thread_data.emplace(thread_id, thread_data);
-            }
-
-            d->num_uninitialized_threads.fetch_sub(1, std::memory_order::release);
-        }
-    }
+    auto checkout = check_out_thread_data(*d, vi->width, vi->height, vi->format->bytesPerSample);
+    auto & thread_data = checkout.thread_data;
+    auto filter_core = checkout.core;
 
     std::vector<std::unique_ptr<const VSFrameRef, decltype(vsapi->freeFrame)>> src_frames;
-    src_frames.reserve(2 * d->radius + 1);
-    for (int i = n - d->radius; i <= n + d->radius; i++) {
+    src_frames.reserve(2 * d->core.radius + 1);
+    for (int i = n - d->core.output_slice; i <= n - d->core.output_slice + 2 * d->core.radius; i++) {
         src_frames.emplace_back(
             vsapi->getFrameFilter(std::clamp(i, 0, vi->numFrames - 1), d->node, frameCtx),
             vsapi->freeFrame
         );
     }
 
-    auto & src_center_frame = src_frames[d->radius];
+    auto & src_center_frame = src_frames[d->core.output_slice];
+
+    std::unique_ptr<GrainStats []> grain_stats;
+    if (!d->grain_path.empty()) {
+        grain_stats = std::make_unique<GrainStats []>(3);
+    }
+
+    bool recursive_prior = false;
+    if (d->core.recursive > 0.0f) {
+        // on random access, the recursion restarts at frame n
+        recursive_prior = n > 0 && d->recursive_frame == n - 1;
+        d->recursive_frame = n;
+    }
     auto format = vsapi->getFrameFormat(src_center_frame.get());
 
     const VSFrameRef * fr[] {
@@ -392,10 +172,24 @@ static const VSFrameRef *VS_CC DFTTestGetFrame(
     };
     const int pl[] { 0, 1, 2 };
     std::unique_ptr<VSFrameRef, decltype(vsapi->freeFrame)> dst_frame {
-        vsapi->newVideoFrame2(format, vi->width, vi->height, fr, pl, src_center_frame.get(), core),
+        vsapi->newVideoFrame2(
+            format,
+            d->core.downscale ? vi->width / 2 : vi->width,
+            d->core.downscale ? vi->height / 2 : vi->height,
+            fr, pl, src_center_frame.get(), core
+        ),
         vsapi->freeFrame
     };
 
+    PerfSession perf_session;
+    PerfSession * perf = nullptr;
+    if (d->perf) {
+        if (auto counters = get_thread_perf_counters(); counters) {
+            start_perf_session(perf_session, counters);
+            perf = &perf_session;
+        }
+    }
+
     for (int plane = 0; plane < format->numPlanes; plane++) {
         if (!d->process[plane]) {
             continue;
@@ -406,86 +200,83 @@ static const VSFrameRef *VS_CC DFTTestGetFrame(
         int stride = vsapi->getStride(src_center_frame.get(), plane) / vi->format->bytesPerSample;
 
         int padded_size_spatial = (
-            calc_pad_size(height, d->block_size, d->block_step) *
-            calc_pad_size(width, d->block_size, d->block_step)
-        );
-
-        std::memset(thread_data.padded2, 0,
-            calc_pad_size(height, d->block_size, d->block_step) *
-            calc_pad_size(width, d->block_size, d->block_step) *
-            sizeof(float)
+            calc_pad_size(height, d->core.block_size, d->core.block_step) *
+            calc_pad_stride(width, d->core.block_size, d->core.block_step)
         );
 
-        for (int i = 0; i < 2 * d->radius + 1; i++) {
+        std::array<const uint8_t *, 7> srcps;
+        for (int i = 0; i < 2 * d->core.radius + 1; i++) {
             auto srcp = vsapi->getReadPtr(src_frames[i].get(), plane);
+            srcps[i] = &thread_data.padded[(i * padded_size_spatial) * vi->format->bytesPerSample];
             reflection_padding(
                 &thread_data.padded[(i * padded_size_spatial) * vi->format->bytesPerSample],
                 srcp,
                 width, height, stride,
-                d->block_size, d->block_step,
+                d->core.block_size, d->core.block_step,
                 vi->format->bytesPerSample
             );
         }
-
-        for (int i = 0; i < calc_pad_num(height, d->block_size, d->block_step); i++) {
-            for (int j = 0; j < calc_pad_num(width, d->block_size, d->block_step); j++) {
-                assert(d->block_size == 16);
-                constexpr int block_size = 16;
-
-                Vec16f block[7 * block_size * 2];
-
-                int offset_x = calc_pad_size(width, d->block_size, d->block_step);
-
-                load_block(
-                    block,
-                    &thread_data.padded[(i * offset_x + j) * d->block_step * vi->format->bytesPerSample],
-                    d->radius, d->block_size, d->block_step,
-                    width, height,
-                    d->window.get(), vi->format->bitsPerSample
-                );
-
-                fused(
-                    block,
-                    d->sigma.get(),
-                    d->sigma2,
-                    d->pmin,
-                    d->pmax,
-                    d->filter_type,
-                    d->zero_mean,
-                    d->window_freq.get(),
-                    d->radius
-                );
-
-                store_block(
-                    &thread_data.padded2[(i * offset_x + j) * d->block_step],
-                    &block[d->radius * block_size * 2],
-                    block_size,
-                    d->block_step,
-                    width,
-                    height,
-                    &d->window[d->radius * block_size * 2]
-                );
-            }
+        if (perf) {
+            perf_mark(*perf, perf_padding);
         }
 
-        int pad_width = calc_pad_size(width, d->block_size, d->block_step);
-        int pad_height = calc_pad_size(height, d->block_size, d->block_step);
-        int offset_y = (pad_height - height) / 2;
-        int offset_x = (pad_width - width) / 2;
+        filter_plane(
+            thread_data.padded2,
+            srcps.data(),
+            width, height,
+            vi->format->bitsPerSample,
+            *filter_core,
+            thread_data.workspace,
+            perf,
+            d->recursive_states[plane].get(),
+            recursive_prior
+        );
+
+        if (grain_stats) {
+            accumulate_grain(
+                grain_stats[plane],
+                thread_data.padded2,
+                srcps[d->core.output_slice],
+                width, height,
+                vi->format->bitsPerSample,
+                *filter_core
+            );
+        }
 
         auto dstp = vsapi->getWritePtr(dst_frame.get(), plane);
-        store_frame(
+        store_plane(
             dstp,
-            &thread_data.padded2[(offset_y * pad_width + offset_x)],
-            width,
-            height,
-            stride,
-            pad_width,
-            vi->format->bitsPerSample
+            thread_data.padded2,
+            width, height,
+            vsapi->getStride(dst_frame.get(), plane) / vi->format->bytesPerSample,
+            vi->format->bitsPerSample,
+            *filter_core
         );
+        if (perf) {
+            perf_mark(*perf, perf_store_frame);
+        }
+    }
+
+    if (perf) {
+        // [cycles, instructions, L1D read misses, LLC read misses] per stage
+        auto props = vsapi->getFramePropsRW(dst_frame.get());
+        for (int i = 0; i < perf_num_stages; i++) {
+            int64_t values[perf_num_events];
+            std::copy_n(perf->stages[i], perf_num_events, values);
+            vsapi->propSetIntArray(props, ("DFTTestPerf" + std::string(perf_stage_names[i])).c_str(), values, perf_num_events);
+        }
+        vsapi->propSetInt(props, "DFTTestPerfThread", perf->counters->thread_index, paReplace);
     }
 
-    set_control_word(mxcsr);
+    check_in_thread_data(checkout);
+
+    if (grain_stats) {
+        add_frame_grain(*d, n, grain_stats.get(), format->numPlanes);
+    }
+
+    if (shared) {
+        cache_frame(d, n, dst_frame.get(), vsapi);
+    }
 
     return dst_frame.release();
 }
@@ -494,15 +285,27 @@ static void VS_CC DFTTestFree(
     void *instanceData, VSCore *core, const VSAPI *vsapi
 ) noexcept {
 
-    auto d = static_cast<const DFTTestData *>(instanceData);
+    auto d = static_cast<DFTTestData *>(instanceData);
 
-    vsapi->freeNode(d->node);
+    if (!release_instance(*d)) {
+        return ;
+    }
+
+    for (auto & [_, frame] : d->frame_cache) {
+        vsapi->freeFrame(frame);
+    }
 
-    for (const auto & [_, thread_data] : d->thread_data) {
-        std::free(thread_data.padded2);
-        std::free(thread_data.padded);
+    if (!d->grain_path.empty()) {
+        auto vi = get_video_info(vsapi->getVideoInfo(d->node));
+        if (auto error_message = write_grain(*d, vi); error_message) {
+            vsapi->logMessage(mtWarning, ("DFTTest: " + std::string(error_message)).c_str());
+        }
     }
 
+    vsapi->freeNode(d->node);
+
+    free_instance_buffers(*d);
+
     delete d;
 }
 
@@ -525,188 +328,376 @@ static void VS_CC DFTTestCreate(
     if (!isConstantFormat(vi)) {
         return set_error("only constant format input is supported");
     }
-    if (vi->format->sampleType == stInteger && vi->format->bytesPerSample > 2) {
-        return set_error("only 8-16 bit integer format input is supported");
-    }
-    if (vi->format->sampleType == stFloat && vi->format->bitsPerSample != 32) {
-        return set_error("only 32-bit float format input is supported");
-    }
 
-    int error;
+    auto args_in = get_args(in, vsapi);
 
-    d->radius = int64ToIntS(vsapi->propGetInt(in, "radius", 0, &error));
-    if (error) {
-        d->radius = 0;
+    DFTTestCoreArgs args;
+    if (auto error_message = parse_args(*d, args, args_in, get_video_info(vi)); error_message) {
+        return set_error(error_message);
     }
 
-    if (d->radius < 0 || d->radius > 3) {
-        return set_error("\"radius\" must be in [0, 1, 2, 3]");
-    }
+    VSCoreInfo info;
+    vsapi->getCoreInfo2(core, &info);
 
-    d->block_size = int64ToIntS(vsapi->propGetInt(in, "block_size", 0, &error));
-    if (error) {
-        d->block_size = 16;
-    }
+    // the video info is owned by the source node, unlike the node reference
+    auto key = make_registry_key(core, vi, *d, args, args_in);
 
-    if (d->block_size != 16) {
-        return set_error("\"block_size\" must be 16");
+    if (auto shared_data = find_instance(key); shared_data) {
+        // a second node on the data of the first instance
+        vsapi->freeNode(d->node);
+        vsapi->createFilter(
+            in, out, "DFTTest",
+            DFTTestInit, DFTTestGetFrame, DFTTestFree,
+            fmParallel,
+            0, static_cast<DFTTestData *>(shared_data), core
+        );
+        return ;
     }
 
-    d->block_step = int64ToIntS(vsapi->propGetInt(in, "block_step", 0, &error));
-    if (error) {
-        d->block_step = d->block_size;
+    if (auto error_message = init_instance(*d, args, get_video_info(vi), info.numThreads); error_message) {
+        return set_error(error_message);
     }
 
-    int num_planes_args = vsapi->propNumElements(in, "planes");
-    d->process.fill(num_planes_args <= 0);
-    for (int i = 0; i < num_planes_args; ++i) {
-        int plane = static_cast<int>(vsapi->propGetInt(in, "planes", i, nullptr));
+    d->frame_cache_size = info.numThreads;
+    register_instance(*d, std::move(key));
 
-        if (plane < 0 || plane >= vi->format->numPlanes) {
-            return set_error("plane index out of range");
-        }
+    vsapi->createFilter(
+        in, out, "DFTTest",
+        DFTTestInit, DFTTestGetFrame, DFTTestFree,
+        // frame n needs the state left by frame n - 1 in the recursive mode
+        d->core.recursive > 0.0f ? fmSerial : fmParallel,
+        0, d.release(), core
+    );
+}
 
-        if (d->process[plane]) {
-            return set_error("plane specified twice");
-        }
+struct DFTTestExportData : DFTTestSpectrumCache {
+    VSNodeRef * node;
+};
 
-        d->process[plane] = true;
+static void VS_CC DFTTestExportInit(
+    VSMap *in, VSMap *out, void **instanceData, VSNode *node,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<const DFTTestExportData *>(*instanceData);
+
+    auto vi = vsapi->getVideoInfo(d->node);
+    vsapi->setVideoInfo(vi, 1, node);
+}
+
+static const VSFrameRef *VS_CC DFTTestExportGetFrame(
+    int n, int activationReason, void **instanceData, void **frameData,
+    VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestExportData *>(*instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        return nullptr;
+    } else if (activationReason != arAllFramesReady) {
+        return nullptr;
     }
 
-    d->window = std::make_unique<Vec16f []>((2 * d->radius + 1) * d->block_size * d->block_size / 16);
-    {
-        auto window = vsapi->propGetFloatArray(in, "window", nullptr);
-        for (int i = 0; i < (2 * d->radius + 1) * d->block_size * d->block_size / 16; i++) {
-            d->window[i] = Vec16f(to_float(Vec8d().load(&window[i * 16])), to_float(Vec8d().load(&window[i * 16 + 8])));
+    auto vi = vsapi->getVideoInfo(d->node);
+    auto src_frame = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+    auto header = reinterpret_cast<SpectrumCacheHeader *>(d->file.data);
+
+    AlignedArray<uint8_t> padded;
+
+    for (int plane = 0; plane < vi->format->numPlanes; plane++) {
+        if (!d->process[plane]) {
+            continue;
         }
-    }
 
-    d->sigma = std::make_unique<Vec16f []>((2 * d->radius + 1) * d->block_size * ((d->block_size / 2 + 1 + 15) / 16));
-    {
-        auto sigma = vsapi->propGetFloatArray(in, "sigma", nullptr);
-        for (int i = 0; i < (2 * d->radius + 1) * d->block_size; i++) {
-            float sigma_padded[16] {};
-            for (int j = 0; j < d->block_size / 2 + 1; j++) {
-                sigma_padded[j] = static_cast<float>(sigma[i * (d->block_size / 2 + 1) + j]);
-            }
-            d->sigma[i] = Vec16f().load(&sigma_padded[0]);
+        int width = vsapi->getFrameWidth(src_frame, plane);
+        int height = vsapi->getFrameHeight(src_frame, plane);
+        int stride = vsapi->getStride(src_frame, plane) / vi->format->bytesPerSample;
+
+        if (!padded) {
+            padded = make_aligned_array<uint8_t>(
+                calc_pad_size(vi->height, d->core.block_size, d->core.block_step) *
+                calc_pad_stride(vi->width, d->core.block_size, d->core.block_step) *
+                vi->format->bytesPerSample
+            );
         }
+
+        reflection_padding(
+            padded.get(),
+            vsapi->getReadPtr(src_frame, plane),
+            width, height, stride,
+            d->core.block_size, d->core.block_step,
+            vi->format->bytesPerSample
+        );
+
+        export_plane(
+            &d->file.data[header->frames_offset + n * header->frame_size + header->plane_offsets[plane]],
+            padded.get(),
+            width, height,
+            vi->format->bitsPerSample,
+            d->half,
+            d->core
+        );
     }
 
-    d->sigma2 = static_cast<float>(vsapi->propGetFloat(in, "sigma2", 0, nullptr));
-    d->pmin = static_cast<float>(vsapi->propGetFloat(in, "pmin", 0, nullptr));
-    d->pmax = static_cast<float>(vsapi->propGetFloat(in, "pmax", 0, nullptr));
+    d->file.data[header->valid_offset + n] = 1;
 
-    d->filter_type = static_cast<int>(vsapi->propGetInt(in, "filter_type", 0, nullptr));
+    return src_frame;
+}
 
-    d->zero_mean = !!vsapi->propGetInt(in, "zero_mean", 0, &error);
-    if (error) {
-        d->zero_mean = true;
-    }
-    if (d->zero_mean) {
-        d->window_freq = std::make_unique<Vec16f []>((2 * d->radius + 1) * d->block_size * ((d->block_size / 2 + 1 + 15) / 16) * 2);
-        auto window_freq = vsapi->propGetFloatArray(in, "window_freq", nullptr);
-        for (int i = 0; i < (2 * d->radius + 1) * d->block_size; i++) {
-            float sigma_padded[32] {};
-            for (int j = 0; j < d->block_size / 2 + 1; j++) {
-                sigma_padded[j] = static_cast<float>(window_freq[(i * (d->block_size / 2 + 1) + j) * 2]);
-                sigma_padded[16 + j] = static_cast<float>(window_freq[(i * (d->block_size / 2 + 1) + j) * 2 + 1]);
-            }
-            d->window_freq[i * 2] = Vec16f().load(&sigma_padded[0]);
-            d->window_freq[i * 2 + 1] = Vec16f().load(&sigma_padded[16]);
-        }
-    }
+static void VS_CC DFTTestExportFree(
+    void *instanceData, VSCore *core, const VSAPI *vsapi
+) noexcept {
 
-    VSCoreInfo info;
-    vsapi->getCoreInfo2(core, &info);
-    d->num_uninitialized_threads.store(info.numThreads, std::memory_order::relaxed);
-    d->thread_data.reserve(info.numThreads);
+    auto d = static_cast<DFTTestExportData *>(instanceData);
 
-    vsapi->createFilter(
-        in, out, "DFTTest",
-        DFTTestInit, DFTTestGetFrame, DFTTestFree,
-        fmParallel, 0, d.release(), core
-    );
+    vsapi->freeNode(d->node);
+    unmap_file(d->file);
+
+    delete d;
 }
 
-static void VS_CC RDFT(
+static void VS_CC DFTTestExportCreate(
     const VSMap *in, VSMap *out, void *userData,
     VSCore *core, const VSAPI *vsapi
 ) noexcept {
 
-    auto set_error = [vsapi, out](const char * error_message) -> void {
+    auto d = std::make_unique<DFTTestExportData>();
+
+    d->node = vsapi->propGetNode(in, "clip", 0, nullptr);
+
+    auto set_error = [vsapi, out, &d](const char * error_message) -> void {
+        vsapi->freeNode(d->node);
+        unmap_file(d->file);
         vsapi->setError(out, error_message);
+        return ;
     };
 
-    int ndim = vsapi->propNumElements(in, "shape");
-    if (ndim != 1 && ndim != 2 && ndim != 3) {
-        return set_error("\"shape\" must be an array of ints with 1, 2 or 3 values");
+    auto vi = vsapi->getVideoInfo(d->node);
+    if (!isConstantFormat(vi) || vi->numFrames <= 0) {
+        return set_error("only constant format input with a known length is supported");
     }
 
-    std::array<int, 3> shape {};
-    {
-        auto shape_array = vsapi->propGetIntArray(in, "shape", nullptr);
-        for (int i = 0; i < ndim; i++) {
-            shape[i] = int64ToIntS(shape_array[i]);
-        }
+    if (auto error_message = init_export(*d, get_args(in, vsapi), get_video_info(vi)); error_message) {
+        return set_error(error_message);
     }
 
-    int size = 1;
-    for (int i = 0; i < ndim; i++) {
-        size *= shape[i];
-    }
-    if (vsapi->propNumElements(in, "data") != size) {
-        return set_error("cannot reshape array");
+    vsapi->createFilter(
+        in, out, "DFTTestExport",
+        DFTTestExportInit, DFTTestExportGetFrame, DFTTestExportFree,
+        fmParallel, 0, d.release(), core
+    );
+}
+
+struct DFTTestCachedData : DFTTestSpectrumCache {
+    VSNodeRef * node;
+};
+
+static void VS_CC DFTTestCachedInit(
+    VSMap *in, VSMap *out, void **instanceData, VSNode *node,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<const DFTTestCachedData *>(*instanceData);
+
+    auto vi = vsapi->getVideoInfo(d->node);
+    vsapi->setVideoInfo(vi, 1, node);
+}
+
+static const VSFrameRef *VS_CC DFTTestCachedGetFrame(
+    int n, int activationReason, void **instanceData, void **frameData,
+    VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestCachedData *>(*instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        return nullptr;
+    } else if (activationReason != arAllFramesReady) {
+        return nullptr;
     }
 
-    int complex_size = shape[ndim - 1] / 2 + 1;
-    for (int i = 0; i < ndim - 1; i++) {
-        complex_size *= shape[i];
+    auto vi = vsapi->getVideoInfo(d->node);
+    auto header = reinterpret_cast<const SpectrumCacheHeader *>(d->file.data);
+
+    std::array<int, 7> frame_indices;
+    for (int i = 0; i < 2 * d->core.radius + 1; i++) {
+        frame_indices[i] = std::clamp(n - d->core.radius + i, 0, vi->numFrames - 1);
+        if (!d->file.data[header->valid_offset + frame_indices[i]]) {
+            auto error_message = "frame " + std::to_string(frame_indices[i]) + " is missing from the spectrum cache";
+            vsapi->setFilterError(error_message.c_str(), frameCtx);
+            return nullptr;
+        }
     }
 
-    auto input = vsapi->propGetFloatArray(in, "data", nullptr);
+    std::unique_ptr<const VSFrameRef, decltype(vsapi->freeFrame)> src_frame {
+        vsapi->getFrameFilter(n, d->node, frameCtx),
+        vsapi->freeFrame
+    };
 
-    auto output = std::make_unique<std::complex<double> []>(complex_size);
+    auto format = vsapi->getFrameFormat(src_frame.get());
+
+    const VSFrameRef * fr[] {
+        d->process[0] ? nullptr : src_frame.get(),
+        d->process[1] ? nullptr : src_frame.get(),
+        d->process[2] ? nullptr : src_frame.get()
+    };
+    const int pl[] { 0, 1, 2 };
+    std::unique_ptr<VSFrameRef, decltype(vsapi->freeFrame)> dst_frame {
+        vsapi->newVideoFrame2(format, vi->width, vi->height, fr, pl, src_frame.get(), core),
+        vsapi->freeFrame
+    };
 
-    if (ndim == 1) {
-        dft(output.get(), input, size, 1);
-        vsapi->propSetFloatArray(out, "ret", (const double *) output.get(), complex_size * 2);
-    } else if (ndim == 2) {
-        for (int i = 0; i < shape[0]; i++) {
-            dft(&output[i * (shape[1] / 2 + 1)], &input[i * shape[1]], shape[1], 1);
+    AlignedArray<float> padded2;
+
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        if (!d->process[plane]) {
+            continue;
         }
 
-        auto output2 = std::make_unique<std::complex<double> []>(complex_size);
+        int width = vsapi->getFrameWidth(src_frame.get(), plane);
+        int height = vsapi->getFrameHeight(src_frame.get(), plane);
+        int stride = vsapi->getStride(dst_frame.get(), plane) / vi->format->bytesPerSample;
 
-        for (int i = 0; i < shape[1] / 2 + 1; i++) {
-            dft(&output2[i], &output[i], shape[0], shape[1] / 2 + 1);
+        if (!padded2) {
+            padded2 = make_aligned_array<float>(
+                calc_pad_size(vi->height, d->core.block_size, d->core.block_step) *
+                calc_pad_stride(vi->width, d->core.block_size, d->core.block_step)
+            );
         }
 
-        vsapi->propSetFloatArray(out, "ret", (const double *) output2.get(), complex_size * 2);
-    } else {
-        for (int i = 0; i < shape[0] * shape[1]; i++) {
-            dft(&output[i * (shape[2] / 2 + 1)], &input[i * shape[2]], shape[2], 1);
+        std::array<const void *, 7> srcps;
+        for (int i = 0; i < 2 * d->core.radius + 1; i++) {
+            srcps[i] = &d->file.data[header->frames_offset + frame_indices[i] * header->frame_size + header->plane_offsets[plane]];
         }
 
-        auto output2 = std::make_unique<std::complex<double> []>(complex_size);
+        filter_plane_cached(
+            padded2.get(),
+            srcps.data(),
+            d->slice_scales.data(),
+            width, height,
+            d->half,
+            d->core
+        );
 
-        for (int i = 0; i < shape[0]; i++) {
-            for (int j = 0; j < shape[2] / 2 + 1; j++) {
-                dft(
-                    &output2[i * shape[1] * (shape[2] / 2 + 1) + j],
-                    &output[i * shape[1] * (shape[2] / 2 + 1) + j],
-                    shape[1],
-                    (shape[2] / 2 + 1)
-                );
-            }
-        }
+        store_plane(
+            vsapi->getWritePtr(dst_frame.get(), plane),
+            padded2.get(),
+            width, height, stride,
+            vi->format->bitsPerSample,
+            d->core
+        );
+    }
 
-        for (int i = 0; i < shape[1] * (shape[2] / 2 + 1); i++) {
-            dft(&output[i], &output2[i], shape[0], shape[1] * (shape[2] / 2 + 1));
-        }
+    return dst_frame.release();
+}
+
+static void VS_CC DFTTestCachedFree(
+    void *instanceData, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestCachedData *>(instanceData);
+
+    vsapi->freeNode(d->node);
+    unmap_file(d->file);
 
-        vsapi->propSetFloatArray(out, "ret", (const double *) output.get(), complex_size * 2);
+    delete d;
+}
+
+static void VS_CC DFTTestCachedCreate(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = std::make_unique<DFTTestCachedData>();
+
+    d->node = vsapi->propGetNode(in, "clip", 0, nullptr);
+
+    auto set_error = [vsapi, out, &d](const char * error_message) -> void {
+        vsapi->freeNode(d->node);
+        unmap_file(d->file);
+        vsapi->setError(out, error_message);
+        return ;
+    };
+
+    // the format is compared with that of the cache once it is validated
+    auto vi = vsapi->getVideoInfo(d->node);
+    PluginVideoInfo video_info;
+    const PluginVideoInfo * clip_info = nullptr;
+    if (isConstantFormat(vi)) {
+        video_info = get_video_info(vi);
+        clip_info = &video_info;
+    }
+
+    if (auto error_message = init_cached(*d, get_args(in, vsapi), clip_info); error_message) {
+        return set_error(error_message);
+    }
+
+    vsapi->createFilter(
+        in, out, "DFTTestCached",
+        DFTTestCachedInit, DFTTestCachedGetFrame, DFTTestCachedFree,
+        fmParallel, 0, d.release(), core
+    );
+}
+
+static void VS_CC RDFT(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    std::unique_ptr<std::complex<double> []> output;
+    int complex_size;
+    if (auto error_message = rdft(output, complex_size, get_args(in, vsapi)); error_message) {
+        vsapi->setError(out, error_message);
+        return ;
     }
+
+    vsapi->propSetFloatArray(out, "ret", (const double *) output.get(), complex_size * 2);
+}
+
+static void VS_CC Estimate(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto set_error = [vsapi, out](const char * error_message) -> void {
+        vsapi->setError(out, error_message);
+    };
+
+    int width = int64ToIntS(vsapi->propGetInt(in, "width", 0, nullptr));
+    int height = int64ToIntS(vsapi->propGetInt(in, "height", 0, nullptr));
+    if (width <= 0 || height <= 0) {
+        return set_error("\"width\" and \"height\" must be positive");
+    }
+
+    auto format = vsapi->getFormatPreset(int64ToIntS(vsapi->propGetInt(in, "format", 0, nullptr)), core);
+    if (format == nullptr) {
+        return set_error("invalid format");
+    }
+
+    auto vi = get_format_info(format);
+    vi.width = width;
+    vi.height = height;
+
+    VSCoreInfo info;
+    vsapi->getCoreInfo2(core, &info);
+
+    DFTTestEstimate result;
+    if (auto error_message = estimate(result, get_args(in, vsapi), vi, info.numThreads); error_message) {
+        return set_error(error_message);
+    }
+
+    auto total_bytes = result.table_bytes + result.thread_bytes * result.num_threads;
+    vsapi->propSetInt(out, "thread_bytes", static_cast<int64_t>(result.thread_bytes), paReplace);
+    vsapi->propSetInt(out, "table_bytes", static_cast<int64_t>(result.table_bytes), paReplace);
+    vsapi->propSetInt(out, "total_bytes", static_cast<int64_t>(total_bytes), paReplace);
+    vsapi->propSetIntArray(out, "blocks", result.blocks.data(), format->numPlanes);
+    vsapi->propSetInt(out, "frame_blocks", result.frame_blocks, paReplace);
+    vsapi->propSetFloat(out, "block_seconds", result.block_seconds, paReplace);
+    vsapi->propSetFloat(out, "frame_seconds", result.frame_seconds, paReplace);
+    vsapi->propSetFloat(out, "fps", result.num_threads / result.frame_seconds, paReplace);
 }
 
 static void Version(const VSMap *, VSMap * out, void *, VSCore *, const VSAPI *vsapi) {
@@ -716,9 +707,15 @@ static void Version(const VSMap *, VSMap * out, void *, VSCore *, const VSAPI *v
 VS_EXTERNAL_API(void)
 VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc, VSPlugin *plugin) {
     configFunc(
+#ifdef DFTTEST2_PORTABLE
+        "io.github.amusementclub.dfttest2_cpu",
+        "dfttest2_cpu",
+        "DFTTest2 (portable)",
+#else
         "io.github.amusementclub.dfttest2_avx2",
         "dfttest2_avx2",
         "DFTTest2 (AVX2)",
+#endif
         VAPOURSYNTH_API_VERSION, 1, plugin
     );
 
@@ -736,10 +733,55 @@ VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc
         "block_step:int:opt;"
         "zero_mean:int:opt;"
         "window_freq:float[]:opt;"
-        "planes:int[]:opt;",
+        "planes:int[]:opt;"
+        "sparse_block_step:int:opt;"
+        "sparse_threshold:float:opt;"
+        "auto_sigma:int:opt;"
+        "lookahead:int:opt;"
+        "smode:int:opt;"
+        "motion_threshold:float:opt;"
+        "motion_window:float[]:opt;"
+        "downscale:int:opt;"
+        "recursive:float:opt;"
+        "exclude_borders:int:opt;"
+        "align:int:opt;"
+        "grain_table:data:opt;"
+        "grain_period:int:opt;"
+        "numa:int:opt;"
+        "perf:int:opt;"
+        "autotune:int:opt;",
         DFTTestCreate, nullptr, plugin
     );
 
+    registerFunc(
+        "DFTTestExport",
+        "clip:clip;"
+        "path:data;"
+        "window:float[];"
+        "radius:int:opt;"
+        "block_size:int:opt;"
+        "block_step:int:opt;"
+        "zero_mean:int:opt;"
+        "window_freq:float[]:opt;"
+        "planes:int[]:opt;"
+        "half:int:opt;",
+        DFTTestExportCreate, nullptr, plugin
+    );
+
+    registerFunc(
+        "DFTTestCached",
+        "clip:clip;"
+        "path:data;"
+        "sigma:float[];"
+        "sigma2:float;"
+        "pmin:float;"
+        "pmax:float;"
+        "filter_type:int;"
+        "window:float[]:opt;"
+        "planes:int[]:opt;",
+        DFTTestCachedCreate, nullptr, plugin
+    );
+
     registerFunc(
         "RDFT",
         "data:float[];"
@@ -747,6 +789,22 @@ VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegisterFunction registerFunc
         RDFT, nullptr, plugin
     );
 
+    registerFunc(
+        "Estimate",
+        "width:int;"
+        "height:int;"
+        "format:int;"
+        "radius:int:opt;"
+        "block_size:int:opt;"
+        "block_step:int:opt;"
+        "threads:int:opt;"
+        "filter_type:int:opt;"
+        "sparse_block_step:int:opt;"
+        "auto_sigma:int:opt;"
+        "smode:int:opt;",
+        Estimate, nullptr, plugin
+    );
+
     registerFunc(
         "Version",
         "",
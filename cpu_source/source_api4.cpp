@@ -0,0 +1,831 @@
+#include <algorithm>
+#include <array>
+#include <complex>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <VapourSynth4.h>
+#include <VSHelper4.h>
+
+#include "core.hpp"
+#include "mapped_file.hpp"
+#include "numa.hpp"
+#include "plugin.hpp"
+
+#include <config.h> // generated by cmake
+
+struct DFTTestData : DFTTestInstance {
+    VSNode * node;
+
+    // recent output frames while the instance is shared
+    std::mutex frame_cache_lock;
+    std::deque<std::pair<int, const VSFrame *>> frame_cache;
+    int frame_cache_size;
+};
+
+static PluginArgs get_args(const VSMap * in, const VSAPI * vsapi) {
+    return {
+        .get_int = [in, vsapi](const char * key, int index, int * error) {
+            return vsapi->mapGetInt(in, key, index, error);
+        },
+        .get_float = [in, vsapi](const char * key, int index, int * error) {
+            return vsapi->mapGetFloat(in, key, index, error);
+        },
+        .get_float_array = [in, vsapi](const char * key, int * error) {
+            return vsapi->mapGetFloatArray(in, key, error);
+        },
+        .get_data = [in, vsapi](const char * key, int * error) {
+            return vsapi->mapGetData(in, key, 0, error);
+        },
+        .num_elements = [in, vsapi](const char * key) {
+            return vsapi->mapNumElements(in, key);
+        }
+    };
+}
+
+static PluginVideoInfo get_format_info(const VSVideoFormat * format) {
+    PluginVideoInfo info {};
+    info.num_planes = format->numPlanes;
+    info.subsampling_w = format->subSamplingW;
+    info.subsampling_h = format->subSamplingH;
+    info.float_samples = format->sampleType == stFloat;
+    info.bits_per_sample = format->bitsPerSample;
+    info.bytes_per_sample = format->bytesPerSample;
+    return info;
+}
+
+// `vi` has a constant format
+static PluginVideoInfo get_video_info(const VSVideoInfo * vi) {
+    auto info = get_format_info(&vi->format);
+    info.width = vi->width;
+    info.height = vi->height;
+    info.num_frames = vi->numFrames;
+    info.fps_num = vi->fpsNum;
+    info.fps_den = vi->fpsDen;
+    return info;
+}
+
+// returns nullptr if frame `n` is not cached
+static const VSFrame * find_cached_frame(DFTTestData * d, int n, const VSAPI * vsapi) {
+    std::lock_guard _ { d->frame_cache_lock };
+    for (const auto & [i, frame] : d->frame_cache) {
+        if (i == n) {
+            return vsapi->addFrameRef(frame);
+        }
+    }
+    return nullptr;
+}
+
+static void cache_frame(DFTTestData * d, int n, const VSFrame * frame, const VSAPI * vsapi) {
+    std::lock_guard _ { d->frame_cache_lock };
+    d->frame_cache.emplace_back(n, vsapi->addFrameRef(frame));
+    if (static_cast<int>(d->frame_cache.size()) > d->frame_cache_size) {
+        vsapi->freeFrame(d->frame_cache.front().second);
+        d->frame_cache.pop_front();
+    }
+}
+
+static const VSFrame *VS_CC DFTTestGetFrame(
+    int n, int activationReason, void *instanceData, void **frameData,
+    VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestData *>(instanceData);
+
+    bool shared = d->num_instances.load(std::memory_order::relaxed) > 1;
+
+    if (activationReason == arInitial) {
+        if (shared) {
+            if (auto frame = find_cached_frame(d, n, vsapi); frame) {
+                return frame;
+            }
+        }
+
+        // frames [n - output_slice, n - output_slice + 2 * radius]
+        int first = n - d->core.output_slice;
+        int start = std::max(first, 0);
+        auto vi = vsapi->getVideoInfo(d->node);
+        int end = std::min(first + 2 * d->core.radius, vi->numFrames - 1);
+        for (int i = start; i <= end; i++) {
+            vsapi->requestFrameFilter(i, d->node, frameCtx);
+        }
+        return nullptr;
+    } else if (activationReason != arAllFramesReady) {
+        return nullptr;
+    }
+
+    auto vi = vsapi->getVideoInfo(d->node);
+
+    auto checkout = check_out_thread_data(*d, vi->width, vi->height, vi->format.bytesPerSample);
+    auto & thread_data = checkout.thread_data;
+    auto filter_core = checkout.core;
+
+    std::vector<std::unique_ptr<const VSFrame, decltype(vsapi->freeFrame)>> src_frames;
+    src_frames.reserve(2 * d->core.radius + 1);
+    for (int i = n - d->core.output_slice; i <= n - d->core.output_slice + 2 * d->core.radius; i++) {
+        src_frames.emplace_back(
+            vsapi->getFrameFilter(std::clamp(i, 0, vi->numFrames - 1), d->node, frameCtx),
+            vsapi->freeFrame
+        );
+    }
+
+    auto & src_center_frame = src_frames[d->core.output_slice];
+
+    std::unique_ptr<GrainStats []> grain_stats;
+    if (!d->grain_path.empty()) {
+        grain_stats = std::make_unique<GrainStats []>(3);
+    }
+
+    bool recursive_prior = false;
+    if (d->core.recursive > 0.0f) {
+        // on random access, the recursion restarts at frame n
+        recursive_prior = n > 0 && d->recursive_frame == n - 1;
+        d->recursive_frame = n;
+    }
+    auto format = vsapi->getVideoFrameFormat(src_center_frame.get());
+
+    const VSFrame * fr[] {
+        d->process[0] ? nullptr : src_center_frame.get(),
+        d->process[1] ? nullptr : src_center_frame.get(),
+        d->process[2] ? nullptr : src_center_frame.get()
+    };
+    const int pl[] { 0, 1, 2 };
+    std::unique_ptr<VSFrame, decltype(vsapi->freeFrame)> dst_frame {
+        vsapi->newVideoFrame2(
+            format,
+            d->core.downscale ? vi->width / 2 : vi->width,
+            d->core.downscale ? vi->height / 2 : vi->height,
+            fr, pl, src_center_frame.get(), core
+        ),
+        vsapi->freeFrame
+    };
+
+    PerfSession perf_session;
+    PerfSession * perf = nullptr;
+    if (d->perf) {
+        if (auto counters = get_thread_perf_counters(); counters) {
+            start_perf_session(perf_session, counters);
+            perf = &perf_session;
+        }
+    }
+
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        if (!d->process[plane]) {
+            continue;
+        }
+
+        int width = vsapi->getFrameWidth(src_center_frame.get(), plane);
+        int height = vsapi->getFrameHeight(src_center_frame.get(), plane);
+        int stride = static_cast<int>(vsapi->getStride(src_center_frame.get(), plane) / vi->format.bytesPerSample);
+
+        int padded_size_spatial = (
+            calc_pad_size(height, d->core.block_size, d->core.block_step) *
+            calc_pad_stride(width, d->core.block_size, d->core.block_step)
+        );
+
+        std::array<const uint8_t *, 7> srcps;
+        for (int i = 0; i < 2 * d->core.radius + 1; i++) {
+            auto srcp = vsapi->getReadPtr(src_frames[i].get(), plane);
+            srcps[i] = &thread_data.padded[(i * padded_size_spatial) * vi->format.bytesPerSample];
+            reflection_padding(
+                &thread_data.padded[(i * padded_size_spatial) * vi->format.bytesPerSample],
+                srcp,
+                width, height, stride,
+                d->core.block_size, d->core.block_step,
+                vi->format.bytesPerSample
+            );
+        }
+        if (perf) {
+            perf_mark(*perf, perf_padding);
+        }
+
+        filter_plane(
+            thread_data.padded2,
+            srcps.data(),
+            width, height,
+            vi->format.bitsPerSample,
+            *filter_core,
+            thread_data.workspace,
+            perf,
+            d->recursive_states[plane].get(),
+            recursive_prior
+        );
+
+        if (grain_stats) {
+            accumulate_grain(
+                grain_stats[plane],
+                thread_data.padded2,
+                srcps[d->core.output_slice],
+                width, height,
+                vi->format.bitsPerSample,
+                *filter_core
+            );
+        }
+
+        auto dstp = vsapi->getWritePtr(dst_frame.get(), plane);
+        store_plane(
+            dstp,
+            thread_data.padded2,
+            width, height,
+            static_cast<int>(vsapi->getStride(dst_frame.get(), plane) / vi->format.bytesPerSample),
+            vi->format.bitsPerSample,
+            *filter_core
+        );
+        if (perf) {
+            perf_mark(*perf, perf_store_frame);
+        }
+    }
+
+    if (perf) {
+        // [cycles, instructions, L1D read misses, LLC read misses] per stage
+        auto props = vsapi->getFramePropertiesRW(dst_frame.get());
+        for (int i = 0; i < perf_num_stages; i++) {
+            int64_t values[perf_num_events];
+            std::copy_n(perf->stages[i], perf_num_events, values);
+            vsapi->mapSetIntArray(props, ("DFTTestPerf" + std::string(perf_stage_names[i])).c_str(), values, perf_num_events);
+        }
+        vsapi->mapSetInt(props, "DFTTestPerfThread", perf->counters->thread_index, maReplace);
+    }
+
+    check_in_thread_data(checkout);
+
+    if (grain_stats) {
+        add_frame_grain(*d, n, grain_stats.get(), format->numPlanes);
+    }
+
+    if (shared) {
+        cache_frame(d, n, dst_frame.get(), vsapi);
+    }
+
+    return dst_frame.release();
+}
+
+static void VS_CC DFTTestFree(
+    void *instanceData, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestData *>(instanceData);
+
+    if (!release_instance(*d)) {
+        return ;
+    }
+
+    for (auto & [_, frame] : d->frame_cache) {
+        vsapi->freeFrame(frame);
+    }
+
+    if (!d->grain_path.empty()) {
+        auto vi = get_video_info(vsapi->getVideoInfo(d->node));
+        if (auto error_message = write_grain(*d, vi); error_message) {
+            vsapi->logMessage(mtWarning, ("DFTTest: " + std::string(error_message)).c_str(), core);
+        }
+    }
+
+    vsapi->freeNode(d->node);
+
+    free_instance_buffers(*d);
+
+    delete d;
+}
+
+static void VS_CC DFTTestCreate(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = std::make_unique<DFTTestData>();
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+
+    auto set_error = [vsapi, out, &d](const char * error_message) -> void {
+        vsapi->freeNode(d->node);
+        vsapi->mapSetError(out, error_message);
+        return ;
+    };
+
+    auto vi = vsapi->getVideoInfo(d->node);
+    if (!vsh::isConstantVideoFormat(vi)) {
+        return set_error("only constant format input is supported");
+    }
+
+    auto args_in = get_args(in, vsapi);
+
+    DFTTestCoreArgs args;
+    if (auto error_message = parse_args(*d, args, args_in, get_video_info(vi)); error_message) {
+        return set_error(error_message);
+    }
+
+    int error;
+    bool linear = !!vsapi->mapGetInt(in, "linear", 0, &error);
+    if (error) {
+        linear = false;
+    }
+
+    VSCoreInfo info;
+    vsapi->getCoreInfo(core, &info);
+
+    auto key = make_registry_key(core, d->node, *d, args, args_in);
+
+    // `downscale` halves the output dimensions
+    VSVideoInfo out_vi = *vi;
+    if (args.downscale) {
+        out_vi.width /= 2;
+        out_vi.height /= 2;
+    }
+
+    if (auto shared_data = static_cast<DFTTestData *>(find_instance(key)); shared_data) {
+        // a second node on the data of the first instance
+        vsapi->freeNode(d->node);
+
+        VSFilterDependency deps[] {
+            { shared_data->node, shared_data->core.radius == 0 ? rpStrictSpatial : rpGeneral }
+        };
+
+        auto node = vsapi->createVideoFilter2(
+            "DFTTest", &out_vi,
+            DFTTestGetFrame, DFTTestFree,
+            fmParallel,
+            deps, 1, shared_data, core
+        );
+
+        if (linear) {
+            vsapi->setLinearFilter(node);
+        }
+
+        vsapi->mapConsumeNode(out, "clip", node, maReplace);
+        return ;
+    }
+
+    if (auto error_message = init_instance(*d, args, get_video_info(vi), info.numThreads); error_message) {
+        return set_error(error_message);
+    }
+
+    d->frame_cache_size = info.numThreads;
+    register_instance(*d, std::move(key));
+
+    // frame n requests [n - radius, n + radius], so the frames of a
+    // temporal filter are shared by neighbouring requests
+    VSFilterDependency deps[] {
+        { d->node, d->core.radius == 0 ? rpStrictSpatial : rpGeneral }
+    };
+
+    auto node = vsapi->createVideoFilter2(
+        "DFTTest", &out_vi,
+        DFTTestGetFrame, DFTTestFree,
+        // frame n needs the state left by frame n - 1 in the recursive mode
+        d->core.recursive > 0.0f ? fmFrameState : fmParallel,
+        deps, 1, d.release(), core
+    );
+
+    if (linear) {
+        vsapi->setLinearFilter(node);
+    }
+
+    vsapi->mapConsumeNode(out, "clip", node, maReplace);
+}
+
+struct DFTTestExportData : DFTTestSpectrumCache {
+    VSNode * node;
+};
+
+static const VSFrame *VS_CC DFTTestExportGetFrame(
+    int n, int activationReason, void *instanceData, void **frameData,
+    VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestExportData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        return nullptr;
+    } else if (activationReason != arAllFramesReady) {
+        return nullptr;
+    }
+
+    auto vi = vsapi->getVideoInfo(d->node);
+    auto src_frame = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+    auto header = reinterpret_cast<SpectrumCacheHeader *>(d->file.data);
+
+    AlignedArray<uint8_t> padded;
+
+    for (int plane = 0; plane < vi->format.numPlanes; plane++) {
+        if (!d->process[plane]) {
+            continue;
+        }
+
+        int width = vsapi->getFrameWidth(src_frame, plane);
+        int height = vsapi->getFrameHeight(src_frame, plane);
+        int stride = static_cast<int>(vsapi->getStride(src_frame, plane) / vi->format.bytesPerSample);
+
+        if (!padded) {
+            padded = make_aligned_array<uint8_t>(
+                calc_pad_size(vi->height, d->core.block_size, d->core.block_step) *
+                calc_pad_stride(vi->width, d->core.block_size, d->core.block_step) *
+                vi->format.bytesPerSample
+            );
+        }
+
+        reflection_padding(
+            padded.get(),
+            vsapi->getReadPtr(src_frame, plane),
+            width, height, stride,
+            d->core.block_size, d->core.block_step,
+            vi->format.bytesPerSample
+        );
+
+        export_plane(
+            &d->file.data[header->frames_offset + n * header->frame_size + header->plane_offsets[plane]],
+            padded.get(),
+            width, height,
+            vi->format.bitsPerSample,
+            d->half,
+            d->core
+        );
+    }
+
+    d->file.data[header->valid_offset + n] = 1;
+
+    return src_frame;
+}
+
+static void VS_CC DFTTestExportFree(
+    void *instanceData, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestExportData *>(instanceData);
+
+    vsapi->freeNode(d->node);
+    unmap_file(d->file);
+
+    delete d;
+}
+
+static void VS_CC DFTTestExportCreate(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = std::make_unique<DFTTestExportData>();
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+
+    auto set_error = [vsapi, out, &d](const char * error_message) -> void {
+        vsapi->freeNode(d->node);
+        unmap_file(d->file);
+        vsapi->mapSetError(out, error_message);
+        return ;
+    };
+
+    auto vi = vsapi->getVideoInfo(d->node);
+    if (!vsh::isConstantVideoFormat(vi) || vi->numFrames <= 0) {
+        return set_error("only constant format input with a known length is supported");
+    }
+
+    if (auto error_message = init_export(*d, get_args(in, vsapi), get_video_info(vi)); error_message) {
+        return set_error(error_message);
+    }
+
+    VSFilterDependency deps[] { { d->node, rpStrictSpatial } };
+
+    vsapi->createVideoFilter(
+        out, "DFTTestExport", vi,
+        DFTTestExportGetFrame, DFTTestExportFree,
+        fmParallel, deps, 1, d.release(), core
+    );
+}
+
+struct DFTTestCachedData : DFTTestSpectrumCache {
+    VSNode * node;
+};
+
+static const VSFrame *VS_CC DFTTestCachedGetFrame(
+    int n, int activationReason, void *instanceData, void **frameData,
+    VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestCachedData *>(instanceData);
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+        return nullptr;
+    } else if (activationReason != arAllFramesReady) {
+        return nullptr;
+    }
+
+    auto vi = vsapi->getVideoInfo(d->node);
+    auto header = reinterpret_cast<const SpectrumCacheHeader *>(d->file.data);
+
+    std::array<int, 7> frame_indices;
+    for (int i = 0; i < 2 * d->core.radius + 1; i++) {
+        frame_indices[i] = std::clamp(n - d->core.radius + i, 0, vi->numFrames - 1);
+        if (!d->file.data[header->valid_offset + frame_indices[i]]) {
+            auto error_message = "frame " + std::to_string(frame_indices[i]) + " is missing from the spectrum cache";
+            vsapi->setFilterError(error_message.c_str(), frameCtx);
+            return nullptr;
+        }
+    }
+
+    std::unique_ptr<const VSFrame, decltype(vsapi->freeFrame)> src_frame {
+        vsapi->getFrameFilter(n, d->node, frameCtx),
+        vsapi->freeFrame
+    };
+
+    auto format = vsapi->getVideoFrameFormat(src_frame.get());
+
+    const VSFrame * fr[] {
+        d->process[0] ? nullptr : src_frame.get(),
+        d->process[1] ? nullptr : src_frame.get(),
+        d->process[2] ? nullptr : src_frame.get()
+    };
+    const int pl[] { 0, 1, 2 };
+    std::unique_ptr<VSFrame, decltype(vsapi->freeFrame)> dst_frame {
+        vsapi->newVideoFrame2(format, vi->width, vi->height, fr, pl, src_frame.get(), core),
+        vsapi->freeFrame
+    };
+
+    AlignedArray<float> padded2;
+
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        if (!d->process[plane]) {
+            continue;
+        }
+
+        int width = vsapi->getFrameWidth(src_frame.get(), plane);
+        int height = vsapi->getFrameHeight(src_frame.get(), plane);
+        int stride = static_cast<int>(vsapi->getStride(dst_frame.get(), plane) / vi->format.bytesPerSample);
+
+        if (!padded2) {
+            padded2 = make_aligned_array<float>(
+                calc_pad_size(vi->height, d->core.block_size, d->core.block_step) *
+                calc_pad_stride(vi->width, d->core.block_size, d->core.block_step)
+            );
+        }
+
+        std::array<const void *, 7> srcps;
+        for (int i = 0; i < 2 * d->core.radius + 1; i++) {
+            srcps[i] = &d->file.data[header->frames_offset + frame_indices[i] * header->frame_size + header->plane_offsets[plane]];
+        }
+
+        filter_plane_cached(
+            padded2.get(),
+            srcps.data(),
+            d->slice_scales.data(),
+            width, height,
+            d->half,
+            d->core
+        );
+
+        store_plane(
+            vsapi->getWritePtr(dst_frame.get(), plane),
+            padded2.get(),
+            width, height, stride,
+            vi->format.bitsPerSample,
+            d->core
+        );
+    }
+
+    return dst_frame.release();
+}
+
+static void VS_CC DFTTestCachedFree(
+    void *instanceData, VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = static_cast<DFTTestCachedData *>(instanceData);
+
+    vsapi->freeNode(d->node);
+    unmap_file(d->file);
+
+    delete d;
+}
+
+static void VS_CC DFTTestCachedCreate(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto d = std::make_unique<DFTTestCachedData>();
+
+    d->node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+
+    auto set_error = [vsapi, out, &d](const char * error_message) -> void {
+        vsapi->freeNode(d->node);
+        unmap_file(d->file);
+        vsapi->mapSetError(out, error_message);
+        return ;
+    };
+
+    // the format is compared with that of the cache once it is validated
+    auto vi = vsapi->getVideoInfo(d->node);
+    PluginVideoInfo video_info;
+    const PluginVideoInfo * clip_info = nullptr;
+    if (vsh::isConstantVideoFormat(vi)) {
+        video_info = get_video_info(vi);
+        clip_info = &video_info;
+    }
+
+    if (auto error_message = init_cached(*d, get_args(in, vsapi), clip_info); error_message) {
+        return set_error(error_message);
+    }
+
+    VSFilterDependency deps[] { { d->node, rpStrictSpatial } };
+
+    vsapi->createVideoFilter(
+        out, "DFTTestCached", vi,
+        DFTTestCachedGetFrame, DFTTestCachedFree,
+        fmParallel, deps, 1, d.release(), core
+    );
+}
+
+static void VS_CC RDFT(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    std::unique_ptr<std::complex<double> []> output;
+    int complex_size;
+    if (auto error_message = rdft(output, complex_size, get_args(in, vsapi)); error_message) {
+        vsapi->mapSetError(out, error_message);
+        return ;
+    }
+
+    vsapi->mapSetFloatArray(out, "ret", (const double *) output.get(), complex_size * 2);
+}
+
+static void VS_CC Estimate(
+    const VSMap *in, VSMap *out, void *userData,
+    VSCore *core, const VSAPI *vsapi
+) noexcept {
+
+    auto set_error = [vsapi, out](const char * error_message) -> void {
+        vsapi->mapSetError(out, error_message);
+    };
+
+    int width = vsh::int64ToIntS(vsapi->mapGetInt(in, "width", 0, nullptr));
+    int height = vsh::int64ToIntS(vsapi->mapGetInt(in, "height", 0, nullptr));
+    if (width <= 0 || height <= 0) {
+        return set_error("\"width\" and \"height\" must be positive");
+    }
+
+    VSVideoFormat video_format;
+    if (!vsapi->getVideoFormatByID(&video_format, static_cast<uint32_t>(vsapi->mapGetInt(in, "format", 0, nullptr)), core)) {
+        return set_error("invalid format");
+    }
+    auto format = &video_format;
+
+    auto vi = get_format_info(format);
+    vi.width = width;
+    vi.height = height;
+
+    VSCoreInfo info;
+    vsapi->getCoreInfo(core, &info);
+
+    DFTTestEstimate result;
+    if (auto error_message = estimate(result, get_args(in, vsapi), vi, info.numThreads); error_message) {
+        return set_error(error_message);
+    }
+
+    auto total_bytes = result.table_bytes + result.thread_bytes * result.num_threads;
+    vsapi->mapSetInt(out, "thread_bytes", static_cast<int64_t>(result.thread_bytes), maReplace);
+    vsapi->mapSetInt(out, "table_bytes", static_cast<int64_t>(result.table_bytes), maReplace);
+    vsapi->mapSetInt(out, "total_bytes", static_cast<int64_t>(total_bytes), maReplace);
+    vsapi->mapSetIntArray(out, "blocks", result.blocks.data(), format->numPlanes);
+    vsapi->mapSetInt(out, "frame_blocks", result.frame_blocks, maReplace);
+    vsapi->mapSetFloat(out, "block_seconds", result.block_seconds, maReplace);
+    vsapi->mapSetFloat(out, "frame_seconds", result.frame_seconds, maReplace);
+    vsapi->mapSetFloat(out, "fps", result.num_threads / result.frame_seconds, maReplace);
+}
+
+static void Version(const VSMap *, VSMap * out, void *, VSCore *, const VSAPI *vsapi) {
+    vsapi->mapSetData(out, "version", VERSION, -1, dtUtf8, maReplace);
+}
+
+VS_EXTERNAL_API(void)
+VapourSynthPluginInit2(VSPlugin *plugin, const VSPLUGINAPI *vspapi) {
+    vspapi->configPlugin(
+#ifdef DFTTEST2_PORTABLE
+        "io.github.amusementclub.dfttest2_cpu",
+        "dfttest2_cpu",
+        "DFTTest2 (portable)",
+#else
+        "io.github.amusementclub.dfttest2_avx2",
+        "dfttest2_avx2",
+        "DFTTest2 (AVX2)",
+#endif
+        VS_MAKE_VERSION(1, 0),
+        VAPOURSYNTH_API_VERSION,
+        0, plugin
+    );
+
+    vspapi->registerFunction(
+        "DFTTest",
+        "clip:vnode;"
+        "window:float[];"
+        "sigma:float[];"
+        "sigma2:float;"
+        "pmin:float;"
+        "pmax:float;"
+        "filter_type:int;"
+        "radius:int:opt;"
+        "block_size:int:opt;"
+        "block_step:int:opt;"
+        "zero_mean:int:opt;"
+        "window_freq:float[]:opt;"
+        "planes:int[]:opt;"
+        "sparse_block_step:int:opt;"
+        "sparse_threshold:float:opt;"
+        "auto_sigma:int:opt;"
+        "lookahead:int:opt;"
+        "smode:int:opt;"
+        "motion_threshold:float:opt;"
+        "motion_window:float[]:opt;"
+        "downscale:int:opt;"
+        "recursive:float:opt;"
+        "exclude_borders:int:opt;"
+        "align:int:opt;"
+        "grain_table:data:opt;"
+        "grain_period:int:opt;"
+        "numa:int:opt;"
+        "perf:int:opt;"
+        "autotune:int:opt;"
+        "linear:int:opt;",
+        "clip:vnode;",
+        DFTTestCreate, nullptr, plugin
+    );
+
+    vspapi->registerFunction(
+        "DFTTestExport",
+        "clip:vnode;"
+        "path:data;"
+        "window:float[];"
+        "radius:int:opt;"
+        "block_size:int:opt;"
+        "block_step:int:opt;"
+        "zero_mean:int:opt;"
+        "window_freq:float[]:opt;"
+        "planes:int[]:opt;"
+        "half:int:opt;",
+        "clip:vnode;",
+        DFTTestExportCreate, nullptr, plugin
+    );
+
+    vspapi->registerFunction(
+        "DFTTestCached",
+        "clip:vnode;"
+        "path:data;"
+        "sigma:float[];"
+        "sigma2:float;"
+        "pmin:float;"
+        "pmax:float;"
+        "filter_type:int;"
+        "window:float[]:opt;"
+        "planes:int[]:opt;",
+        "clip:vnode;",
+        DFTTestCachedCreate, nullptr, plugin
+    );
+
+    vspapi->registerFunction(
+        "RDFT",
+        "data:float[];"
+        "shape:int[];",
+        "ret:float[];",
+        RDFT, nullptr, plugin
+    );
+
+    vspapi->registerFunction(
+        "Estimate",
+        "width:int;"
+        "height:int;"
+        "format:int;"
+        "radius:int:opt;"
+        "block_size:int:opt;"
+        "block_step:int:opt;"
+        "threads:int:opt;"
+        "filter_type:int:opt;"
+        "sparse_block_step:int:opt;"
+        "auto_sigma:int:opt;"
+        "smode:int:opt;",
+        "thread_bytes:int;"
+        "table_bytes:int;"
+        "total_bytes:int;"
+        "blocks:int[];"
+        "frame_blocks:int;"
+        "block_seconds:float;"
+        "frame_seconds:float;"
+        "fps:float;",
+        Estimate, nullptr, plugin
+    );
+
+    vspapi->registerFunction(
+        "Version",
+        "",
+        "version:data;",
+        Version, nullptr, plugin
+    );
+}
@@ -0,0 +1,219 @@
+#ifndef TUNE_HPP
+#define TUNE_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+// On-disk database of autotuned parameters.
+//
+// Each line of the file holds a key and an integer value. A key starts with
+// the processor model, so a database shared between machines (e.g. through a
+// synced home directory) keeps separate entries for each of them. Later
+// entries of the same key take precedence. Nothing is stored on machines
+// that cannot be identified.
+
+#ifdef __linux__
+// "model name" of the first processor in /proc/cpuinfo, or its implementer
+// and part numbers on ARM, where there is no model name
+static inline std::string get_cpuinfo_name() {
+    auto file = std::fopen("/proc/cpuinfo", "r");
+    if (file == nullptr) {
+        return {};
+    }
+
+    std::string model;
+    std::string implementer;
+    std::string part;
+    char line[256];
+    while (std::fgets(line, sizeof(line), file)) {
+        auto colon = std::strchr(line, ':');
+        if (colon == nullptr) {
+            continue;
+        }
+
+        std::string key(line, colon);
+        while (!key.empty() && (key.back() == ' ' || key.back() == '\t')) {
+            key.pop_back();
+        }
+        std::string value(colon + 1 + std::strspn(colon + 1, " \t"));
+        while (!value.empty() && (value.back() == '\n' || value.back() == ' ')) {
+            value.pop_back();
+        }
+
+        if (key == "model name" && model.empty()) {
+            model = value;
+        } else if (key == "CPU implementer" && implementer.empty()) {
+            implementer = value;
+        } else if (key == "CPU part" && part.empty()) {
+            part = value;
+        }
+    }
+
+    std::fclose(file);
+
+    if (!model.empty()) {
+        return model;
+    }
+    if (!part.empty()) {
+        return "arm " + implementer + " " + part;
+    }
+    return {};
+}
+#endif
+
+// Processor brand string without spaces. Off x86, the model reported by the
+// operating system, and the host name if there is none. Empty if the machine
+// cannot be identified.
+static inline std::string get_cpu_name() {
+    char brand[49] {};
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned>(regs[0]) >= 0x80000004) {
+        for (int i = 0; i < 3; i++) {
+            __cpuid(regs, 0x80000002 + i);
+            std::memcpy(&brand[i * 16], regs, 16);
+        }
+    }
+#elif defined(__x86_64__) || defined(__i386__)
+    unsigned regs[4];
+    if (__get_cpuid(0x80000000, &regs[0], &regs[1], &regs[2], &regs[3]) && regs[0] >= 0x80000004) {
+        for (unsigned i = 0; i < 3; i++) {
+            __get_cpuid(0x80000002 + i, &regs[0], &regs[1], &regs[2], &regs[3]);
+            std::memcpy(&brand[i * 16], regs, 16);
+        }
+    }
+#elif defined(__linux__)
+    std::strncpy(brand, get_cpuinfo_name().c_str(), sizeof(brand) - 1);
+#elif defined(__APPLE__)
+    size_t size = sizeof(brand) - 1;
+    if (sysctlbyname("machdep.cpu.brand_string", brand, &size, nullptr, 0) != 0) {
+        brand[0] = '\0';
+    }
+#endif
+
+    if (brand[0] == '\0') {
+#ifdef _WIN32
+        DWORD size = sizeof(brand);
+        if (!GetComputerNameA(brand, &size)) {
+            brand[0] = '\0';
+        }
+#else
+        if (gethostname(brand, sizeof(brand) - 1) != 0) {
+            brand[0] = '\0';
+        }
+#endif
+    }
+
+    std::string name;
+    for (const char * p = brand; *p; p++) {
+        if (*p != ' ' || (!name.empty() && name.back() != '_')) {
+            name.push_back(*p == ' ' ? '_' : *p);
+        }
+    }
+    while (!name.empty() && name.back() == '_') {
+        name.pop_back();
+    }
+
+    return name;
+}
+
+// Path of the database, creating its directory if needed. Returns an empty
+// string if no suitable location exists.
+static inline std::string get_tune_path() {
+    std::string dir;
+
+#ifdef _WIN32
+    if (auto base = std::getenv("LOCALAPPDATA"); base && *base) {
+        dir = std::string(base) + "\\dfttest2";
+        CreateDirectoryA(dir.c_str(), nullptr);
+        return dir + "\\tune.txt";
+    }
+#else
+    if (auto base = std::getenv("XDG_CACHE_HOME"); base && *base) {
+        dir = base;
+    } else if (auto home = std::getenv("HOME"); home && *home) {
+        dir = std::string(home) + "/.cache";
+        mkdir(dir.c_str(), 0755);
+    }
+    if (!dir.empty()) {
+        dir += "/dfttest2";
+        mkdir(dir.c_str(), 0755);
+        return dir + "/tune.txt";
+    }
+#endif
+
+    return {};
+}
+
+// returns false if `key` is not in the database
+static inline bool load_tuned_value(const std::string & key, int & value) {
+    auto path = get_tune_path();
+    if (path.empty()) {
+        return false;
+    }
+
+    auto file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool found = false;
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        auto separator = std::strrchr(line, ' ');
+        if (separator == nullptr) {
+            continue;
+        }
+        if (static_cast<size_t>(separator - line) == key.size() &&
+            std::memcmp(line, key.data(), key.size()) == 0
+        ) {
+            value = std::atoi(separator + 1);
+            found = true;
+        }
+    }
+
+    std::fclose(file);
+    return found;
+}
+
+// Appends an entry. The line is written in one call to a file opened for
+// appending, so concurrent writers do not interleave.
+static inline void store_tuned_value(const std::string & key, int value) {
+    auto path = get_tune_path();
+    if (path.empty()) {
+        return ;
+    }
+
+    auto file = std::fopen(path.c_str(), "a");
+    if (file == nullptr) {
+        return ;
+    }
+
+    auto line = key + ' ' + std::to_string(value) + '\n';
+    std::fwrite(line.data(), 1, line.size(), file);
+    std::fclose(file);
+}
+
+#endif // TUNE_HPP
@@ -0,0 +1,572 @@
+// Y4M denoiser built on libdfttest2
+//
+// usage: dfttest2-y4m [options] [input.y4m|-] [output.y4m|-]
+//        dfttest2-y4m [options] --shm NAME [input.y4m|-]
+//        dfttest2-y4m --attach NAME [output.y4m|-]
+
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "dfttest2.h"
+#ifndef _WIN32
+#include "dfttest2_shm.h"
+#endif
+
+struct Y4MFormat {
+    std::string header; // without the trailing newline
+    DFTTest2Format format;
+    int plane_widths[3];
+    int plane_heights[3];
+    size_t plane_sizes[3]; // in bytes
+    int fps_num;
+    int fps_den;
+};
+
+static bool read_line(FILE * file, std::string & line) {
+    line.clear();
+    int c;
+    while ((c = std::fgetc(file)) != EOF && c != '\n') {
+        line.push_back(static_cast<char>(c));
+    }
+    return c == '\n';
+}
+
+// returns an error message on failure
+static const char * parse_header(Y4MFormat & y4m, FILE * file) {
+    if (!read_line(file, y4m.header) || y4m.header.compare(0, 10, "YUV4MPEG2 ") != 0) {
+        return "not a YUV4MPEG2 stream";
+    }
+
+    auto & format = y4m.format;
+    format = {};
+    format.num_planes = 3;
+    format.subsampling_w = 1;
+    format.subsampling_h = 1;
+    format.sample_type = DFTTEST2_INTEGER;
+    format.bits_per_sample = 8;
+    y4m.fps_num = 0;
+    y4m.fps_den = 1;
+
+    for (size_t pos = 10; pos < y4m.header.size(); ) {
+        size_t end = y4m.header.find(' ', pos);
+        if (end == std::string::npos) {
+            end = y4m.header.size();
+        }
+        std::string token = y4m.header.substr(pos, end - pos);
+        pos = end + 1;
+
+        if (token.empty()) {
+            continue;
+        }
+
+        if (token[0] == 'W') {
+            format.width = std::atoi(&token[1]);
+        } else if (token[0] == 'H') {
+            format.height = std::atoi(&token[1]);
+        } else if (token[0] == 'F') {
+            auto colon = token.find(':');
+            if (colon != std::string::npos) {
+                y4m.fps_num = std::atoi(&token[1]);
+                y4m.fps_den = std::atoi(&token[colon + 1]);
+            }
+        } else if (token[0] == 'I') {
+            if (token != "Ip" && token != "I?") {
+                return "only progressive input is supported";
+            }
+        } else if (token[0] == 'C') {
+            std::string colorspace = token.substr(1);
+
+            auto p = colorspace.find('p');
+            if (colorspace.compare(0, 4, "mono") == 0) {
+                format.num_planes = 1;
+                format.bits_per_sample = colorspace.size() > 4 ? std::atoi(&colorspace[4]) : 8;
+            } else {
+                if (colorspace.compare(0, 3, "420") == 0) {
+                    format.subsampling_w = format.subsampling_h = 1;
+                } else if (colorspace.compare(0, 3, "422") == 0) {
+                    format.subsampling_w = 1;
+                    format.subsampling_h = 0;
+                } else if (colorspace.compare(0, 3, "444") == 0) {
+                    format.subsampling_w = format.subsampling_h = 0;
+                } else {
+                    return "unsupported colorspace";
+                }
+
+                if (colorspace.size() > 3 && colorspace[3] == 'p' && p != std::string::npos) {
+                    format.bits_per_sample = std::atoi(&colorspace[p + 1]);
+                } else if (colorspace.size() > 3 && colorspace.compare(3, std::string::npos, "jpeg") != 0 &&
+                    colorspace.compare(3, std::string::npos, "paldv") != 0 &&
+                    colorspace.compare(3, std::string::npos, "mpeg2") != 0
+                ) {
+                    return "unsupported colorspace";
+                }
+            }
+
+            if (format.bits_per_sample < 8 || format.bits_per_sample > 16) {
+                return "unsupported bit depth";
+            }
+        }
+    }
+
+    if (format.width <= 0 || format.height <= 0) {
+        return "missing frame dimensions";
+    }
+    if (format.width % (1 << format.subsampling_w) || format.height % (1 << format.subsampling_h)) {
+        return "frame dimensions must be divisible by the chroma subsampling";
+    }
+
+    int bytes_per_sample = (format.bits_per_sample + 7) / 8;
+    for (int plane = 0; plane < format.num_planes; plane++) {
+        y4m.plane_widths[plane] = plane ? format.width >> format.subsampling_w : format.width;
+        y4m.plane_heights[plane] = plane ? format.height >> format.subsampling_h : format.height;
+        y4m.plane_sizes[plane] = static_cast<size_t>(y4m.plane_widths[plane]) * y4m.plane_heights[plane] * bytes_per_sample;
+    }
+
+    return nullptr;
+}
+
+static void usage() {
+    std::fprintf(stderr,
+        "usage: dfttest2-y4m [options] [input|-] [output|-]\n"
+#ifndef _WIN32
+        "       dfttest2-y4m [options] --shm NAME [input|-]\n"
+        "       dfttest2-y4m --attach NAME [output|-]\n"
+#endif
+        "\n"
+        "options (see dfttest2.DFTTest for their meaning):\n"
+        "  --ftype N          --sigma X          --sigma2 X\n"
+        "  --pmin X           --pmax X           --sbsize N\n"
+        "  --sosize N         --tbsize N         --swin N\n"
+        "  --twin N           --sbeta X          --tbeta X\n"
+        "  --zmean N          --f0beta X         --planes MASK\n"
+        "  --flat-sosize N    --flat-threshold X\n"
+        "  --auto-sigma X     --lookahead N      --autotune N\n"
+        "  --smode N          --motion-threshold X --recursive X\n"
+        "  --exclude-borders N --align N         --threads N\n"
+        "\n"
+        "  --grain-table PATH write an AV1 film grain table of the removed noise\n"
+        "  --grain-period N   frames per entry of the table (default 0, one entry)\n"
+#ifndef _WIN32
+        "\n"
+        "  --shm NAME         publish the output frames into a shared memory ring\n"
+        "  --shm-slots N      number of frames in the ring (default 8)\n"
+        "  --shm-consumers N  number of processes reading the ring (default 1)\n"
+        "  --attach NAME      write the frames of a shared memory ring as y4m\n"
+#endif
+    );
+}
+
+#ifndef _WIN32
+// writes the frames published by another dfttest2-y4m process
+static int run_client(const char * name, FILE * output) {
+    // detaches properly when the encoder reading the output exits
+    std::signal(SIGPIPE, SIG_IGN);
+
+    char error[256];
+    auto shm = dfttest2_shm_attach(name, error, sizeof error);
+    if (shm == nullptr) {
+        std::fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    DFTTest2Format format;
+    dfttest2_shm_get_format(shm, &format);
+    int bytes_per_sample = (format.bits_per_sample + 7) / 8;
+
+    bool write_error = std::fprintf(output, "%s\n", dfttest2_shm_get_tag(shm)) < 0;
+
+    DFTTest2ShmFrame frame;
+    int ret = DFTTEST2_OK;
+    while (!write_error && (ret = dfttest2_shm_acquire(shm, &frame, 1)) == DFTTEST2_OK) {
+        write_error = std::fputs("FRAME\n", output) == EOF;
+
+        for (int plane = 0; plane < format.num_planes && !write_error; plane++) {
+            int width = plane ? format.width >> format.subsampling_w : format.width;
+            int height = plane ? format.height >> format.subsampling_h : format.height;
+            size_t row_size = static_cast<size_t>(width) * bytes_per_sample;
+
+            auto src = static_cast<const uint8_t *>(frame.planes[plane]);
+            for (int y = 0; y < height; y++) {
+                if (std::fwrite(&src[y * frame.strides[plane]], 1, row_size, output) != row_size) {
+                    write_error = true;
+                    break;
+                }
+            }
+        }
+
+        dfttest2_shm_release(shm, &frame);
+    }
+
+    dfttest2_shm_close(shm);
+
+    if (!write_error && ret != DFTTEST2_EOF) {
+        std::fprintf(stderr, "the server exited before the end of the clip\n");
+        return 1;
+    }
+    if (std::fflush(output) != 0 || write_error) {
+        std::fprintf(stderr, "write error\n");
+        return 1;
+    }
+
+    return 0;
+}
+#endif
+
+int main(int argc, char ** argv) {
+    DFTTest2Params params;
+    dfttest2_params_init(&params);
+
+    std::vector<const char *> paths;
+
+    const char * shm_name = nullptr;
+    const char * attach_name = nullptr;
+    int shm_slots = 8;
+    int shm_consumers = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else if (arg == "--version") {
+            std::printf("%s\n", dfttest2_version());
+            return 0;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            if (i + 1 >= argc) {
+                usage();
+                return 1;
+            }
+            const char * value = argv[++i];
+
+            if (arg == "--ftype") {
+                params.ftype = std::atoi(value);
+            } else if (arg == "--sigma") {
+                params.sigma = std::strtof(value, nullptr);
+            } else if (arg == "--sigma2") {
+                params.sigma2 = std::strtof(value, nullptr);
+            } else if (arg == "--pmin") {
+                params.pmin = std::strtof(value, nullptr);
+            } else if (arg == "--pmax") {
+                params.pmax = std::strtof(value, nullptr);
+            } else if (arg == "--sbsize") {
+                params.sbsize = std::atoi(value);
+            } else if (arg == "--sosize") {
+                params.sosize = std::atoi(value);
+            } else if (arg == "--tbsize") {
+                params.tbsize = std::atoi(value);
+            } else if (arg == "--swin") {
+                params.swin = std::atoi(value);
+            } else if (arg == "--twin") {
+                params.twin = std::atoi(value);
+            } else if (arg == "--sbeta") {
+                params.sbeta = std::strtof(value, nullptr);
+            } else if (arg == "--tbeta") {
+                params.tbeta = std::strtof(value, nullptr);
+            } else if (arg == "--zmean") {
+                params.zmean = std::atoi(value);
+            } else if (arg == "--f0beta") {
+                params.f0beta = std::strtof(value, nullptr);
+            } else if (arg == "--planes") {
+                params.planes = static_cast<int>(std::strtol(value, nullptr, 0));
+            } else if (arg == "--flat-sosize") {
+                params.flat_sosize = std::atoi(value);
+            } else if (arg == "--flat-threshold") {
+                params.flat_threshold = std::strtof(value, nullptr);
+            } else if (arg == "--auto-sigma") {
+                params.auto_sigma = std::strtof(value, nullptr);
+            } else if (arg == "--lookahead") {
+                params.lookahead = std::atoi(value);
+            } else if (arg == "--motion-threshold") {
+                params.motion_threshold = std::strtof(value, nullptr);
+            } else if (arg == "--recursive") {
+                params.recursive = std::strtof(value, nullptr);
+            } else if (arg == "--exclude-borders") {
+                params.exclude_borders = std::atoi(value);
+            } else if (arg == "--align") {
+                params.align = std::atoi(value);
+            } else if (arg == "--grain-table") {
+                params.grain_table = value;
+            } else if (arg == "--grain-period") {
+                params.grain_period = std::atoi(value);
+            } else if (arg == "--autotune") {
+                params.autotune = std::atoi(value);
+            } else if (arg == "--smode") {
+                params.smode = std::atoi(value);
+            } else if (arg == "--threads") {
+                params.num_threads = std::atoi(value);
+#ifndef _WIN32
+            } else if (arg == "--shm") {
+                shm_name = value;
+            } else if (arg == "--shm-slots") {
+                shm_slots = std::atoi(value);
+            } else if (arg == "--shm-consumers") {
+                shm_consumers = std::atoi(value);
+            } else if (arg == "--attach") {
+                attach_name = value;
+#endif
+            } else {
+                std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+                return 1;
+            }
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    // a client has no input, and a server has no output
+    bool has_input = attach_name == nullptr;
+    bool has_output = shm_name == nullptr;
+    if (paths.size() > static_cast<size_t>(has_input + has_output)) {
+        usage();
+        return 1;
+    }
+    const char * input_path = has_input && paths.size() > 0 ? paths[0] : "-";
+    const char * output_path = has_output && paths.size() > static_cast<size_t>(has_input) ? paths[has_input] : "-";
+
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    FILE * output = std::strcmp(output_path, "-") ? std::fopen(output_path, "wb") : stdout;
+    if (output == nullptr) {
+        std::fprintf(stderr, "cannot open %s\n", output_path);
+        return 1;
+    }
+
+#ifndef _WIN32
+    if (attach_name) {
+        int ret = run_client(attach_name, output);
+        if (output != stdout) {
+            std::fclose(output);
+        }
+        return ret;
+    }
+#endif
+
+    FILE * input = std::strcmp(input_path, "-") ? std::fopen(input_path, "rb") : stdin;
+    if (input == nullptr) {
+        std::fprintf(stderr, "cannot open %s\n", input_path);
+        return 1;
+    }
+
+    Y4MFormat y4m {};
+    if (auto error_message = parse_header(y4m, input); error_message) {
+        std::fprintf(stderr, "%s\n", error_message);
+        return 1;
+    }
+
+    if (y4m.format.num_planes == 1) {
+        params.planes &= 1;
+    }
+    params.fps_num = y4m.fps_num;
+    params.fps_den = y4m.fps_den;
+
+    char error[256];
+    auto d = dfttest2_create(&params, &y4m.format, error, sizeof error);
+    if (d == nullptr) {
+        std::fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+#ifndef _WIN32
+    DFTTest2Shm * shm = nullptr;
+    if (shm_name) {
+        shm = dfttest2_shm_create(
+            shm_name, &y4m.format, shm_slots, shm_consumers,
+            y4m.header.c_str(), error, sizeof error
+        );
+        if (shm == nullptr) {
+            dfttest2_free(d);
+            std::fprintf(stderr, "%s\n", error);
+            return 1;
+        }
+    }
+#endif
+
+    // the reader waits for pulls when the denoiser is full, and the writer
+    // waits for pushes when the next frame needs more input
+    std::mutex lock;
+    std::condition_variable cond;
+    long long num_pushes = 0;
+    long long num_pulls = 0;
+    bool reader_done = false;
+    const char * read_error = nullptr;
+
+    auto reader = std::thread([&] {
+        std::vector<uint8_t> buffer(y4m.plane_sizes[0] + y4m.plane_sizes[1] + y4m.plane_sizes[2]);
+        const void * planes[3];
+        ptrdiff_t strides[3];
+        size_t offset = 0;
+        for (int plane = 0; plane < y4m.format.num_planes; plane++) {
+            planes[plane] = &buffer[offset];
+            strides[plane] = static_cast<ptrdiff_t>(y4m.plane_sizes[plane] / y4m.plane_heights[plane]);
+            offset += y4m.plane_sizes[plane];
+        }
+
+        std::string line;
+        while (read_line(input, line)) {
+            if (line.compare(0, 5, "FRAME") != 0) {
+                read_error = "bad frame header";
+                break;
+            }
+            if (std::fread(buffer.data(), 1, offset, input) != offset) {
+                read_error = "truncated frame";
+                break;
+            }
+
+            int ret;
+            while (true) {
+                long long pulls;
+                {
+                    std::lock_guard guard { lock };
+                    pulls = num_pulls;
+                }
+
+                ret = dfttest2_push(d, planes, strides);
+                if (ret != DFTTEST2_AGAIN) {
+                    break;
+                }
+
+                std::unique_lock guard { lock };
+                cond.wait(guard, [&] { return num_pulls != pulls; });
+            }
+            if (ret != DFTTEST2_OK) {
+                read_error = "cannot push frame";
+                break;
+            }
+
+            {
+                std::lock_guard guard { lock };
+                num_pushes++;
+            }
+            cond.notify_all();
+        }
+
+        dfttest2_finish(d);
+
+        {
+            std::lock_guard guard { lock };
+            reader_done = true;
+        }
+        cond.notify_all();
+    });
+
+    std::vector<uint8_t> buffer(y4m.plane_sizes[0] + y4m.plane_sizes[1] + y4m.plane_sizes[2]);
+    void * planes[3];
+    ptrdiff_t strides[3];
+    size_t offset = 0;
+    for (int plane = 0; plane < y4m.format.num_planes; plane++) {
+        planes[plane] = &buffer[offset];
+        strides[plane] = static_cast<ptrdiff_t>(y4m.plane_sizes[plane] / y4m.plane_heights[plane]);
+        offset += y4m.plane_sizes[plane];
+    }
+
+    bool write_error = false;
+    bool grain_error = false;
+#ifndef _WIN32
+    if (shm == nullptr)
+#endif
+    {
+        std::fprintf(output, "%s\n", y4m.header.c_str());
+    }
+    while (true) {
+        long long pushes;
+        bool done;
+        {
+            std::lock_guard guard { lock };
+            pushes = num_pushes;
+            done = reader_done;
+        }
+
+#ifndef _WIN32
+        // filters directly into the next slot of the ring
+        if (shm && dfttest2_shm_begin_write(shm, planes, strides, 1) != DFTTEST2_OK) {
+            break;
+        }
+#endif
+
+        int ret = dfttest2_pull(d, planes, strides, 1);
+        if (ret == DFTTEST2_EOF) {
+            break;
+        } else if (ret == DFTTEST2_AGAIN) {
+            // retry unconditionally once the reader has finished
+            if (!done) {
+                std::unique_lock guard { lock };
+                cond.wait(guard, [&] { return num_pushes != pushes || reader_done; });
+            }
+            continue;
+        } else if (ret != DFTTEST2_OK) {
+            // only the grain table is written at the end of the clip
+            grain_error = params.grain_table != nullptr;
+            break;
+        }
+
+        {
+            std::lock_guard guard { lock };
+            num_pulls++;
+        }
+        cond.notify_all();
+
+#ifndef _WIN32
+        if (shm) {
+            dfttest2_shm_end_write(shm);
+            continue;
+        }
+#endif
+
+        if (!write_error && (
+            std::fputs("FRAME\n", output) == EOF ||
+            std::fwrite(buffer.data(), 1, offset, output) != offset
+        )) {
+            // keep pulling so that the reader is not blocked
+            write_error = true;
+        }
+    }
+
+    reader.join();
+#ifndef _WIN32
+    // waits until every consumer has read the clip
+    dfttest2_shm_close(shm);
+#endif
+    dfttest2_free(d);
+
+    if (std::fflush(output) != 0) {
+        write_error = true;
+    }
+    if (input != stdin) {
+        std::fclose(input);
+    }
+    if (output != stdout) {
+        std::fclose(output);
+    }
+
+    if (read_error) {
+        std::fprintf(stderr, "%s\n", read_error);
+        return 1;
+    }
+    if (write_error) {
+        std::fprintf(stderr, "write error\n");
+        return 1;
+    }
+    if (grain_error) {
+        std::fprintf(stderr, "cannot write %s\n", params.grain_table);
+        return 1;
+    }
+
+    return 0;
+}
@@ -9,7 +9,7 @@ import vapoursynth as vs
 from vapoursynth import core
 
 
-__all__ = ["DFTTest", "DFTTest2", "Backend"]
+__all__ = ["DFTTest", "DFTTest2", "ExportSpectra", "Backend", "process"]
 
 
 class Backend:
@@ -25,7 +25,9 @@ class Backend:
 
     @dataclass(frozen=False)
     class CPU:
-        pass
+        numa: bool = False
+        perf: bool = False
+        autotune: bool = False
 
 backendT = typing.Union[Backend.cuFFT, Backend.NVRTC, Backend.CPU]
 
@@ -40,6 +42,13 @@ def init_backend(backend: backendT) -> backendT:
     return backend
 
 
+def cpu_plugin() -> vs.Plugin:
+    # the portable build of the CPU backend is used where the x86 one is absent
+    if hasattr(core, "dfttest2_avx2"):
+        return core.dfttest2_avx2
+    return core.dfttest2_cpu
+
+
 # https://github.com/HomeOfVapourSynthEvolution/VapourSynth-DFTTest/blob/
 # bc5e0186a7f309556f20a8e9502f2238e39179b8/DFTTest/DFTTest.cpp#L518
 def normalize(
@@ -139,13 +148,21 @@ def get_window(
     spatial_window_mode: int,
     spatial_beta: float,
     temporal_window_mode: int,
-    temporal_beta: float
+    temporal_beta: float,
+    lookahead: typing.Optional[int] = None
 ) -> typing.List[float]:
 
+    # the temporal window peaks at the output frame, which is the centre
+    # one unless the temporal block is asymmetric
+    if lookahead is None:
+        lookahead = radius
+    output_slice = 2 * radius - lookahead
+    window_radius = max(output_slice, lookahead)
+
     temporal_window = [
         get_window_value(
-            location = i + 0.5,
-            size = 2 * radius + 1,
+            location = i - output_slice + window_radius + 0.5,
+            size = 2 * window_radius + 1,
             mode = temporal_window_mode,
             beta = temporal_beta
         ) for i in range(2 * radius + 1)
@@ -209,6 +226,48 @@ def get_sigma(
         return func(get_location(position, length))
 
 
+# shape: (2 * radius + 1, block_size, block_size // 2 + 1)
+def get_sigma_array(
+    sigma: typing.Sequence[typing.Callable[[float], float]],
+    ssystem: typing.Literal[0, 1],
+    radius: int,
+    block_size: int
+) -> typing.List[float]:
+
+    sigma_funcs = sigma
+    if callable(sigma_funcs):
+        sigma_funcs = [sigma_funcs]
+    else:
+        sigma_funcs = list(sigma_funcs)
+    sigma_funcs.extend([sigma_funcs[-1]] * 3)
+    sigma_func_x, sigma_func_y, sigma_func_t = sigma_funcs[:3]
+
+    sigma_array = []
+
+    if ssystem == 0:
+        for t in range(2 * radius + 1):
+            sigma_t = get_sigma(position=t, length=2*radius+1, func=sigma_func_t)
+            for y in range(block_size):
+                sigma_y = get_sigma(position=y, length=block_size, func=sigma_func_y)
+                for x in range(block_size // 2 + 1):
+                    sigma_x = get_sigma(position=x, length=block_size, func=sigma_func_x)
+
+                    sigma_array.append(sigma_t * sigma_y * sigma_x)
+    else:
+        for t in range(2 * radius + 1):
+            loc_t = get_location(position=t, length=2*radius+1)
+            for y in range(block_size):
+                loc_y = get_location(position=y, length=block_size)
+                for x in range(block_size // 2 + 1):
+                    loc_x = get_location(position=x, length=block_size)
+
+                    ndim = 3 if radius > 0 else 2
+                    location = math.sqrt((loc_t * loc_t + loc_y * loc_y + loc_x * loc_x) / ndim)
+                    sigma_array.append(sigma_func_t(location))
+
+    return sigma_array
+
+
 def DFTTest2(
     clip: vs.VideoNode,
     ftype: typing.Literal[0, 1, 2, 3, 4] = 0,
@@ -227,7 +286,20 @@ def DFTTest2(
     f0beta: float = 1.0,
     ssystem: typing.Literal[0, 1] = 0,
     planes: typing.Optional[typing.Union[int, typing.Sequence[int]]] = None,
-    backend: backendT = Backend.cuFFT()
+    backend: backendT = Backend.cuFFT(),
+    flat_sosize: typing.Optional[int] = None,
+    flat_threshold: float = 64.0,
+    spectrum_cache: typing.Optional[str] = None,
+    auto_sigma: typing.Optional[float] = None,
+    lookahead: typing.Optional[int] = None,
+    smode: typing.Literal[0, 1] = 1,
+    motion_threshold: typing.Optional[float] = None,
+    downscale: bool = False,
+    recursive: typing.Optional[float] = None,
+    exclude_borders: bool = False,
+    align: int = 0,
+    grain_table: typing.Optional[str] = None,
+    grain_period: int = 0
 ) -> vs.VideoNode:
     """ this interface is not stable """
 
@@ -244,7 +316,8 @@ def DFTTest2(
 
     radius = (tbsize - 1) // 2
     block_size = sbsize
-    block_step = sbsize - sosize
+    # every sample is the centre of its own block in smode 0
+    block_step = 1 if smode == 0 else sbsize - sosize
     spatial_window_mode = swin
     temporal_window_mode = twin
     spatial_beta = sbeta
@@ -258,6 +331,106 @@ def DFTTest2(
         if block_size != 16:
             raise ValueError("invalid block_size (sbsize)")
 
+    if flat_sosize is not None and not isinstance(backend, Backend.CPU):
+        raise ValueError('"flat_sosize" requires the CPU backend')
+
+    if spectrum_cache is not None:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"spectrum_cache" requires the CPU backend')
+        if flat_sosize is not None:
+            raise ValueError('"spectrum_cache" cannot be used with "flat_sosize"')
+
+    if auto_sigma is not None:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"auto_sigma" requires the CPU backend')
+        if spectrum_cache is not None:
+            raise ValueError('"auto_sigma" cannot be used with "spectrum_cache"')
+        if ftype >= 2:
+            raise ValueError('"auto_sigma" requires ftype 0 or 1')
+
+    if lookahead is not None:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"lookahead" requires the CPU backend')
+        if spectrum_cache is not None:
+            raise ValueError('"lookahead" cannot be used with "spectrum_cache"')
+        if lookahead not in range(2 * radius + 1):
+            raise ValueError('"lookahead" must be in [0, tbsize - 1]')
+
+    if smode == 0:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('smode=0 requires the CPU backend')
+        if flat_sosize is not None or spectrum_cache is not None:
+            raise ValueError('smode=0 cannot be used with "flat_sosize" or "spectrum_cache"')
+    elif smode != 1:
+        raise ValueError('"smode" must be 0 or 1')
+
+    if motion_threshold is not None:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"motion_threshold" requires the CPU backend')
+        if spectrum_cache is not None or smode == 0:
+            raise ValueError('"motion_threshold" cannot be used with "spectrum_cache" or smode=0')
+        if lookahead is not None and lookahead != radius:
+            raise ValueError('"motion_threshold" requires the default "lookahead"')
+
+    if downscale:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"downscale" requires the CPU backend')
+        if (
+            flat_sosize is not None or spectrum_cache is not None or
+            smode == 0 or motion_threshold is not None
+        ):
+            raise ValueError(
+                '"downscale" cannot be used with "flat_sosize", "spectrum_cache", '
+                'smode=0 or "motion_threshold"'
+            )
+        if block_step % 2 != 0:
+            raise ValueError('"downscale" requires an even sbsize - sosize')
+        if planes is not None and set([planes] if isinstance(planes, int) else planes) != set(range(clip.format.num_planes)):
+            raise ValueError('"downscale" requires all planes to be processed')
+
+    if recursive is not None:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"recursive" requires the CPU backend')
+        if radius != 0:
+            raise ValueError('"recursive" requires tbsize=1')
+        if ftype >= 2:
+            raise ValueError('"recursive" requires ftype 0 or 1')
+        if flat_sosize is not None or spectrum_cache is not None or smode == 0 or downscale:
+            raise ValueError(
+                '"recursive" cannot be used with "flat_sosize", "spectrum_cache", '
+                'smode=0 or "downscale"'
+            )
+        if not 0 < recursive < 1:
+            raise ValueError('"recursive" must be in (0, 1)')
+
+    if exclude_borders:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"exclude_borders" requires the CPU backend')
+        if spectrum_cache is not None or smode == 0 or downscale or recursive is not None:
+            raise ValueError('"exclude_borders" cannot be used with "spectrum_cache", smode=0, "downscale" or "recursive"')
+
+    if align != 0:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"align" requires the CPU backend')
+        if not 0 < align < block_size // 2:
+            raise ValueError('"align" must be in [0, sbsize / 2 - 1]')
+        if (
+            spectrum_cache is not None or smode == 0 or
+            motion_threshold is not None or downscale
+        ):
+            raise ValueError(
+                '"align" cannot be used with "spectrum_cache", smode=0, '
+                '"motion_threshold" or "downscale"'
+            )
+
+    if grain_table is not None:
+        if not isinstance(backend, Backend.CPU):
+            raise ValueError('"grain_table" requires the CPU backend')
+        if spectrum_cache is not None or downscale:
+            raise ValueError('"grain_table" cannot be used with "spectrum_cache" or "downscale"')
+        if grain_period < 0:
+            raise ValueError('"grain_period" must be non-negative')
+
     # compute constants
     try:
         sigma_scalar = float(sigma) # type: ignore
@@ -266,39 +439,12 @@ def DFTTest2(
         # compute sigma_array
 
         sigma_is_scalar = False
-
-        sigma_funcs = typing.cast(typing.Sequence[typing.Callable[[float], float]], sigma)
-        if callable(sigma_funcs):
-            sigma_funcs = [sigma_funcs]
-        else:
-            sigma_funcs = list(sigma_funcs)
-        sigma_funcs.extend([sigma_funcs[-1]] * 3)
-        sigma_func_x, sigma_func_y, sigma_func_t = sigma_funcs[:3]
-
-        sigma_array = []
-
-        if ssystem == 0:
-            for t in range(2 * radius + 1):
-                sigma_t = get_sigma(position=t, length=2*radius+1, func=sigma_func_t)
-                for y in range(block_size):
-                    sigma_y = get_sigma(position=y, length=block_size, func=sigma_func_y)
-                    for x in range(block_size // 2 + 1):
-                        sigma_x = get_sigma(position=x, length=block_size, func=sigma_func_x)
-
-                        sigma = sigma_t * sigma_y * sigma_x
-                        sigma_array.append(sigma)
-        else:
-            for t in range(2 * radius + 1):
-                loc_t = get_location(position=t, length=2*radius+1)
-                for y in range(block_size):
-                    loc_y = get_location(position=y, length=block_size)
-                    for x in range(block_size // 2 + 1):
-                        loc_x = get_location(position=x, length=block_size)
-
-                        ndim = 3 if radius > 0 else 2
-                        location = math.sqrt((loc_t * loc_t + loc_y * loc_y + loc_x * loc_x) / ndim)
-                        sigma = sigma_func_t(location)
-                        sigma_array.append(sigma)
+        sigma_array = get_sigma_array(
+            sigma=typing.cast(typing.Sequence[typing.Callable[[float], float]], sigma),
+            ssystem=ssystem,
+            radius=radius,
+            block_size=block_size
+        )
 
     window = get_window(
         radius=radius,
@@ -307,12 +453,35 @@ def DFTTest2(
         spatial_window_mode=spatial_window_mode,
         temporal_window_mode=temporal_window_mode,
         spatial_beta=spatial_beta,
-        temporal_beta=temporal_beta
+        temporal_beta=temporal_beta,
+        lookahead=lookahead
     )
 
     wscale = math.fsum(w * w for w in window)
 
-    if ftype < 2:
+    # windows of the temporal blocks of motion-adaptive blocks, the plugin
+    # scales sigma to their energy
+    motion_window = []
+    if motion_threshold is not None:
+        for reduced_radius in range(radius):
+            motion_window.extend(get_window(
+                radius=reduced_radius,
+                block_size=block_size,
+                block_step=block_step,
+                spatial_window_mode=spatial_window_mode,
+                temporal_window_mode=temporal_window_mode,
+                spatial_beta=spatial_beta,
+                temporal_beta=temporal_beta
+            ))
+
+    if auto_sigma is not None:
+        # sigma is relative to the noise power estimated on each frame,
+        # which already includes the window energy
+        if sigma_is_scalar:
+            sigma_scalar = auto_sigma
+        else:
+            sigma_array = [s * auto_sigma for s in sigma_array]
+    elif ftype < 2:
         if sigma_is_scalar:
             sigma_scalar *= wscale
         else:
@@ -327,7 +496,7 @@ def DFTTest2(
     elif isinstance(backend, Backend.NVRTC):
         rdft = core.dfttest2_nvrtc.RDFT
     elif isinstance(backend, Backend.CPU):
-        rdft = core.dfttest2_avx2.RDFT
+        rdft = cpu_plugin().RDFT
     else:
         raise TypeError("unknown backend")
 
@@ -342,8 +511,21 @@ def DFTTest2(
             shape=(2 * radius + 1, block_size, block_size)
         )
 
+    if isinstance(backend, Backend.CPU) and spectrum_cache is not None:
+        return cpu_plugin().DFTTestCached(
+            clip,
+            path=spectrum_cache,
+            sigma=[sigma_scalar] * (2 * radius + 1) * block_size * (block_size // 2 + 1) if sigma_is_scalar else sigma_array,
+            sigma2=sigma2,
+            pmin=pmin,
+            pmax=pmax,
+            filter_type=filter_type,
+            window=window,
+            planes=planes
+        )
+
     if isinstance(backend, Backend.CPU):
-        return core.dfttest2_avx2.DFTTest(
+        return cpu_plugin().DFTTest(
             clip,
             window=window,
             sigma=[sigma_scalar] * (2 * radius + 1) * block_size * (block_size // 2 + 1) if sigma_is_scalar else sigma_array,
@@ -355,7 +537,23 @@ def DFTTest2(
             block_step=block_step,
             planes=planes,
             filter_type=filter_type,
-            window_freq=window_freq
+            window_freq=window_freq,
+            numa=backend.numa,
+            perf=backend.perf,
+            autotune=backend.autotune,
+            sparse_block_step=0 if flat_sosize is None else block_size - flat_sosize,
+            sparse_threshold=flat_threshold,
+            auto_sigma=auto_sigma is not None,
+            lookahead=-1 if lookahead is None else lookahead,
+            smode=smode,
+            motion_threshold=0.0 if motion_threshold is None else motion_threshold,
+            motion_window=motion_window,
+            downscale=downscale,
+            recursive=0.0 if recursive is None else recursive,
+            exclude_borders=exclude_borders,
+            align=align,
+            grain_table="" if grain_table is None else grain_table,
+            grain_period=grain_period
         )
 
     if isinstance(backend, Backend.cuFFT):
@@ -571,7 +769,19 @@ def DFTTest(
     ]] = None,
     ssystem: typing.Literal[0, 1] = 0,
     planes: typing.Optional[typing.Union[int, typing.Sequence[int]]] = None,
-    backend: typing.Optional[backendT] = None
+    backend: typing.Optional[backendT] = None,
+    flat_sosize: typing.Optional[int] = None,
+    flat_threshold: float = 64.0,
+    spectrum_cache: typing.Optional[str] = None,
+    auto_sigma: typing.Optional[float] = None,
+    lookahead: typing.Optional[int] = None,
+    motion_threshold: typing.Optional[float] = None,
+    downscale: bool = False,
+    recursive: typing.Optional[float] = None,
+    exclude_borders: bool = False,
+    align: int = 0,
+    grain_table: typing.Optional[str] = None,
+    grain_period: int = 0
 ) -> vs.VideoNode:
     """ 2D/3D frequency domain denoiser
 
@@ -613,9 +823,17 @@ def DFTTest(
 
         sbsize: Sets the length of the sides of the spatial window.
             Must be 1 or greater. Must be odd if using smode=0.
+            The CPU backend uses sbsize=16 with smode=0 as well, and the block
+            of a pixel spans 8 pixels before and 7 pixels after it.
 
         smode: Sets the mode for spatial operation.
-            Currently only tmode=1 is implemented.
+                0: every pixel is filtered in its own block, centred on it,
+                   and only that pixel of the block is kept (CPU backend only).
+                   sosize is ignored. The spectra are built from horizontal
+                   spectra shared by all blocks, and the pixel is computed from
+                   the filtered spectrum directly, so it costs roughly 15-20
+                   times sosize=12 rather than sbsize*sbsize times.
+                1: overlapping blocks are combined by overlap-add.
 
         sosize: Sets the spatial overlap amount.
             Must be in the range 0 to sbsize-1 (inclusive).
@@ -674,11 +892,93 @@ def DFTTest(
         planes: Sets which planes will be processed.
             Any unprocessed planes will be simply copied.
 
+        flat_sosize: Spatial overlap used on flat regions (CPU backend only).
+            Blocks are placed with sosize on 16x16 tiles whose mean squared gradient
+            (in 8-bit units) exceeds flat_threshold, and with flat_sosize elsewhere.
+            sbsize-flat_sosize must be a multiple of sbsize-sosize that is at most sbsize/2,
+            e.g. flat_sosize=8 for sosize=12.
+
+        flat_threshold: Gradient energy threshold of flat_sosize.
+
+        spectrum_cache: Path of a file written by ExportSpectra (CPU backend only).
+            The spectra are read from the file instead of being computed from the clip,
+            which is then only used for its format, frame properties and unprocessed planes,
+            e.g. core.std.BlankClip(src) avoids decoding the source.
+            sbsize, sosize, tbsize, swin, twin, sbeta, tbeta and zmean must match the export.
+
+        auto_sigma: Estimates the noise power of each plane of each frame (CPU backend only).
+            The noise is measured as the median high-frequency power of non-overlapping blocks,
+            and the threshold of ftype 0 and 1 becomes auto_sigma times the estimate,
+            so auto_sigma=1.0 roughly corresponds to sigma set to the noise variance.
+            sigma is ignored, while slocation, ssx, ssy and sst scale the threshold per frequency.
+
+        lookahead: Number of future frames in the temporal block, in [0, tbsize-1] (CPU backend only).
+            By default the block is centred on the output frame (tbsize//2).
+            lookahead=0 is causal: frame n is filtered with frames n-tbsize+1 to n,
+            so no later frame is needed, e.g. for low latency filtering of live sources.
+            The temporal window is shifted to peak at the output frame.
+
+        motion_threshold: Reduces tbsize per block where the neighbouring frames differ (CPU backend only).
+            Each block is compared with the blocks at the same position in the other frames,
+            from the nearest ones outwards. If the mean absolute difference (in 8-bit units)
+            to the frame at distance d exceeds motion_threshold, the block is filtered with
+            tbsize=2*d-1 and the temporal window of that size, so moving areas do not ghost
+            and cost less, while static ones keep the full tbsize. It should be above the
+            difference caused by noise alone, e.g. about twice the noise standard deviation.
+
+        downscale: Returns the filtered clip at half the width and height (CPU backend only).
+            The spectrum of each filtered block is cropped to its lower half frequencies
+            and inverse transformed at 8x8 within the same pass, instead of filtering at full
+            resolution and resizing afterwards. The result is close to a 2x2 box downscale
+            of the full resolution output. It requires all planes to be processed, plane
+            dimensions that are multiples of 4 and an even sbsize-sosize.
+
+        recursive: Filters each frame against the previous filtered frame instead of a temporal
+            block (CPU backend only, requires tbsize=1 and ftype 0 or 1). This is the weight of the
+            previous frame in (0, 1). Each frequency of a block moves from its filtered value in the
+            previous frame towards the current one, by 1-recursive where they differ by noise and
+            entirely where they differ by more than sigma, and is then filtered spatially against
+            the noise left in it. Static content is averaged over about (1+recursive)/(1-recursive)
+            frames, e.g. 0.67 is close to tbsize=5, at the cost of tbsize=1.
+            Frames must be requested in order: the filter runs on one frame at a time, and
+            seeking restarts the recursion, so the first frame after a seek is filtered as with tbsize=1.
+
+        exclude_borders: Skips the blocks in uniform borders (CPU backend only).
+            The rows and columns at the edges of each plane that only hold the value of their
+            corner, e.g. letterbox or pillarbox bars, are copied to the output, and only the blocks
+            overlapping the rest of the plane are filtered. The output inside the borders is the
+            same as without the option.
+
+        align: Aligns the blocks of the other frames of the temporal block to the block of the
+            output frame before the temporal transform (CPU backend only, requires tbsize > 1).
+            This is the largest displacement in samples, at most sbsize / 2 - 1, 0 disables it.
+            The displacement of each block is estimated by phase correlation of the 2D spectra
+            that the filter computes anyway, and the block is fetched again at that integer
+            offset. It is kept only if it matches the output block better than the unaligned
+            one, so static content is filtered as without the option. Blocks further away in
+            time start from the motion of the nearer ones. Mixed motion inside of a block is
+            not compensated.
+
+        grain_table: Path of an AV1 film grain table (aomenc's --film-grain-table) describing
+            the noise removed from the clip (CPU backend only). The residual of the filter is
+            fitted with an auto-regressive model of lag 3 and a scaling function of the output
+            intensity for each plane, so that an encoder can resynthesize the grain of the source.
+            The table is written when the filter is freed, and only covers the requested frames.
+
+        grain_period: Frames per entry of the grain table, 0 for a single entry.
+
         backend: Backend implementation to use.
             All available backends can be found in the dfttest2.Backend "namespace":
                 dfttest2.Backend.{CPU, cuFFT, NVRTC}
             
             The CPU and NVRTC backend require sbsize=16.
+            Backend.CPU(numa=True) keeps the buffers and tables of each NUMA node
+            on that node on multi-socket systems.
+            Backend.CPU(perf=True) attaches the hardware counters of each pipeline stage
+            to the output frames (linux only).
+            Backend.CPU(autotune=True) times a few block traversal orders for the frame size
+            when the filter is created and keeps the fastest in ~/.cache/dfttest2/tune.txt
+            (%LOCALAPPDATA%\\dfttest2\\tune.txt on windows), so it is measured once per machine.
             The cuFFT and NVRTC backend require a CUDA-enabled system.
             
             Speed: NVRTC >> cuFFT > CPU
@@ -700,10 +1000,10 @@ def DFTTest(
     if sbsize < 1:
         raise ValueError("sbsize must be greater than or equal to 1")
 
-    if smode != 1:
-        raise ValueError('"smode" must be 1')
+    if smode not in (0, 1):
+        raise ValueError('"smode" must be 0 or 1')
 
-    if sosize > sbsize // 2 and (sbsize % (sbsize - sosize) != 0):
+    if smode == 1 and sosize > sbsize // 2 and (sbsize % (sbsize - sosize) != 0):
         raise ValueError("spatial overlap greater than 50% requires that sbsize-sosize is a divisor of sbsize")
 
     if swin < 0 or swin > 11:
@@ -765,5 +1065,218 @@ def DFTTest(
         f0beta = f0beta,
         ssystem = ssystem,
         planes = planes,
-        backend = select_backend(backend, sbsize, tbsize)
+        backend = (
+            Backend.CPU()
+            if backend is None and (
+                flat_sosize is not None or spectrum_cache is not None or
+                auto_sigma is not None or lookahead is not None or smode == 0 or
+                motion_threshold is not None or downscale or recursive is not None or
+                exclude_borders or align != 0 or grain_table is not None
+            )
+            else select_backend(backend, sbsize, tbsize)
+        ),
+        flat_sosize = flat_sosize,
+        flat_threshold = flat_threshold,
+        spectrum_cache = spectrum_cache,
+        auto_sigma = auto_sigma,
+        lookahead = lookahead,
+        smode = smode,
+        motion_threshold = motion_threshold,
+        downscale = downscale,
+        recursive = recursive,
+        exclude_borders = exclude_borders,
+        align = align,
+        grain_table = grain_table,
+        grain_period = grain_period
     )
+
+
+def ExportSpectra(
+    clip: vs.VideoNode,
+    path: str,
+    sbsize: int = 16,
+    sosize: int = 12,
+    tbsize: int = 3,
+    swin: typing.Literal[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11] = 0,
+    twin: typing.Literal[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11] = 7,
+    sbeta: float = 2.5,
+    tbeta: float = 2.5,
+    zmean: bool = True,
+    planes: typing.Optional[typing.Union[int, typing.Sequence[int]]] = None,
+    half: bool = False
+) -> vs.VideoNode:
+    """ Writes the block spectra of a clip for DFTTest(spectrum_cache=path)
+
+    Returns the input clip. The spectrum of each frame is written to the memory-mapped
+    file at path when the frame is requested, so every frame has to be requested once,
+    e.g. with "vspipe script.vpy --". Filtering from the file then skips decoding and the
+    spatial forward transforms, which makes it cheap to iterate on ftype, sigma,
+    sigma2, pmin, pmax and the sigma functions.
+
+    The window parameters must be the same as in the later DFTTest call.
+    Each frame uses about (4 or 2) * 9 * 32 bytes per block step of each plane,
+    e.g. sosize=12 on 1080p yields about 230 MB per frame for YUV420P8.
+
+    half: Store the spectra in half precision, which halves the file size
+        and is within 1 LSB of the float result for 8-bit input.
+    """
+
+    radius = (tbsize - 1) // 2
+    block_size = sbsize
+    block_step = sbsize - sosize
+
+    if radius not in range(4):
+        raise ValueError("invalid radius (tbsize)")
+    if block_size != 16:
+        raise ValueError("invalid block_size (sbsize)")
+
+    window = get_window(
+        radius=radius,
+        block_size=block_size,
+        block_step=block_step,
+        spatial_window_mode=swin,
+        temporal_window_mode=twin,
+        spatial_beta=sbeta,
+        temporal_beta=tbeta
+    )
+
+    if radius == 0:
+        window_freq = cpu_plugin().RDFT(
+            data=[w * 255 for w in window],
+            shape=(block_size, block_size)
+        )
+    else:
+        window_freq = cpu_plugin().RDFT(
+            data=[w * 255 for w in window],
+            shape=(2 * radius + 1, block_size, block_size)
+        )
+
+    return cpu_plugin().DFTTestExport(
+        clip,
+        path=path,
+        window=window,
+        radius=radius,
+        block_size=block_size,
+        block_step=block_step,
+        zero_mean=zmean,
+        window_freq=window_freq,
+        planes=planes,
+        half=half
+    )
+
+
+def process(
+    array: typing.Any,
+    ftype: typing.Literal[0, 1, 2, 3, 4] = 0,
+    sigma: typing.Union[float, typing.Sequence[typing.Callable[[float], float]]] = 8.0,
+    sigma2: float = 8.0,
+    pmin: float = 0.0,
+    pmax: float = 500.0,
+    sbsize: int = 16,
+    sosize: int = 12,
+    tbsize: int = 3,
+    swin: typing.Literal[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11] = 0,
+    twin: typing.Literal[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11] = 7,
+    sbeta: float = 2.5,
+    tbeta: float = 2.5,
+    zmean: bool = True,
+    f0beta: float = 1.0,
+    ssystem: typing.Literal[0, 1] = 0,
+    planes: typing.Optional[typing.Union[int, typing.Sequence[int]]] = None,
+    flat_sosize: typing.Optional[int] = None,
+    flat_threshold: float = 64.0,
+    auto_sigma: typing.Optional[float] = None,
+    lookahead: typing.Optional[int] = None,
+    autotune: bool = False,
+    smode: typing.Literal[0, 1] = 1,
+    motion_threshold: typing.Optional[float] = None,
+    recursive: typing.Optional[float] = None,
+    exclude_borders: bool = False,
+    align: int = 0,
+    bits: typing.Optional[int] = None,
+    num_threads: int = 0,
+    out: typing.Any = None
+) -> typing.Any:
+    """ Runs the CPU backend on frames in memory, without VapourSynth
+
+    array: uint8, uint16 or float32 buffer (e.g. a numpy array) of shape (T, H, W)
+        or (T, C, H, W) with 1 to 3 channels, holding T consecutive frames.
+        Rows must be contiguous. The data is read in place.
+
+    The filter parameters are the same as in DFTTest2(). As in DFTTest(), the first
+    and last frames are repeated beyond the ends of the array. auto_sigma, lookahead,
+    smode, motion_threshold, recursive, exclude_borders and align are described in
+    DFTTest(), autotune in Backend.CPU.
+    With recursive, the frames are filtered in order on a single thread.
+
+    bits: Bit depth of uint16 input, 16 by default.
+
+    num_threads: Number of worker threads, 0 for the number of logical processors.
+        The GIL is released while filtering.
+
+    out: Buffer of the same shape and dtype receiving the result. It may be
+        the input array itself. By default a new numpy array is returned.
+    """
+
+    import array as _array
+
+    import _dfttest2
+
+    if out is None:
+        import numpy
+        out = numpy.empty_like(array)
+
+    radius = (tbsize - 1) // 2
+
+    try:
+        sigma_scalar = float(sigma) # type: ignore
+        sigma_array = None
+    except:
+        sigma_scalar = 8.0
+        sigma_array = _array.array("f", get_sigma_array(
+            sigma=typing.cast(typing.Sequence[typing.Callable[[float], float]], sigma),
+            ssystem=ssystem,
+            radius=radius,
+            block_size=sbsize
+        ))
+
+    if planes is None:
+        planes_mask = 0b111
+    elif isinstance(planes, int):
+        planes_mask = 1 << planes
+    else:
+        planes_mask = sum(1 << plane for plane in set(planes))
+
+    _dfttest2.process(
+        array, out,
+        ftype=ftype,
+        sigma=sigma_scalar,
+        sigma_array=sigma_array,
+        sigma2=sigma2,
+        pmin=pmin,
+        pmax=pmax,
+        sbsize=sbsize,
+        sosize=sosize,
+        tbsize=tbsize,
+        swin=swin,
+        twin=twin,
+        sbeta=sbeta,
+        tbeta=tbeta,
+        zmean=zmean,
+        f0beta=f0beta,
+        planes=planes_mask,
+        flat_sosize=-1 if flat_sosize is None else flat_sosize,
+        flat_threshold=flat_threshold,
+        auto_sigma=0.0 if auto_sigma is None else auto_sigma,
+        lookahead=-1 if lookahead is None else lookahead,
+        autotune=autotune,
+        smode=smode,
+        motion_threshold=0.0 if motion_threshold is None else motion_threshold,
+        recursive=0.0 if recursive is None else recursive,
+        exclude_borders=exclude_borders,
+        align=align,
+        bits=0 if bits is None else bits,
+        num_threads=num_threads
+    )
+
+    return out